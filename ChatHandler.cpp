@@ -25,6 +25,9 @@
 #include "WorldSession.h"
 #include "DatabaseEnv.h"
 #include "SocketConnector.h" //WowChat
+#include "SocketConnectorRegistry.h" //WowChat
+#include "SocketConnectorChannels.h" //WowChat
+#include "SocketConnectorEventBus.h" //WowChat
 
 #include "CellImpl.h"
 #include "Chat.h"
@@ -281,30 +284,27 @@ void WorldSession::HandleMessagechatOpcode(WorldPacket & recv_data)
             bool senderIsPlayer = AccountMgr::IsPlayerAccount(GetSecurity());
             bool receiverIsPlayer = AccountMgr::IsPlayerAccount(receiver ? receiver->GetSession()->GetSecurity() : SEC_PLAYER);
 
-            std::list<SocketConnector*>::const_iterator iterator;
-            for (iterator = SocketConnector::connections->begin(); iterator != SocketConnector::connections->end(); ++iterator)
+            SocketConnectorRegistry::ReadGuard connections;
+            if (SocketConnector* webReceiver = connections.FindByName(to))
             {
-                if ((*iterator)->playerName.compare(to.c_str()) == 0)
+                uint8 playerFaction = webReceiver->playerFaction;
+                if (lang == LANG_UNIVERSAL || 
+                    (lang == LANG_ORCISH && playerFaction == 1) || 
+                    (lang == LANG_COMMON && playerFaction == 0) || 
+                    sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT))
                 {
-                    uint8 playerFaction = (*iterator)->playerFaction;
-                    if (lang == LANG_UNIVERSAL || 
-                        (lang == LANG_ORCISH && playerFaction == 1) || 
-                        (lang == LANG_COMMON && playerFaction == 0) || 
-                        sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT))
-                    {
-                        (*iterator)->sendMessage("w\\" + senderName + "\\" + msg);
-                        WorldPacket data(SMSG_MESSAGECHAT, 200);
-                        data << uint8(CHAT_MSG_WHISPER_INFORM);
-                        data << uint32(LANG_UNIVERSAL);
-                        data << uint64((*iterator)->playerGuid);
-                        data << uint32(LANG_UNIVERSAL);
-                        data << uint64((*iterator)->playerGuid);
-                        data << uint32(msg.length() + 1);
-                        data << msg;
-                        data << uint8(0);
-                        GetPlayer()->GetSession()->SendPacket(&data);
-                        return;
-                    }
+                    sSocketConnectorEventBus->Publish(SocketConnectorEventBus::EVENT_WHISPER, GetPlayer()->GetGUID(), senderName, lang, 0, to, msg);
+                    WorldPacket data(SMSG_MESSAGECHAT, 200);
+                    data << uint8(CHAT_MSG_WHISPER_INFORM);
+                    data << uint32(LANG_UNIVERSAL);
+                    data << uint64(webReceiver->playerGuid);
+                    data << uint32(LANG_UNIVERSAL);
+                    data << uint64(webReceiver->playerGuid);
+                    data << uint32(msg.length() + 1);
+                    data << msg;
+                    data << uint8(0);
+                    GetPlayer()->GetSession()->SendPacket(&data);
+                    return;
                 }
             }
 
@@ -377,19 +377,7 @@ void WorldSession::HandleMessagechatOpcode(WorldPacket & recv_data)
 
                     //Wowchat --->
                     if (lang != LANG_ADDON)
-                    {
-                        std::string senderName = GetPlayer()->GetName();
-                        uint32 guildGuid = GetPlayer()->GetGuildId();
-                        std::list<SocketConnector*>::const_iterator iterator;
-
-                        for (iterator = SocketConnector::connections->begin(); iterator != SocketConnector::connections->end(); ++iterator)
-                        {
-                            if ((*iterator)->guildGuid == guildGuid)
-                            {
-                                (*iterator)->sendMessage("g\\" + senderName + "\\" + msg);
-                            }
-                        }
-                    }
+                        sSocketConnectorEventBus->Publish(SocketConnectorEventBus::EVENT_GUILD, GetPlayer()->GetGUID(), GetPlayer()->GetName(), lang, GetPlayer()->GetGuildId(), "", msg);
                     //<--- Wowchat
                 }
             }
@@ -519,7 +507,16 @@ void WorldSession::HandleMessagechatOpcode(WorldPacket & recv_data)
 
             if (ChannelMgr* cMgr = channelMgr(_player->GetTeam()))
             {
-                if (Channel* chn = cMgr->GetChannel(channel, _player))
+                //WowChat: the session keeps the channel it spoke in last, GetChannel reports unknown channels to the player
+                Channel* chn = sSocketConnectorChannels->Find(m_lastChannel, channel);
+                if (!chn)
+                {
+                    chn = cMgr->GetChannel(channel, _player);
+                    if (chn)
+                        sSocketConnectorChannels->Remember(m_lastChannel, channel, chn);
+                }
+
+                if (chn)
                 {
                     if (chn->IsLFG() && !_player->isGameMaster())
                     {
@@ -548,19 +545,7 @@ void WorldSession::HandleMessagechatOpcode(WorldPacket & recv_data)
                     GetPlayer()->HandleChatSpyMessage(msg, CHAT_MSG_CHANNEL, lang, NULL, channel);
 
                     if (chn->IsLFG())
-                    {
-                        std::string senderName = GetPlayer()->GetName();
-                        std::list<SocketConnector*>::const_iterator iterator;
-                        for (iterator = SocketConnector::connections->begin(); iterator != SocketConnector::connections->end(); ++iterator)
-                        {
-                            int playerFaction = (*iterator)->playerFaction;
-                            if (lang == LANG_UNIVERSAL || 
-                                (lang == LANG_ORCISH && playerFaction == 1) || 
-                                (lang == LANG_COMMON && playerFaction == 0) || 
-                                sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT))
-                                (*iterator)->sendMessage("m\\" + senderName + "\\" + msg);
-                        }
-                    }
+                        sSocketConnectorEventBus->Publish(SocketConnectorEventBus::EVENT_LFG, GetPlayer()->GetGUID(), GetPlayer()->GetName(), lang, 0, channel, msg);
                 }
             }
         } break;
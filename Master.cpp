@@ -33,6 +33,8 @@
 #include "Database/DatabaseEnv.h"
 #include "Database/DatabaseWorkerPool.h"
 #include "SocketConnectorRunnable.h" //WowChat
+#include "SocketConnectorDatabase.h" //WowChat
+#include "SocketConnectorAffinity.h" //WowChat
 
 #include "CliRunnable.h"
 #include "Log.h"
@@ -158,9 +160,14 @@ int Master::Run()
         sLog->outString("Daemon PID: %u\n", pid);
     }
 
+    ///- Place the worldserver threads on Linux, every thread inherits the placement of the thread that starts it
+    SocketConnectorAffinity::Load(); //WowChat
+
     ///- Start the databases
+    SocketConnectorAffinity::Enter(SocketConnectorAffinity::ROLE_DATABASE); //WowChat
     if (!_StartDB())
         return 1;
+    SocketConnectorAffinity::Restore(); //WowChat
 
     // set server offline (not connectable)
     LoginDatabase.DirectPExecute("UPDATE realmlist SET color = (color & ~%u) | %u WHERE id = '%d'", REALM_FLAG_OFFLINE, REALM_FLAG_INVALID, realmID);
@@ -183,8 +190,11 @@ int Master::Run()
     #endif /* _WIN32 */
 
     ///- Launch WorldRunnable thread
+    SocketConnectorAffinity::Enter(SocketConnectorAffinity::ROLE_WORLD); //WowChat
     ACE_Based::Thread world_thread(new WorldRunnable);
-    world_thread.setPriority(ACE_Based::Highest);
+    SocketConnectorAffinity::Restore(); //WowChat
+    if (!SocketConnectorAffinity::IsWorldRealtime()) //WowChat
+        world_thread.setPriority(ACE_Based::Highest);
 
     ACE_Based::Thread* cliThread = NULL;
 
@@ -198,8 +208,11 @@ int Master::Run()
         cliThread = new ACE_Based::Thread(new CliRunnable);
     }
 
+    SocketConnectorAffinity::Enter(SocketConnectorAffinity::ROLE_NETWORK); //WowChat
     ACE_Based::Thread rar_thread(new RARunnable);
+    SocketConnectorAffinity::Enter(SocketConnectorAffinity::ROLE_WEBCHAT); //WowChat
     ACE_Based::Thread socket_connector_thread(new SocketConnectorRunnable); //WowChat
+    SocketConnectorAffinity::Restore(); //WowChat
 
     ///- Handle affinity for multiple processors and process priority on Windows
     #ifdef _WIN32
@@ -251,7 +264,9 @@ int Master::Run()
     {
         TCSoapRunnable *runnable = new TCSoapRunnable();
         runnable->setListenArguments(sConfig->GetStringDefault("SOAP.IP", "127.0.0.1"), sConfig->GetIntDefault("SOAP.Port", 7878));
+        SocketConnectorAffinity::Enter(SocketConnectorAffinity::ROLE_NETWORK); //WowChat
         soap_thread = new ACE_Based::Thread(runnable);
+        SocketConnectorAffinity::Restore(); //WowChat
     }
 
     ///- Start up freeze catcher thread
@@ -259,7 +274,9 @@ int Master::Run()
     {
         FreezeDetectorRunnable *fdr = new FreezeDetectorRunnable();
         fdr->SetDelayTime(freeze_delay*1000);
+        SocketConnectorAffinity::Enter(SocketConnectorAffinity::ROLE_FREEZE_DETECTOR); //WowChat
         ACE_Based::Thread freeze_thread(fdr);
+        SocketConnectorAffinity::Restore(); //WowChat
         freeze_thread.setPriority(ACE_Based::Highest);
     }
 
@@ -267,12 +284,14 @@ int Master::Run()
     uint16 wsport = sWorld->getIntConfig(CONFIG_PORT_WORLD);
     std::string bind_ip = sConfig->GetStringDefault("BindIP", "0.0.0.0");
 
+    SocketConnectorAffinity::Enter(SocketConnectorAffinity::ROLE_NETWORK); //WowChat
     if (sWorldSocketMgr->StartNetwork(wsport, bind_ip.c_str ()) == -1)
     {
         sLog->outError("Failed to start network");
         World::StopNow(ERROR_EXIT_CODE);
         // go down and shutdown the server
     }
+    SocketConnectorAffinity::Restore(); //WowChat
 
     // set server online (allow connecting now)
     LoginDatabase.DirectPExecute("UPDATE realmlist SET color = color & ~%u, population = 0 WHERE id = '%u'", REALM_FLAG_INVALID, realmID);
@@ -441,6 +460,10 @@ bool Master::_StartDB()
         return false;
     }
 
+    ///- Initialise the web chat pools, the game ones are used if they are disabled
+    if (!SocketConnectorDatabase::Open()) //WowChat
+        return false;
+
     ///- Get the realm Id from the configuration file
     realmID = sConfig->GetIntDefault("RealmID", 0);
     if (!realmID)
@@ -470,6 +493,7 @@ bool Master::_StartDB()
 
 void Master::_StopDB()
 {
+    SocketConnectorDatabase::Close(); //WowChat
     CharacterDatabase.Close();
     WorldDatabase.Close();
     LoginDatabase.Close();
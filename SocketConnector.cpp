@@ -26,23 +26,156 @@
 #include "AccountMgr.h"
 #include "Log.h"
 #include "SocketConnector.h"
-#include "ChannelMgr.h"
+#include "SocketConnectorRegistry.h"
+#include "SocketConnectorRunnable.h"
+#include "SocketConnectorModeration.h"
+#include "SocketConnectorAuth.h"
+#include "SocketConnectorTokens.h"
+#include "SocketConnectorCharacters.h"
+#include "SocketConnectorWebSocket.h"
+#include "SocketConnectorLines.h"
+#include "SocketConnectorUring.h"
+#include "SocketConnectorInbox.h"
+#include "SocketConnectorFanout.h"
+#include "SocketConnectorAdmission.h"
 #include "ObjectMgr.h"
-#include "GuildMgr.h"
 #include "Util.h"
 #include "World.h"
-#include "SHA1.h"
 #include <string>
+#include <sstream>
+#include <algorithm>
+
+#include <ace/OS_NS_sys_time.h>
+#include <ace/os_include/netinet/os_tcp.h>
+
+uint32 SocketConnector::s_maxLineLength = 4096;
+uint32 SocketConnector::s_sendQueueMaxFrames = 512;
+uint32 SocketConnector::s_sendQueueMaxBytes = 256 * 1024;
+SocketConnector::SlowConsumerPolicy SocketConnector::s_slowConsumerPolicy = SocketConnector::SLOW_CONSUMER_DROP_OLDEST;
+ACE_Time_Value SocketConnector::s_flushWindow = ACE_Time_Value::zero;
+uint32 SocketConnector::s_flushMaxBytes = 16 * 1024;
+bool SocketConnector::s_flushCork = false;
+uint32 SocketConnector::s_loginTimeout = 30;
+uint32 SocketConnector::s_idleTimeout = 90;
+uint32 SocketConnector::s_pongTimeout = 30;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint32> SocketConnector::s_totalTimeouts;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint64> SocketConnector::s_totalWriteCalls;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint64> SocketConnector::s_totalWrittenFrames;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint64> SocketConnector::s_totalFlushes;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint64> SocketConnector::s_totalFlushDelay;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint64> SocketConnector::s_totalReadCalls;
+bool SocketConnector::s_webSocketEnabled = true;
+SocketConnectorWebSocket::Settings SocketConnector::s_webSocket;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint32> SocketConnector::s_totalDroppedFrames;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint32> SocketConnector::s_totalSlowConsumerKicks;
+
+#define FRAME_LOCK_STRIPES 16
+#define MAX_WRITE_IOV 64                                    // frames per sendv call
+#define MAX_STAGE_BYTES (64 * 1024)                         // encoded bytes per send call in websocket / v2 mode
+
+const SocketConnector::PacketHandler SocketConnector::s_packetHandlers[MAX_V2_OPCODE] =
+{
+    &SocketConnector::handle_line_packet,                   // V2_LINE
+    &SocketConnector::handle_chat_packet,                   // V2_CHAT
+    &SocketConnector::handle_whisper_packet,                // V2_WHISPER
+    &SocketConnector::handle_guild_packet,                  // V2_GUILD
+    NULL,                                                   // V2_PRESENCE
+    NULL,                                                   // V2_ACK
+    NULL,                                                   // V2_TEXT
+    &SocketConnector::handle_ping_packet                    // V2_PING
+};
+
+ACE_Lock_Adapter<ACE_Thread_Mutex> SocketConnector::s_frameLocks[FRAME_LOCK_STRIPES];
+ACE_Atomic_Op<ACE_Thread_Mutex, uint32> SocketConnector::s_frameLockIndex;
+
+ACE_Atomic_Op<ACE_Thread_Mutex, uint32> SocketConnector::s_nextSerial;
+
+SocketConnector::SocketConnector() : accountGuid(0), playerGuid(0), guildGuid(0), playerFaction(0),
+    m_Serial(++s_nextSerial), m_state(STATE_WAIT_USER), m_RemoteHost(0), m_AuthRequest(NULL), m_Shard(NULL), m_ShardIndex(0), m_Uring(NULL), m_UringLink(NULL), m_InBuffer(s_maxLineLength), m_Transport(TRANSPORT_PENDING), m_WebSocket(NULL),
+    m_Protocol(PROTOCOL_LEGACY), m_Timers(NULL), m_LastInput(0), m_PingSent(false),
+    m_OutQueue(s_sendQueueMaxFrames, (ACE_Data_Block*)NULL), m_OutHead(0), m_OutCount(0), m_OutBytes(0), m_OutOffset(0),
+    m_OutStageOffset(0), m_OutStageFrames(0), m_OutInFlight(0), m_OutSending(false), m_OutDropped(0), m_FlushTimer(-1), m_OutActive(false), m_OutClosed(false), m_CloseAfterFlush(false), m_KickRequested(false)
+{
+}
 
-SocketConnector::Connections *SocketConnector::connections = new Connections();
-
-SocketConnector::SocketConnector()
+void SocketConnector::LoadConfig()
 {
-    
+    s_maxLineLength = ConfigMgr::GetIntDefault("SocketConnector.MaxLineLength", 4096);
+    if (s_maxLineLength < 256)
+        s_maxLineLength = 256;
+
+    s_sendQueueMaxFrames = ConfigMgr::GetIntDefault("SocketConnector.SendQueue.MaxFrames", 512);
+    if (s_sendQueueMaxFrames < 16)
+        s_sendQueueMaxFrames = 16;
+
+    s_sendQueueMaxBytes = ConfigMgr::GetIntDefault("SocketConnector.SendQueue.MaxBytes", 256 * 1024);
+    if (s_sendQueueMaxBytes < s_maxLineLength)
+        s_sendQueueMaxBytes = s_maxLineLength;
+
+    uint32 policy = ConfigMgr::GetIntDefault("SocketConnector.SendQueue.Policy", SLOW_CONSUMER_DROP_OLDEST);
+    if (policy > SLOW_CONSUMER_DISCONNECT)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector.SendQueue.Policy (%u) is invalid, using 0 (drop oldest)", policy);
+        policy = SLOW_CONSUMER_DROP_OLDEST;
+    }
+    s_slowConsumerPolicy = SlowConsumerPolicy(policy);
+
+    // microseconds the first queued line waits for more, 0 writes at once
+    s_flushWindow.set(0, 0);
+    s_flushWindow.usec(ConfigMgr::GetIntDefault("SocketConnector.Flush.WindowUs", 0));
+    s_flushMaxBytes = ConfigMgr::GetIntDefault("SocketConnector.Flush.MaxBytes", 16 * 1024);
+    s_flushCork = ConfigMgr::GetBoolDefault("SocketConnector.Flush.Cork", false);
+
+#ifndef TCP_CORK
+    if (s_flushCork)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector.Flush.Cork is not supported on this platform, ignored");
+        s_flushCork = false;
+    }
+#endif
+
+    // seconds, 0 disables; a login step has to follow the previous one within Login
+    s_loginTimeout = ConfigMgr::GetIntDefault("SocketConnector.Timeout.Login", 30);
+    s_idleTimeout = ConfigMgr::GetIntDefault("SocketConnector.Timeout.Idle", 90);
+    s_pongTimeout = ConfigMgr::GetIntDefault("SocketConnector.Timeout.Pong", 30);
+    if (s_idleTimeout && !s_pongTimeout)
+        s_pongTimeout = 1;
+
+    s_webSocketEnabled = ConfigMgr::GetBoolDefault("SocketConnector.WebSocket.Enable", true);
+    s_webSocket.allowDeflate = ConfigMgr::GetBoolDefault("SocketConnector.WebSocket.Deflate", true);
+
+    // 15 is the zlib default, every step down halves the window of both directions
+    s_webSocket.windowBits = ConfigMgr::GetIntDefault("SocketConnector.WebSocket.DeflateWindowBits", MAX_WBITS);
+    if (s_webSocket.windowBits < 9 || s_webSocket.windowBits > MAX_WBITS)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector.WebSocket.DeflateWindowBits (%d) must be between 9 and %d, using %d", s_webSocket.windowBits, MAX_WBITS, MAX_WBITS);
+        s_webSocket.windowBits = MAX_WBITS;
+    }
+
+    s_webSocket.memLevel = ConfigMgr::GetIntDefault("SocketConnector.WebSocket.DeflateMemLevel", 8);
+    if (s_webSocket.memLevel < 1 || s_webSocket.memLevel > MAX_MEM_LEVEL)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector.WebSocket.DeflateMemLevel (%d) must be between 1 and %d, using 8", s_webSocket.memLevel, MAX_MEM_LEVEL);
+        s_webSocket.memLevel = 8;
+    }
+
+    // "https://chat.example.com, http://localhost:8080", compared case insensitively
+    std::string list = ConfigMgr::GetStringDefault("SocketConnector.WebSocket.AllowedOrigins", "");
+    std::replace(list.begin(), list.end(), ',', ' ');
+
+    s_webSocket.origins.clear();
+    std::istringstream origins(list);
+    std::string origin;
+    while (origins >> origin)
+    {
+        std::transform(origin.begin(), origin.end(), origin.begin(), ::tolower);
+        s_webSocket.origins.push_back(origin);
+    }
 }
 
 SocketConnector::~SocketConnector()
 {
+    delete m_WebSocket;
 }
 
 int SocketConnector::open(void *)
@@ -55,472 +188,1634 @@ int SocketConnector::open(void *)
         return -1;
     }
 
-    SocketConnector::connections->push_back(this);
-
-    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Incoming connection from %s", peer().get_remote_addr(remote_addr));
-
-    return activate();
-}
+    m_RemoteHost = remote_addr.get_type() == AF_INET ? remote_addr.get_ip_address() : 0;
 
-int SocketConnector::handle_close(ACE_HANDLE, ACE_Reactor_Mask)
-{
-    SocketConnector::connections->remove(this);
-    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: Closing connection");
-    peer().close_reader();
-    wait();
-    destroy();
-    return 0;
-}
+    // the connection stays on this shard's reactor until it is closed
+    SocketConnectorShard* shard = SocketConnectorRunnable::PickShard();
+    reactor(shard->GetReactor());
 
-int SocketConnector::send(const std::string& line)
-{
-    return size_t(peer().send(line.c_str(), line.length())) == line.length() ? 0 : -1;
-}
+    // input may arrive on the shard thread as soon as the handler is registered
+    m_Timers = shard->GetTimers();
+    m_LastInput = m_Timers->GetTick();
 
-int SocketConnector::recv_line(ACE_Message_Block& buffer)
-{
-    char byte;
-    for (;;)
+    // the ring waits for the socket itself, it stays blocking
+    if (!shard->GetUring())
     {
-        ssize_t n = peer().recv(&byte, sizeof(byte));
-
-        if (n < 0)
+        // sends are queued and drained by handle_output, they must never block the reactor
+        if (peer().enable(ACE_NONBLOCK) == -1)
         {
+            sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector::open: unable to set non blocking mode errno = %s", ACE_OS::strerror(errno));
             return -1;
         }
 
-        if (n == 0)
+        if (reactor()->register_handler(this, ACE_Event_Handler::READ_MASK) == -1)
         {
-            // EOF, connection was closed
-            errno = ECONNRESET;
+            sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector::open: unable to register client handler errno = %s", ACE_OS::strerror(errno));
             return -1;
         }
+    }
 
-        ACE_ASSERT(n == sizeof(byte));
+    m_Shard = shard;
+    m_ShardIndex = shard->GetIndex();
+    m_Shard->AddConnection();
 
-        if (byte == '\n' || byte == '\0')
-            break;
-        else if (byte == '\r') /* Ignore CR */
-            continue;
-        else if (buffer.copy(&byte, sizeof(byte)) == -1)
-            return -1;
+    sSocketConnectorRegistry->Add(this);
+
+    set_keepalive();
+    arm_timer(s_loginTimeout);
+
+    if (shard->GetUring())
+    {
+        m_Uring = shard->GetUring();
+        m_Uring->Adopt(this);
     }
 
-    const char null_term = '\0';
-    if (buffer.copy(&null_term, sizeof(null_term)) == -1)
-        return -1;
+    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Incoming connection from %s", remote_addr.get_host_addr());
 
     return 0;
 }
 
-int SocketConnector::recv_line(std::string& out_line)
+int SocketConnector::handle_close(ACE_HANDLE, ACE_Reactor_Mask)
 {
-    char buf[4096];
+    // the reactor may call us once per registered mask
+    if (m_state == STATE_CLOSING)
+        return 0;
+
+    if (m_state == STATE_CHAT)
+        announce_presence(false);
 
-    ACE_Data_Block db(sizeof (buf),
-            ACE_Message_Block::MB_DATA,
-            buf,
-            0,
-            0,
-            ACE_Message_Block::DONT_DELETE,
-            0);
+    // a queued login that was admitted meanwhile owns a slot like a running one
+    if ((m_state == STATE_QUEUED && !sSocketConnectorAdmission->Cancel(this)) || m_AuthRequest)
+        sSocketConnectorAdmission->Finish();
 
-    ACE_Message_Block message_block(&db,
-            ACE_Message_Block::DONT_DELETE,
-            0);
+    m_state = STATE_CLOSING;
+
+    // frames of a send still in the ring are released once the engine lets go of us
+    if (m_Uring)
+        shut_output();
+    else
+        release_queue();
 
-    if (recv_line(message_block) == -1)
+    if (m_AuthRequest)
     {
-        sLog->outError(LOG_FILTER_REMOTECOMMAND, "Recv error %s", ACE_OS::strerror(errno));
-        return -1;
-    }
+        // an abandoned request deletes itself when the pipeline is done with it
+        if (m_AuthRequest->Abandon())
+            delete m_AuthRequest;
 
-    out_line = message_block.rd_ptr();
+        m_AuthRequest = NULL;
+    }
 
-    return 0;
-}
+    if (accountGuid)
+    {
+        sSocketConnectorModeration->Release(accountGuid);
+        sSocketConnectorCharacters->Release(accountGuid);
+    }
 
-int SocketConnector::fill_user_data(const std::string& user)
-{
-    std::string safe_user = user;
+    // the client has ResumeTokenTTL seconds from now to come back
+    sSocketConnectorTokens->Drop(m_ResumeNonce);
 
-    AccountMgr::normalizeString(safe_user);
+    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: Closing connection");
 
-    PreparedStatement* stmt = LoginDatabase.GetPreparedStatement(LOGIN_SEL_ACCOUNT_ID_BY_NAME);
+    if (m_Timers)
+        m_Timers->Cancel(&m_Deadline);
 
-    stmt->setString(0, safe_user);
-    
-    PreparedQueryResult result = LoginDatabase.Query(stmt);
+    // a pending flush timer would fire on a handler that is gone
+    reactor()->cancel_timer(this);
+    reactor()->remove_handler(this, ACE_Event_Handler::ALL_EVENTS_MASK | ACE_Event_Handler::DONT_CALL);
+    reactor()->purge_pending_notifications(this);
+    peer().close();
 
-    if (!result)
+    if (m_Shard)
     {
-        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "User %s does not exist in database", user.c_str());
-        return -1;
+        m_Shard->RemoveConnection();
+        m_Shard = NULL;
     }
 
-    accountGuid = result->Fetch()->GetUInt32();
+    if (m_Uring)
+    {
+        m_Uring->Detach(this);
+        return 0;
+    }
 
+    // a broadcast may still hold a pointer to us, the registry destroys us once none can
+    sSocketConnectorRegistry->Remove(this);
     return 0;
 }
 
-int SocketConnector::check_password(const std::string& user, const std::string& pass)
+void SocketConnector::uring_detached()
 {
-    std::string safe_user = user;
-    AccountMgr::normalizeString(safe_user);
+    // the ring holds no operation on us anymore
+    release_queue();
+    sSocketConnectorRegistry->Remove(this);
+}
 
-    std::string safe_pass = pass;
-    AccountMgr::normalizeString(safe_pass);
+int SocketConnector::send(const std::string& line)
+{
+    if (line.empty())
+        return 0;
 
-    std::string hash = AccountMgr::CalculateShaPassHash(safe_user, safe_pass);
+    ACE_Data_Block* frame = new ACE_Data_Block(line.length(), ACE_Message_Block::MB_DATA, NULL, NULL, NULL, 0, NULL);
+    memcpy(frame->base(), line.c_str(), line.length());
 
-    PreparedStatement* stmt = LoginDatabase.GetPreparedStatement(LOGIN_SEL_CHECK_PASSWORD_BY_NAME);
+    return enqueue(frame);
+}
 
-    stmt->setString(0, safe_user);
-    stmt->setString(1, hash);
+int SocketConnector::send_raw(const std::string& data)
+{
+    // MB_PROTO frames are written as they are, in websocket mode too
+    ACE_Data_Block* frame = new ACE_Data_Block(data.length(), ACE_Message_Block::MB_PROTO, NULL, NULL, NULL, 0, NULL);
+    memcpy(frame->base(), data.c_str(), data.length());
 
-    PreparedQueryResult result = LoginDatabase.Query(stmt);
+    return enqueue(frame);
+}
 
-    if (!result)
+ACE_Data_Block* SocketConnector::BuildFrame(char type, const std::string& senderName, const std::string& message)
+{
+    size_t length = 2 + senderName.length() + 1 + message.length();
+    ACE_Lock* lock = &s_frameLocks[(++s_frameLockIndex) % FRAME_LOCK_STRIPES];
+
+    ACE_Data_Block* frame = new ACE_Data_Block(length, SOCKET_CONNECTOR_TYPED_FRAME, NULL, NULL, lock, 0, NULL);
+
+    // "<type>\\<sender>\\<message>", v2 clients get the typed form at write time
+    char* out = frame->base();
+    *out++ = type;
+    *out++ = '\\';
+    memcpy(out, senderName.c_str(), senderName.length());
+    out += senderName.length();
+    *out++ = '\\';
+    memcpy(out, message.c_str(), message.length());
+
+    return frame;
+}
+
+int SocketConnector::sendFrame(ACE_Data_Block* frame)
+{
+    return enqueue(frame->duplicate());
+}
+
+int SocketConnector::enqueue(ACE_Data_Block* frame)
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, (frame->release(), -1));
+
+    if (m_OutClosed)
     {
-        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Wrong password for user: %s", user.c_str());
+        frame->release();
         return -1;
     }
 
-    stmt = LoginDatabase.GetPreparedStatement(LOGIN_GET_ACCOUNT_ID_BY_USERNAME);
-    stmt->setString(0, safe_user);
-    result = LoginDatabase.Query(stmt);
+    if (m_OutCount == m_OutQueue.size() || m_OutBytes + frame->size() > s_sendQueueMaxBytes)
+    {
+        // the head may be partially written, it has to stay or the stream gets corrupted;
+        // with io_uring the frames of the send in the ring stay as well
+        size_t keep = std::max(m_OutOffset > 0 ? size_t(1) : size_t(0), m_OutInFlight);
+
+        switch (s_slowConsumerPolicy)
+        {
+            case SLOW_CONSUMER_DROP_OLDEST:
+            {
+                while (m_OutCount > keep && (m_OutCount == m_OutQueue.size() || m_OutBytes + frame->size() > s_sendQueueMaxBytes))
+                {
+                    size_t pos = (m_OutHead + keep) % m_OutQueue.size();
+                    ACE_Data_Block* dropped = m_OutQueue[pos];
+
+                    // shift the kept head forward into the freed slot
+                    for (size_t i = keep; i > 0; --i)
+                        m_OutQueue[(m_OutHead + i) % m_OutQueue.size()] = m_OutQueue[(m_OutHead + i - 1) % m_OutQueue.size()];
+
+                    m_OutQueue[m_OutHead] = NULL;
+                    m_OutHead = (m_OutHead + 1) % m_OutQueue.size();
+                    --m_OutCount;
+                    m_OutBytes -= dropped->size();
+                    dropped->release();
+
+                    ++m_OutDropped;
+                    ++s_totalDroppedFrames;
+                }
+                break;
+            }
+            case SLOW_CONSUMER_COALESCE:
+            {
+                uint32 skipped = 0;
+                while (m_OutCount > keep)
+                {
+                    size_t tail = (m_OutHead + m_OutCount - 1) % m_OutQueue.size();
+                    m_OutBytes -= m_OutQueue[tail]->size();
+                    m_OutQueue[tail]->release();
+                    m_OutQueue[tail] = NULL;
+                    --m_OutCount;
+                    ++skipped;
+                }
+
+                m_OutDropped += skipped;
+                s_totalDroppedFrames += skipped;
+
+                // the kept frames may fill the whole ring, the new frame is dropped below then
+                if (!skipped || m_OutCount == m_OutQueue.size())
+                    break;
+
+                std::ostringstream ss;
+                ss << "s\\" << skipped;
+                std::string notice = ss.str();
+
+                ACE_Data_Block* noticeFrame = new ACE_Data_Block(notice.length(), ACE_Message_Block::MB_DATA, NULL, NULL, NULL, 0, NULL);
+                memcpy(noticeFrame->base(), notice.c_str(), notice.length());
+
+                size_t tail = (m_OutHead + m_OutCount) % m_OutQueue.size();
+                m_OutQueue[tail] = noticeFrame;
+                ++m_OutCount;
+                m_OutBytes += noticeFrame->size();
+                break;
+            }
+            case SLOW_CONSUMER_DISCONNECT:
+            default:
+            {
+                frame->release();
+                ++m_OutDropped;
+                ++s_totalDroppedFrames;
+
+                if (!m_KickRequested)
+                {
+                    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: %s does not read its messages, closing connection", playerName.c_str());
+                    ++s_totalSlowConsumerKicks;
+                    request_close();
+                }
+                return -1;
+            }
+        }
+
+        // the frame alone does not fit, nothing left to make room with
+        if (m_OutCount == m_OutQueue.size() || m_OutBytes + frame->size() > s_sendQueueMaxBytes)
+        {
+            frame->release();
+            ++m_OutDropped;
+            ++s_totalDroppedFrames;
+            return -1;
+        }
+    }
+
+    size_t tail = (m_OutHead + m_OutCount) % m_OutQueue.size();
+    m_OutQueue[tail] = frame;
+    ++m_OutCount;
+    m_OutBytes += frame->size();
+
+    if (m_OutActive)
+        return 0;
+
+    if (m_FlushTimer == -1)
+    {
+        // the delay of this line is what the flush window adds
+        m_FlushStart = ACE_OS::gettimeofday();
+
+        if (s_flushWindow != ACE_Time_Value::zero && m_OutBytes < s_flushMaxBytes)
+        {
+            // gather what arrives within the window, handle_timeout starts the write
+            m_FlushTimer = reactor()->schedule_timer(this, NULL, s_flushWindow);
+            if (m_FlushTimer != -1)
+                return 0;
+        }
+    }
+    else if (m_OutBytes < s_flushMaxBytes)
+        return 0;
 
-    uint32 accounId = (*result)[0].GetUInt32();
+    return start_output();
+}
 
-    QueryResult banresult = LoginDatabase.PQuery("SELECT 1 FROM account_banned WHERE id = '%d' AND active = '1'", accountGuid);
+int SocketConnector::start_output()
+{
+    // called with m_OutLock held
+    if (m_OutActive)
+        return 0;
 
-    if (banresult)
+    if (m_Uring)
+        m_Uring->RequestOutput(this);
+    else if (reactor()->schedule_wakeup(this, ACE_Event_Handler::WRITE_MASK) == -1)
     {
-        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Account banned for user: %s", user.c_str());
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector::start_output: schedule_wakeup failed errno = %s", ACE_OS::strerror(errno));
         return -1;
     }
 
+    m_OutActive = true;
     return 0;
 }
 
-int SocketConnector::authenticate()
+int SocketConnector::handle_timeout(const ACE_Time_Value&, const void* act)
 {
-    std::string user;
-    if (recv_line(user) == -1)
-        return -1;
+    // the shard's timer wheel, everything else is the flush window
+    if (act == &m_Deadline)
+        return handle_deadline();
 
-    //new --->
-    if (user.compare("<policy-file-request/>") == 0)
-    {
-        const char* policy = "<?xml version=\"1.0\"?><cross-domain-policy><allow-access-from domain=\"*\" to-ports=\"*\" /></cross-domain-policy>" + (char)0;
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, 0);
 
-        if (size_t(peer().send(policy, strlen(policy) + 1)) != strlen(policy) + 1)
-            return -1;
+    m_FlushTimer = -1;
 
-        if (recv_line(user) == -1)
-            return -1;
-    }
-    //<---- new
+    if (m_OutCount > 0)
+        (void) start_output();
 
-    std::string pass;
-    if (recv_line(pass) == -1)
-        return -1;
+    return 0;
+}
 
-    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Login attempt for user: %s", user.c_str());
+int SocketConnector::handle_output(ACE_HANDLE)
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, -1);
 
-    if (check_password(user, pass) == -1)
+    if (m_KickRequested)
         return -1;
 
-    if (fill_user_data(user) == -1)
+    begin_flush();
+
+    set_cork(true);
+    int result = (m_WebSocket || m_Protocol == PROTOCOL_V2) ? write_staged() : write_lines();
+    set_cork(false);
+
+    if (result <= 0)
+        return result;
+
+    if (m_CloseAfterFlush)
         return -1;
 
-    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "User login: %s", user.c_str());
+    if (reactor()->cancel_wakeup(this, ACE_Event_Handler::WRITE_MASK) == -1)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector::handle_output: cancel_wakeup failed errno = %s", ACE_OS::strerror(errno));
+        return -1;
+    }
 
+    m_OutActive = false;
     return 0;
 }
 
-int SocketConnector::select_character()
+/// Called with m_OutLock held when a drain starts
+void SocketConnector::begin_flush()
 {
-    //if (send(std::string("Char name: ")) == -1)
-    //    return -1;
+    if (m_FlushStart != ACE_Time_Value::zero)
+    {
+        ACE_Time_Value delay = ACE_OS::gettimeofday() - m_FlushStart;
+        s_totalFlushDelay += uint64(delay.sec()) * 1000000 + delay.usec();
+        ++s_totalFlushes;
+        m_FlushStart = ACE_Time_Value::zero;
+    }
 
-    std::string name;
-    if (recv_line(name) == -1)
-        return -1;
-    
-    CharacterDatabase.EscapeString(name);
+    if (m_FlushTimer != -1)
+    {
+        // the queue filled up before the window ended
+        reactor()->cancel_timer(m_FlushTimer);
+        m_FlushTimer = -1;
+    }
+}
 
-    normalizePlayerName(name);
+/// Called with m_OutLock held. Points iov at the head of the queue, returns the number of frames.
+int SocketConnector::gather_lines(iovec* iov, size_t& total)
+{
+    int count = 0;
+    total = 0;
 
-    QueryResult result = CharacterDatabase.PQuery("SELECT guid, name, race FROM characters WHERE name = '%s' AND account = '%d'", name.c_str(), accountGuid);
-    if (!result)
+    for (; size_t(count) < m_OutCount && count < MAX_WRITE_IOV; ++count)
     {
-        sLog->outError(LOG_FILTER_REMOTECOMMAND, "Player %s does not exist in database", name.c_str());
-        return -1;
+        ACE_Data_Block* frame = m_OutQueue[(m_OutHead + count) % m_OutQueue.size()];
+        size_t offset = count == 0 ? m_OutOffset : 0;
+
+        iov[count].iov_base = (char*)frame->base() + offset;
+        iov[count].iov_len = frame->size() - offset;
+        total += frame->size() - offset;
     }
-    Field *fields = result->Fetch();
-    playerGuid = fields[0].GetUInt32();
-    playerName = fields[1].GetString();
 
-    uint8 r = fields[2].GetUInt8();
-    playerFaction = r != 1 && r != 3 && r != 4 && r != 7 && r != 11;
+    return count;
+}
 
-    result = CharacterDatabase.PQuery("SELECT guildid FROM guild_member WHERE guid = '%d'", playerGuid);
-    if (result)
+/// Called with m_OutLock held. Releases the frames written completely, a partial one stays at the head.
+void SocketConnector::consume_lines(size_t written)
+{
+    while (written > 0)
     {
-        fields = result->Fetch();
-        guildGuid = fields[0].GetUInt32();
-    }
+        ACE_Data_Block* frame = m_OutQueue[m_OutHead];
+        size_t left = frame->size() - m_OutOffset;
 
-    return 0;
+        if (written < left)
+        {
+            m_OutOffset += written;
+            break;
+        }
+
+        written -= left;
+        m_OutBytes -= frame->size();
+        frame->release();
+        m_OutQueue[m_OutHead] = NULL;
+        m_OutHead = (m_OutHead + 1) % m_OutQueue.size();
+        m_OutOffset = 0;
+        --m_OutCount;
+        ++s_totalWrittenFrames;
+    }
 }
 
-int SocketConnector::get_characters()
+/// Called with m_OutLock held. Returns 1 once the queue is drained, 0 if the
+/// socket is full and -1 on error.
+int SocketConnector::write_lines()
 {
-    QueryResult result = CharacterDatabase.PQuery("SELECT name FROM characters WHERE account = '%d'", accountGuid);
-    if (result)
+    while (m_OutCount > 0)
     {
-        Field *fields;
-        std::string charNames = "";
+        // gather the queued frames into one syscall
+        iovec iov[MAX_WRITE_IOV];
+        size_t total = 0;
+        int count = gather_lines(iov, total);
 
-        fields = result->Fetch();
-        charNames += fields[0].GetString() + ",";
+        ssize_t n = peer().sendv(iov, count);
 
-        while (result->NextRow())
+        if (n < 0)
         {
-            fields = result->Fetch();
-            charNames += fields[0].GetString() + ",";
+            if (errno == EWOULDBLOCK || errno == EINTR)
+                return 0;                                   // keep WRITE_MASK, try again when writable
+
+            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector::handle_output: send error %s", ACE_OS::strerror(errno));
+            return -1;
         }
 
-        send(charNames);
+        ++s_totalWriteCalls;
+
+        consume_lines(size_t(n));
+
+        if (size_t(n) < total)
+            return 0;
     }
 
-    return 0;
+    return 1;
 }
 
-int SocketConnector::sendMessage(const std::string& message)
+/// Websocket and v2 counterpart of write_lines. Shared frames are encoded for
+/// this connection when they are written, so the deflate context sees the
+/// messages in the order the client receives them.
+int SocketConnector::write_staged()
 {
-    //std::string console;
-    //utf8ToConsole(message, console);
-    if (send(message) == -1)
-        return -1;
-    return 0;
+    for (;;)
+    {
+        if (m_OutStageOffset == m_OutStage.length())
+        {
+            fill_stage();
+
+            if (m_OutStage.empty())
+                return 1;
+        }
+
+        ssize_t n = peer().send(m_OutStage.data() + m_OutStageOffset, m_OutStage.length() - m_OutStageOffset);
+
+        if (n < 0)
+        {
+            if (errno == EWOULDBLOCK || errno == EINTR)
+                return 0;
+
+            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector::handle_output: send error %s", ACE_OS::strerror(errno));
+            return -1;
+        }
+
+        ++s_totalWriteCalls;
+
+        m_OutStageOffset += size_t(n);
+        if (m_OutStageOffset < m_OutStage.length())
+            return 0;
+    }
 }
 
-int SocketConnector::sendToLFG(const std::string& message)
+/// Called with m_OutLock held once m_OutStage is written completely
+void SocketConnector::fill_stage()
 {
-    uint32 team = playerFaction == 0 ? ALLIANCE : HORDE;
+    s_totalWrittenFrames += m_OutStageFrames;
+    m_OutStage.clear();
+    m_OutStageOffset = 0;
+    m_OutStageFrames = 0;
 
-    if (ChannelMgr* cMgr = channelMgr(team))
+    // encode as many frames as fit into one send
+    while (m_OutCount > 0 && m_OutStage.length() < MAX_STAGE_BYTES)
     {
-        ChannelMap::const_iterator i;
-        
-        for (i = cMgr->channels.begin(); i != cMgr->channels.end(); ++i)
-        {
-            if ((*i).second->IsLFG())
-            {
-                Channel *ch = (*i).second;
-
-                uint32 messageLength = strlen(message.c_str()) + 1;
-                uint32 lang = playerFaction == 0 ? LANG_COMMON : LANG_ORCISH;
-
-                WorldPacket data(SMSG_MESSAGECHAT, 1+4+8+4+(ch->GetName()).size()+1+8+4+messageLength+1);
-                data << (uint8)CHAT_MSG_CHANNEL;
-                data << lang;
-                data << playerGuid;
-                data << uint32(0);
-                data << ch->GetName();
-                data << playerGuid;
-                data << messageLength;
-                data << message.c_str();
-                data << uint8(0);
-
-                ch->SendToAll(&data, false);
-
-                std::list<SocketConnector*>::const_iterator iterator;
-                for (iterator = SocketConnector::connections->begin(); iterator != SocketConnector::connections->end(); ++iterator)
-                {
-                    uint8 playerFaction = (*iterator)->playerFaction;
-                    if ((*iterator)->playerGuid != playerGuid)
-                    {
-                        if (lang == LANG_UNIVERSAL || 
-                            (lang == LANG_ORCISH && playerFaction == 1) || 
-                            (lang == LANG_COMMON && playerFaction == 0) || 
-                            sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT))
-                        {
-                            (*iterator)->sendMessage("m\\" + playerName + "\\" + message);
-                        }
-                    }
-                }
+        ACE_Data_Block* frame = m_OutQueue[m_OutHead];
 
-                break;
-            }
+        // the line written partially before the client switched to v2 is finished as it is
+        if (m_OutOffset > 0)
+        {
+            m_OutStage.append(frame->base() + m_OutOffset, frame->size() - m_OutOffset);
+            m_OutOffset = 0;
         }
+        else
+            encode_frame(frame, m_OutStage);
+
+        m_OutBytes -= frame->size();
+        frame->release();
+        m_OutQueue[m_OutHead] = NULL;
+        m_OutHead = (m_OutHead + 1) % m_OutQueue.size();
+        --m_OutCount;
+        ++m_OutStageFrames;
     }
-
-    return 0;
 }
 
-int SocketConnector::sendToPlayer(const std::string& message, std::string& receiverName)
+int SocketConnector::uring_output()
 {
-    if (receiverName.empty())
-        return false;
-
-    wchar_t wstr_buf[MAX_INTERNAL_PLAYER_NAME+1];
-    size_t wstr_len = MAX_INTERNAL_PLAYER_NAME;
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, -1);
+    return uring_flush();
+}
 
-    if (!Utf8toWStr(receiverName, &wstr_buf[0], wstr_len))
-        return false;
+/// io_uring counterpart of handle_output, called with m_OutLock held on the shard thread.
+/// Puts the next send into the ring, uring_sent continues once it completed.
+int SocketConnector::uring_flush()
+{
+    if (m_KickRequested)
+        return -1;
 
-    wstr_buf[0] = wcharToUpper(wstr_buf[0]);
-    for (size_t i = 1; i < wstr_len; ++i)
-        wstr_buf[i] = wcharToLower(wstr_buf[i]);
+    if (m_OutSending)
+        return 0;
 
-    if (!WStrToUtf8(wstr_buf, wstr_len, receiverName))
-        return false;
+    begin_flush();
 
-    Player *player = sObjectAccessor->FindPlayerByName(receiverName.c_str());
+    iovec iov[MAX_WRITE_IOV];
+    size_t total = 0;
+    int count = 0;
 
-    if (!player)
+    if (m_WebSocket || m_Protocol == PROTOCOL_V2)
     {
-        bool flag = false;
-        std::list<SocketConnector*>::const_iterator iterator;
-        for (iterator = SocketConnector::connections->begin(); iterator != SocketConnector::connections->end(); ++iterator)
+        if (m_OutStageOffset == m_OutStage.length())
+            fill_stage();
+
+        if (m_OutStageOffset < m_OutStage.length())
         {
-            if ((*iterator)->playerName.compare(receiverName.c_str()) == 0)
-            {
-                int receiverFaction = (*iterator)->playerFaction;
-                if (receiverFaction == playerFaction || sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT))
-                {
-                    (*iterator)->sendMessage("w\\" + playerName + "\\" + message);
-                    flag = true;
-                    break;
-                }
-            }
+            iov[0].iov_base = (char*)m_OutStage.data() + m_OutStageOffset;
+            iov[0].iov_len = m_OutStage.length() - m_OutStageOffset;
+            total = iov[0].iov_len;
+            count = 1;
         }
-
-        if (!flag)
-            return -1;
     }
     else
     {
-        uint8 r = player->getRace();
-        uint8 receiverFaction = r != 1 && r != 3 && r != 4 && r != 7 && r != 11;
+        count = gather_lines(iov, total);
 
-        if (sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT) || playerFaction == receiverFaction)
-        {
-            WorldPacket data(SMSG_MESSAGECHAT, 200);
-            data << uint8(CHAT_MSG_WHISPER);
-            data << uint32(LANG_UNIVERSAL);
-            data << uint64(playerGuid);
-            data << uint32(LANG_UNIVERSAL);
-            data << uint64(playerGuid);
-            data << uint32(message.length() + 1);
-            data << message;
-            data << uint8(0);
-            player->GetSession()->SendPacket(&data);
-        }
+        // the queue must not drop these while the kernel reads them
+        m_OutInFlight = count;
+    }
+
+    if (count == 0)
+    {
+        if (m_CloseAfterFlush)
+            return -1;
+
+        m_OutActive = false;
+        return 0;
+    }
+
+    if (!m_Uring->Send(this, iov, count, total))
+    {
+        m_OutInFlight = 0;
         return -1;
     }
+
+    m_OutSending = true;
+    ++s_totalWriteCalls;
     return 0;
 }
 
-int SocketConnector::sendToGuild(const std::string& message)
+int SocketConnector::uring_sent(int result)
 {
-    if (Guild *guild = sGuildMgr->GetGuildById(guildGuid))
-    {
-        WorldPacket data(SMSG_MESSAGECHAT, 200);
-        data << (uint8)CHAT_MSG_GUILD;
-        data << LANG_UNIVERSAL;
-        data << playerGuid;
-        data << uint32(0);
-        data << playerGuid;
-        data << (strlen(message.c_str()) + 1);
-        data << message.c_str();
-        data << uint8(0);
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, -1);
 
-        guild->BroadcastPacket(&data);
+    m_OutSending = false;
 
-        std::list<SocketConnector*>::const_iterator iterator;
-        for (iterator = SocketConnector::connections->begin(); iterator != SocketConnector::connections->end(); ++iterator)
+    if (result < 0)
+    {
+        m_OutInFlight = 0;
+
+        if (result != -EAGAIN && result != -EINTR)
         {
-            if ((*iterator)->guildGuid == guildGuid && ((*iterator)->playerGuid != playerGuid))
-            {
-                (*iterator)->sendMessage("g\\" + playerName + "\\" + message);
-            }
+            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector::uring_sent: send error %s", ACE_OS::strerror(-result));
+            return -1;
         }
     }
-    else
+    // the client may have switched to v2 meanwhile, what was sent decides
+    else if (m_OutInFlight > 0)
     {
-        return -1;
+        consume_lines(size_t(result));
+        m_OutInFlight = 0;
     }
+    else
+        m_OutStageOffset += size_t(result);
 
-    return 0;
+    return uring_flush();
+}
+
+void SocketConnector::set_cork(bool cork)
+{
+#ifdef TCP_CORK
+    if (!s_flushCork)
+        return;
+
+    // holds partial segments while a drain takes several syscalls
+    int value = cork ? 1 : 0;
+    peer().set_option(IPPROTO_TCP, TCP_CORK, &value, sizeof(value));
+#else
+    (void)cork;
+#endif
 }
 
-int SocketConnector::svc(void)
-{    
-    if (authenticate() == -1)
+void SocketConnector::encode_frame(ACE_Data_Block* frame, std::string& out)
+{
+    if (frame->msg_type() == ACE_Message_Block::MB_PROTO)
     {
-        (void) send("Authentication failed");
-        return -1;
+        out.append(frame->base(), frame->size());
+        return;
     }
 
-    get_characters();
-
-    if (select_character() == -1)
+    if (m_Protocol != PROTOCOL_V2)
     {
-        (void) send("Character not found");
-        return -1;
+        m_WebSocket->Write(frame->base(), frame->size(), out);
+        return;
     }
 
-    // send motd
-    if (send(std::string(sWorld->GetMotd()) + "") == -1)
-        return -1;
-    
-    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Player connected: %s", playerName.c_str());
-    for(;;)
+    if (!m_WebSocket)
     {
-        // show prompt
-        //const char* tc_prompt = "TC> ";
-        //if (size_t(peer().send(tc_prompt, strlen(tc_prompt))) != strlen(tc_prompt))
-        //    return -1;
+        SocketConnectorProtocol::Encode(frame, out);
+        return;
+    }
 
-        std::string line;
+    // one v2 frame per binary message
+    std::string packet;
+    SocketConnectorProtocol::Encode(frame, packet);
+    m_WebSocket->Write(packet.data(), packet.length(), out, SocketConnectorWebSocket::OPCODE_BINARY);
+}
+
+void SocketConnector::Kick()
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_OutLock);
+    request_close();
+}
+
+void SocketConnector::request_close()
+{
+    // called with m_OutLock held. A peer that stopped reading never makes handle_output run,
+    // handle_exception closes the connection on the reactor thread whatever the output state.
+    if (m_KickRequested)
+        return;
+
+    m_KickRequested = true;
+    m_OutClosed = true;
+
+    // handle_close purges the notification, it sets m_KickRequested under the same lock first
+    reactor()->notify(this, ACE_Event_Handler::EXCEPT_MASK);
+}
+
+void SocketConnector::shut_output()
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_OutLock);
+
+    // no more frames and no more output requests, the queue is released by uring_detached
+    m_OutClosed = true;
+    m_OutActive = true;
+    m_KickRequested = true;
+}
+
+void SocketConnector::close_after_flush()
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_OutLock);
+
+    m_OutClosed = true;
+    m_CloseAfterFlush = true;
+
+    (void) start_output();
+}
+
+void SocketConnector::release_queue()
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_OutLock);
+
+    // a later Kick finds the connection closed and posts nothing
+    m_OutClosed = true;
+    m_KickRequested = true;
+
+    for (; m_OutCount > 0; --m_OutCount)
+    {
+        m_OutQueue[m_OutHead]->release();
+        m_OutQueue[m_OutHead] = NULL;
+        m_OutHead = (m_OutHead + 1) % m_OutQueue.size();
+    }
+
+    m_OutBytes = 0;
+    m_OutOffset = 0;
+    m_OutStage.clear();
+    m_OutStageOffset = 0;
+    m_OutStageFrames = 0;
+}
+
+size_t SocketConnector::GetQueuedFrames() const
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, 0);
+    return m_OutCount;
+}
+
+size_t SocketConnector::GetQueuedBytes() const
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, 0);
+    return m_OutBytes;
+}
+
+uint32 SocketConnector::GetDroppedFrames() const
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, 0);
+    return m_OutDropped;
+}
+
+int SocketConnector::handle_input(ACE_HANDLE)
+{
+    ssize_t n = peer().recv(m_InBuffer.wr_ptr(), m_InBuffer.space());
+    ++s_totalReadCalls;
+
+    m_LastInput = m_Timers->GetTick();
+
+    if (n == 0)
+    {
+        // EOF, connection was closed
+        return -1;
+    }
+
+    if (n < 0)
+    {
+        if (errno == EWOULDBLOCK || errno == EINTR)
+            return 0;
+
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector::handle_input: recv error %s", ACE_OS::strerror(errno));
+        return -1;
+    }
+
+    m_InBuffer.wr_ptr(size_t(n));
+
+    return process_input();
+}
+
+/// io_uring engine: the kernel filled a buffer of its choice, what does not fit m_InBuffer waits in m_InBacklog
+int SocketConnector::handle_received(const char* data, size_t length)
+{
+    m_LastInput = m_Timers->GetTick();
+    m_InBacklog.append(data, length);
+    return drain_backlog();
+}
+
+int SocketConnector::drain_backlog()
+{
+    while (!m_InBacklog.empty() && !login_pending() && m_InBuffer.space() > 0)
+    {
+        size_t n = std::min(m_InBacklog.length(), m_InBuffer.space());
+        memcpy(m_InBuffer.wr_ptr(), m_InBacklog.data(), n);
+        m_InBuffer.wr_ptr(n);
+        m_InBacklog.erase(0, n);
 
-        if (recv_line(line) == -1)
+        if (process_input() == -1)
             return -1;
 
-        QueryResult result = LoginDatabase.PQuery("SELECT mutetime FROM account WHERE id = '%d'", accountGuid);
-        if (!result) return -1;
+        // a final reply is being flushed, the rest is never read
+        if (m_CloseAfterFlush)
+            m_InBacklog.clear();
+    }
+
+    // the socket buffer holds this in reactor mode, a login does not need more
+    if (m_InBacklog.length() > s_maxLineLength)
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: more than %u bytes received during login, closing connection", s_maxLineLength);
+        return -1;
+    }
+
+    return 0;
+}
+
+int SocketConnector::process_input()
+{
+    if (m_Transport == TRANSPORT_PENDING)
+    {
+        // browsers open with an HTTP upgrade request, everything else speaks lines
+        size_t length = std::min(m_InBuffer.length(), size_t(4));
+        if (!s_webSocketEnabled || memcmp(m_InBuffer.rd_ptr(), "GET ", length) != 0)
+            m_Transport = TRANSPORT_LINES;
+        else if (length < 4)
+            return 0;
+        else
+            m_Transport = TRANSPORT_WEBSOCKET_HANDSHAKE;
+    }
+
+    if (m_Transport == TRANSPORT_WEBSOCKET_HANDSHAKE)
+        return process_handshake();
+
+    if (m_Transport == TRANSPORT_WEBSOCKET)
+        return process_frames();
+
+    if (m_Protocol == PROTOCOL_V2)
+    {
+        size_t consumed = 0;
+        int result = process_packets(m_InBuffer.rd_ptr(), m_InBuffer.wr_ptr(), consumed);
+
+        // an incomplete frame stays at the front of the buffer
+        m_InBuffer.rd_ptr(consumed);
+        m_InBuffer.crunch();
+        return result;
+    }
+
+    while (m_InBuffer.length() > 0 && !login_pending())
+    {
+        const char* begin = m_InBuffer.rd_ptr();
+        const char* end = FindLineEnd(begin, m_InBuffer.wr_ptr());
+
+        if (end == m_InBuffer.wr_ptr())
+            break;
+
+        std::string line(begin, end);
+        m_InBuffer.rd_ptr(size_t(end - begin) + 1);
+
+        /* Ignore CR */
+        if (line.find('\r') != std::string::npos)
+            line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+
+        if (process_line(line) == -1)
+            return -1;
+
+        // whatever follows the "v2" line is already framed
+        if (m_Protocol == PROTOCOL_V2)
+            return process_input();
+    }
 
-        Field *fields = result->Fetch();
-        time_t muteTime = fields[0].GetInt64();
+    // keep the partial line at the front of the buffer
+    m_InBuffer.crunch();
 
-        if (muteTime > time(NULL)) return -1;
+    if (m_InBuffer.space() == 0 && !login_pending())
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: line exceeds %u bytes, closing connection", s_maxLineLength);
+        return -1;
+    }
+
+    return 0;
+}
+
+int SocketConnector::process_handshake()
+{
+    const char* begin = m_InBuffer.rd_ptr();
+    const char* end = std::search(begin, (const char*)m_InBuffer.wr_ptr(), "\r\n\r\n", "\r\n\r\n" + 4);
+
+    if (end == m_InBuffer.wr_ptr())
+    {
+        m_InBuffer.crunch();
 
-        if (line.substr(0, 2) == "m\\")
+        if (m_InBuffer.space() == 0)
         {
-            sendToLFG(line.substr(2));
+            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: websocket upgrade request exceeds %u bytes, closing connection", s_maxLineLength);
+            return -1;
         }
-        else if (line.substr(0, 2) == "g\\")
+
+        return 0;
+    }
+
+    std::string request(begin, end + 2);
+    m_InBuffer.rd_ptr(size_t(end - begin) + 4);
+
+    m_WebSocket = new SocketConnectorWebSocket(s_webSocket, s_maxLineLength);
+
+    std::string response;
+    if (!m_WebSocket->Accept(request, response))
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: websocket upgrade refused");
+
+        // the refusal is plain HTTP, not a websocket frame
+        delete m_WebSocket;
+        m_WebSocket = NULL;
+
+        (void) send_raw(response);
+        close_after_flush();
+        return 0;
+    }
+
+    if (send_raw(response) == -1)
+        return -1;
+
+    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: websocket upgrade, deflate %s", m_WebSocket->IsDeflateEnabled() ? "on" : "off");
+
+    m_Transport = TRANSPORT_WEBSOCKET;
+    return process_frames();
+}
+
+int SocketConnector::process_frames()
+{
+    while (!login_pending() && !m_CloseAfterFlush)
+    {
+        std::string message, reply;
+        SocketConnectorWebSocket::ReadResult result = m_WebSocket->Read(m_InBuffer, message, reply);
+
+        if (result == SocketConnectorWebSocket::READ_MORE)
+            break;
+
+        if (result == SocketConnectorWebSocket::READ_CONTROL)
+        {
+            if (send_raw(reply) == -1)
+                return -1;
+
+            continue;
+        }
+
+        if (result == SocketConnectorWebSocket::READ_CLOSE)
+        {
+            (void) send_raw(reply);
+            close_after_flush();
+            return 0;
+        }
+
+        if (m_Protocol == PROTOCOL_V2)
         {
-            sendToGuild(line.substr(2));
+            // one v2 frame per binary message
+            size_t consumed = 0;
+            if (process_packets(message.data(), message.data() + message.length(), consumed) == -1)
+                return -1;
+
+            if (consumed != message.length())
+            {
+                sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: websocket message does not hold exactly one v2 frame, closing connection");
+                return -1;
+            }
+
+            continue;
         }
-        else if (line.substr(0, 2) == "w\\")
+
+        // one line per message, a trailing line break is tolerated
+        while (!message.empty() && (message[message.length() - 1] == '\n' || message[message.length() - 1] == '\r'))
+            message.erase(message.length() - 1);
+
+        if (process_line(message) == -1)
+            return -1;
+    }
+
+    // frames are checked against the buffer size, an incomplete one always fits after this
+    m_InBuffer.crunch();
+    return 0;
+}
+
+int SocketConnector::process_packets(const char* begin, const char* end, size_t& consumed)
+{
+    consumed = 0;
+
+    while (!login_pending() && !m_CloseAfterFlush)
+    {
+        uint8 opcode = 0;
+        ByteView payload;
+        size_t frameSize = 0;
+
+        if (SocketConnectorProtocol::Peek(begin + consumed, end, opcode, payload, frameSize) == SocketConnectorProtocol::PEEK_MORE)
         {
-            std::string receiver = line.substr(2, line.find("\\", 3, 1) - 2);
-            std::string message = line.substr(line.find("\\", receiver.length(), 1) + 1);
-            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, receiver.c_str());
-            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, message.c_str());
-            sendToPlayer(message, receiver);
+            if (frameSize > s_maxLineLength)
+            {
+                sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: v2 frame exceeds %u bytes, closing connection", s_maxLineLength);
+                return -1;
+            }
+
+            break;
         }
-        else if (line == "getchars")
+
+        consumed += frameSize;
+
+        if (opcode >= MAX_V2_OPCODE || !s_packetHandlers[opcode])
         {
-            get_characters();
+            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: unexpected v2 opcode %u, closing connection", opcode);
+            return -1;
         }
-        else if (line == "quit" || line == "exit" || line == "logout")
+
+        SocketConnectorPacketReader packet(payload.data, payload.length);
+        if ((this->*s_packetHandlers[opcode])(packet) == -1)
+            return -1;
+    }
+
+    return 0;
+}
+
+int SocketConnector::process_line(const std::string& line)
+{
+    // a final reply is being flushed, the client has nothing more to say
+    if (m_CloseAfterFlush)
+        return 0;
+
+    // every login step restarts the deadline for the next one
+    if (m_state == STATE_WAIT_USER || m_state == STATE_WAIT_PASS || m_state == STATE_WAIT_CHARACTER)
+        arm_timer(s_loginTimeout);
+
+    switch (m_state)
+    {
+        case STATE_WAIT_USER:
+            return handle_user_line(line);
+        case STATE_WAIT_PASS:
+            return handle_pass_line(line);
+        case STATE_WAIT_CHARACTER:
+            return handle_character_line(line);
+        case STATE_CHAT:
+            return handle_chat_line(line);
+        default:
+            return -1;
+    }
+}
+
+int SocketConnector::handle_user_line(const std::string& line)
+{
+    if (line.compare("<policy-file-request/>") == 0)
+    {
+        const char* policy = "<?xml version=\"1.0\"?><cross-domain-policy><allow-access-from domain=\"*\" to-ports=\"*\" /></cross-domain-policy>";
+
+        // flash expects the policy to be null terminated
+        if (send(std::string(policy, strlen(policy) + 1)) == -1)
             return -1;
+
+        return 0;
+    }
+
+    if (line.substr(0, 2) == "t\\")
+        return handle_resume_line(line.substr(2));
+
+    if (line == "v2" && m_Protocol == PROTOCOL_LEGACY)
+    {
+        // the confirmation is the first v2 frame
+        m_Protocol = PROTOCOL_V2;
+        return send("v2");
+    }
+
+    m_user = line;
+    m_state = STATE_WAIT_PASS;
+    return 0;
+}
+
+int SocketConnector::handle_pass_line(const std::string& line)
+{
+    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Login attempt for user: %s", m_user.c_str());
+
+    // lines sent meanwhile stay in m_InBuffer until the login is resolved
+    (void) hold_input(true);
+
+    uint32 position = 0;
+    switch (sSocketConnectorAdmission->Request(this, m_RemoteHost, position))
+    {
+        case SocketConnectorAdmission::ADMIT_NOW:
+            start_login(line);
+            return 0;
+        case SocketConnectorAdmission::ADMIT_QUEUED:
+        {
+            // handle_exception starts the login once a slot is free
+            m_state = STATE_QUEUED;
+            m_QueuedPass = line;
+            arm_timer(sSocketConnectorAdmission->GetQueueTimeout());
+
+            std::ostringstream ss;
+            ss << "q\\" << position;
+            return send(ss.str());
+        }
+        case SocketConnectorAdmission::ADMIT_REFUSED:
+        default:
+        {
+            std::ostringstream ss;
+            ss << "Server busy, retry in " << position;
+            (void) send(ss.str());
+            close_after_flush();
+            return 0;
+        }
+    }
+}
+
+void SocketConnector::start_login(const std::string& pass)
+{
+    m_state = STATE_AUTHENTICATING;
+    m_AuthRequest = new SocketConnectorAuthRequest(this, m_user, pass);
+    sSocketConnectorAuth->Enqueue(m_AuthRequest);
+}
+
+int SocketConnector::handle_exception(ACE_HANDLE)
+{
+    {
+        // kicked, see request_close
+        ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_OutLock, -1);
+        if (m_KickRequested)
+            return -1;
+    }
+
+    // admitted from the login queue, the slot is ours now
+    if (m_state == STATE_QUEUED)
+    {
+        std::string pass;
+        pass.swap(m_QueuedPass);
+        start_login(pass);
+        return 0;
+    }
+
+    if (m_state != STATE_AUTHENTICATING || !m_AuthRequest)
+        return 0;
+
+    // the pipeline held the slot until the character list was cached
+    int result = authenticated();
+    sSocketConnectorAdmission->Finish();
+
+    if (result == -1)
+        return -1;
+
+    // login failed, the reply is being flushed
+    if (m_CloseAfterFlush)
+        return 0;
+
+    if (hold_input(false) == -1)
+        return -1;
+
+    // the character line may already be waiting
+    if (process_input() == -1)
+        return -1;
+
+    return drain_backlog();
+}
+
+int SocketConnector::hold_input(bool hold)
+{
+    if (m_Uring)
+        return m_Uring->HoldInput(this, hold) ? 0 : -1;
+
+    if (hold)
+        return reactor()->cancel_wakeup(this, ACE_Event_Handler::READ_MASK);
+
+    return reactor()->schedule_wakeup(this, ACE_Event_Handler::READ_MASK);
+}
+
+int SocketConnector::authenticated()
+{
+    PreparedQueryResult result = m_AuthRequest->GetResult();
+    // a successful login keeps the characters referenced until handle_close releases accountGuid
+    m_AuthRequest->TakeCharacters();
+    delete m_AuthRequest;
+    m_AuthRequest = NULL;
+
+    if (!result)
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Wrong password for user: %s", m_user.c_str());
+        (void) send("Authentication failed");
+        close_after_flush();
+        return 0;
+    }
+
+    Field* fields = result->Fetch();
+    if (fields[2].GetBool())
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Account banned for user: %s", m_user.c_str());
+        (void) send("Authentication failed");
+        close_after_flush();
+        return 0;
+    }
+
+    accountGuid = fields[0].GetUInt32();
+
+    // the only mute lookup of the session, later changes arrive through SocketConnectorModeration
+    sSocketConnectorModeration->Acquire(accountGuid, time_t(fields[1].GetInt64()), false);
+
+    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "User login: %s", m_user.c_str());
+
+    get_characters();
+
+    m_state = STATE_WAIT_CHARACTER;
+    arm_timer(s_loginTimeout);
+    return 0;
+}
+
+int SocketConnector::handle_character_line(const std::string& line)
+{
+    std::string name = line;
+    if (select_character(name) == -1)
+    {
+        (void) send("Character not found");
+        close_after_flush();
+        return 0;
+    }
+
+    // send motd
+    if (send(std::string(sWorld->GetMotd()) + "") == -1)
+        return -1;
+
+    enter_chat();
+
+    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Player connected: %s", playerName.c_str());
+    return issue_token();
+}
+
+int SocketConnector::handle_resume_line(const std::string& token)
+{
+    SocketConnectorTokens::ResumeState state;
+    if (!sSocketConnectorTokens->Redeem(token, state))
+    {
+        // the client falls back to the full login on the same connection
+        return send("Session expired");
+    }
+
+    // the token's moderation and character references now belong to this connection
+    accountGuid = state.accountId;
+
+    if (sSocketConnectorModeration->IsBanned(state.accountId))
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Account banned, session of %s not resumed", state.playerName.c_str());
+        (void) send("Authentication failed");
+        close_after_flush();
+        return 0;
+    }
+
+    // deleted, renamed or moved to another account while the client was away
+    SocketConnectorCharacters::CharacterInfo info;
+    if (!sSocketConnectorCharacters->FindCharacter(state.accountId, state.playerGuid, info))
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Character of %s is gone, session not resumed", state.playerName.c_str());
+
+        // the full login takes references of its own
+        sSocketConnectorModeration->Release(state.accountId);
+        sSocketConnectorCharacters->Release(state.accountId);
+        accountGuid = 0;
+        return send("Session expired");
+    }
+
+    set_character(info);
+
+    {
+        // the dropped connections may not have noticed yet, the resumed one replaces all of them
+        SocketConnectorRegistry::ReadGuard connections;
+        SocketConnectorRegistry::ConnectionList previous;
+        connections.FindSessions(playerGuid, previous);
+
+        for (SocketConnectorRegistry::ConnectionList::const_iterator itr = previous.begin(); itr != previous.end(); ++itr)
+            (*itr)->Kick();
+    }
+
+    if (send(std::string(sWorld->GetMotd()) + "") == -1)
+        return -1;
+
+    enter_chat();
+
+    sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Player resumed: %s", playerName.c_str());
+    return issue_token();
+}
+
+void SocketConnector::enter_chat()
+{
+    m_state = STATE_CHAT;
+    sSocketConnectorRegistry->Activate(this);
+    announce_presence(true);
+
+    m_PingSent = false;
+    arm_timer(s_idleTimeout);
+}
+
+void SocketConnector::arm_timer(uint32 seconds)
+{
+    if (!m_Timers)
+        return;
+
+    if (!seconds)
+    {
+        m_Timers->Cancel(&m_Deadline);
+        return;
+    }
+
+    m_Timers->Schedule(&m_Deadline, this, SocketConnectorTimerWheel::SecondsToTicks(seconds));
+}
+
+/// Shard thread, the wheel closes the connection when this returns -1
+int SocketConnector::handle_deadline()
+{
+    if (m_state == STATE_CLOSING)
+        return 0;
+
+    if (m_state == STATE_QUEUED)
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: login of %s not admitted within %u seconds, closing connection", m_user.c_str(), sSocketConnectorAdmission->GetQueueTimeout());
+        ++s_totalTimeouts;
+        return -1;
+    }
+
+    if (m_state != STATE_CHAT)
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: login step not completed within %u seconds, closing connection", s_loginTimeout);
+        ++s_totalTimeouts;
+        return -1;
+    }
+
+    // input does not touch the wheel, a busy session only moves its deadline when it comes due
+    uint64 idle = SocketConnectorTimerWheel::SecondsToTicks(s_idleTimeout);
+    uint64 silent = m_Timers->GetTick() - m_LastInput;
+    if (silent < idle)
+    {
+        m_PingSent = false;
+        m_Timers->Schedule(&m_Deadline, this, idle - silent);
+        return 0;
+    }
+
+    if (m_PingSent)
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: %s did not answer the keepalive, closing connection", playerName.c_str());
+        ++s_totalTimeouts;
+        return -1;
+    }
+
+    // legacy line clients have nothing to answer with, TCP keepalive finds their dead peers
+    if (m_Transport != TRANSPORT_WEBSOCKET && m_Protocol != PROTOCOL_V2)
+    {
+        arm_timer(s_idleTimeout);
+        return 0;
+    }
+
+    if (send_ping() == -1)
+        return -1;
+
+    m_PingSent = true;
+    arm_timer(s_pongTimeout);
+    return 0;
+}
+
+int SocketConnector::send_ping()
+{
+    // browsers answer websocket pings by themselves
+    if (m_Transport == TRANSPORT_WEBSOCKET)
+    {
+        std::string ping;
+        SocketConnectorWebSocket::AppendFrame(ping, SocketConnectorWebSocket::OPCODE_PING, false, "", 0);
+        return send_raw(ping);
+    }
+
+    std::string ping;
+    SocketConnectorProtocol::AppendHeader(ping, V2_PING, 0);
+
+    ACE_Data_Block* frame = new ACE_Data_Block(ping.length(), SOCKET_CONNECTOR_V2_FRAME, NULL, NULL, NULL, 0, NULL);
+    memcpy(frame->base(), ping.data(), ping.length());
+
+    return enqueue(frame);
+}
+
+void SocketConnector::set_keepalive()
+{
+    if (!s_idleTimeout)
+        return;
+
+    int value = 1;
+    peer().set_option(SOL_SOCKET, SO_KEEPALIVE, &value, sizeof(value));
+
+#ifdef TCP_KEEPIDLE
+    // a legacy client gets no pings, the kernel probes it after the same idle time
+    int idle = int(s_idleTimeout);
+    int interval = int(s_pongTimeout < 10 ? s_pongTimeout : s_pongTimeout / 3);
+    int count = 3;
+    peer().set_option(IPPROTO_TCP, TCP_KEEPIDLE, &idle, sizeof(idle));
+    peer().set_option(IPPROTO_TCP, TCP_KEEPINTVL, &interval, sizeof(interval));
+    peer().set_option(IPPROTO_TCP, TCP_KEEPCNT, &count, sizeof(count));
+#endif
+}
+
+int SocketConnector::issue_token()
+{
+    SocketConnectorTokens::ResumeState state;
+    state.accountId = uint32(accountGuid);
+    state.playerGuid = playerGuid;
+    state.playerName = playerName;
+    state.guildId = guildGuid.value();
+    state.faction = playerFaction;
+
+    std::string token = sSocketConnectorTokens->Issue(state, m_ResumeNonce);
+    if (token.empty())
+        return 0;
+
+    return send("t\\" + token);
+}
+
+int SocketConnector::select_character(std::string& name)
+{
+    normalizePlayerName(name);
+
+    SocketConnectorCharacters::CharacterInfo info;
+    if (!sSocketConnectorCharacters->FindCharacter(uint32(accountGuid), name, info))
+    {
+        sLog->outError(LOG_FILTER_REMOTECOMMAND, "Player %s does not exist in database", name.c_str());
+        return -1;
+    }
+
+    set_character(info);
+    return 0;
+}
+
+void SocketConnector::set_character(SocketConnectorCharacters::CharacterInfo const& info)
+{
+    playerGuid = info.guid;
+    playerName = info.name;
+    guildGuid = info.guildId;
+
+    uint8 r = info.race;
+    playerFaction = r != 1 && r != 3 && r != 4 && r != 7 && r != 11;
+}
+
+int SocketConnector::get_characters()
+{
+    SocketConnectorCharacters::CharacterList characters;
+    sSocketConnectorCharacters->GetCharacters(uint32(accountGuid), characters);
+
+    if (characters.empty())
+        return 0;
+
+    std::string charNames = "";
+    for (SocketConnectorCharacters::CharacterList::const_iterator itr = characters.begin(); itr != characters.end(); ++itr)
+        charNames += itr->name + ",";
+
+    return send(charNames);
+}
+
+int SocketConnector::sendMessage(const std::string& message)
+{
+    //std::string console;
+    //utf8ToConsole(message, console);
+    if (send(message) == -1)
+        return -1;
+    return 0;
+}
+
+int SocketConnector::handle_line_packet(SocketConnectorPacketReader& packet)
+{
+    ByteView line;
+    if (!packet.ReadString(line) || !packet.AtEnd())
+        return -1;
+
+    return process_line(line.ToString());
+}
+
+int SocketConnector::handle_chat_packet(SocketConnectorPacketReader& packet)
+{
+    uint32 id;
+    ByteView message;
+    if (m_state != STATE_CHAT || !packet.ReadUInt32(id) || !packet.ReadString(message) || !packet.AtEnd())
+        return -1;
+
+    if (!sSocketConnectorModeration->CanSpeak(accountGuid))
+        return SendAck(id, V2_ACK_MUTED);
+
+    // the world thread acknowledges once the line is delivered
+    if (sendToLFG(message.ToString(), &id) == -1)
+        return SendAck(id, V2_ACK_UNDELIVERED);
+
+    return 0;
+}
+
+int SocketConnector::handle_whisper_packet(SocketConnectorPacketReader& packet)
+{
+    uint32 id;
+    ByteView receiver, message;
+    if (m_state != STATE_CHAT || !packet.ReadUInt32(id) || !packet.ReadString(receiver) || !packet.ReadString(message) || !packet.AtEnd())
+        return -1;
+
+    if (!sSocketConnectorModeration->CanSpeak(accountGuid))
+        return SendAck(id, V2_ACK_MUTED);
+
+    std::string receiverName = receiver.ToString();
+    if (receiverName.empty() || sendToPlayer(message.ToString(), receiverName, &id) == -1)
+        return SendAck(id, V2_ACK_UNDELIVERED);
+
+    return 0;
+}
+
+int SocketConnector::handle_guild_packet(SocketConnectorPacketReader& packet)
+{
+    uint32 id;
+    ByteView message;
+    if (m_state != STATE_CHAT || !packet.ReadUInt32(id) || !packet.ReadString(message) || !packet.AtEnd())
+        return -1;
+
+    if (!sSocketConnectorModeration->CanSpeak(accountGuid))
+        return SendAck(id, V2_ACK_MUTED);
+
+    if (sendToGuild(message.ToString(), &id) == -1)
+        return SendAck(id, V2_ACK_UNDELIVERED);
+
+    return 0;
+}
+
+int SocketConnector::handle_ping_packet(SocketConnectorPacketReader& packet)
+{
+    // the answer to our keepalive, receiving it already counts as input
+    return packet.AtEnd() ? 0 : -1;
+}
+
+int SocketConnector::SendAck(uint32 id, uint8 status)
+{
+    std::string ack;
+    SocketConnectorProtocol::AppendHeader(ack, V2_ACK, 4 + 1);
+    SocketConnectorProtocol::AppendUInt32(ack, id);
+    SocketConnectorProtocol::AppendUInt8(ack, status);
+
+    ACE_Data_Block* frame = new ACE_Data_Block(ack.length(), SOCKET_CONNECTOR_V2_FRAME, NULL, NULL, NULL, 0, NULL);
+    memcpy(frame->base(), ack.data(), ack.length());
+
+    return enqueue(frame);
+}
+
+void SocketConnector::announce_presence(bool online)
+{
+    uint32 guildId = guildGuid.value();
+    if (!guildId)
+        return;
+
+    SocketConnectorRegistry::ReadGuard connections;
+    SocketConnectorRegistry::ConnectionList const* members = connections.FindGuildMembers(guildId);
+    if (!members)
+        return;
+
+    // legacy clients have no presence line
+    ACE_Data_Block* frame = BuildFrame('p', playerName, online ? "1" : "0");
+    sSocketConnectorFanout->Broadcast(frame, *members, playerGuid, true);
+    frame->release();
+}
+
+int SocketConnector::post(SocketConnectorInbox::Request* request, const std::string& message, const uint32* ackId)
+{
+    request->senderGuid = playerGuid;
+    request->senderSerial = m_Serial;
+    request->senderName = playerName;
+    request->faction = playerFaction;
+    request->message = message;
+
+    if (ackId)
+    {
+        request->ack = true;
+        request->ackId = *ackId;
+    }
+
+    if (!sSocketConnectorInbox->Post(request))
+    {
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: world inbox full, line of %s dropped", playerName.c_str());
+        return -1;
+    }
+
+    return 0;
+}
+
+int SocketConnector::sendToLFG(const std::string& message, const uint32* ackId)
+{
+    SocketConnectorInbox::Request* request = new SocketConnectorInbox::Request();
+    request->type = SocketConnectorInbox::REQUEST_LFG;
+
+    return post(request, message, ackId);
+}
+
+int SocketConnector::sendToPlayer(const std::string& message, std::string& receiverName, const uint32* ackId)
+{
+    if (receiverName.empty())
+        return -1;
+
+    wchar_t wstr_buf[MAX_INTERNAL_PLAYER_NAME+1];
+    size_t wstr_len = MAX_INTERNAL_PLAYER_NAME;
+
+    if (!Utf8toWStr(receiverName, &wstr_buf[0], wstr_len))
+        return -1;
+
+    wstr_buf[0] = wcharToUpper(wstr_buf[0]);
+    for (size_t i = 1; i < wstr_len; ++i)
+        wstr_buf[i] = wcharToLower(wstr_buf[i]);
+
+    if (!WStrToUtf8(wstr_buf, wstr_len, receiverName))
+        return -1;
+
+    SocketConnectorInbox::Request* request = new SocketConnectorInbox::Request();
+    request->type = SocketConnectorInbox::REQUEST_WHISPER;
+    request->receiver = receiverName;
+
+    return post(request, message, ackId);
+}
+
+int SocketConnector::sendToGuild(const std::string& message, const uint32* ackId)
+{
+    // may be changed by the guild code on the world thread
+    uint32 guildId = guildGuid.value();
+    if (!guildId)
+        return -1;
+
+    SocketConnectorInbox::Request* request = new SocketConnectorInbox::Request();
+    request->type = SocketConnectorInbox::REQUEST_GUILD;
+    request->guildId = guildId;
+
+    return post(request, message, ackId);
+}
+
+int SocketConnector::handle_chat_line(const std::string& line)
+{
+    if (!sSocketConnectorModeration->CanSpeak(accountGuid))
+        return -1;
+
+    if (line.substr(0, 2) == "m\\")
+    {
+        sendToLFG(line.substr(2));
+    }
+    else if (line.substr(0, 2) == "g\\")
+    {
+        sendToGuild(line.substr(2));
+    }
+    else if (line.substr(0, 2) == "w\\")
+    {
+        std::string receiver = line.substr(2, line.find("\\", 3, 1) - 2);
+        std::string message = line.substr(line.find("\\", receiver.length(), 1) + 1);
+        sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "Whisper to %s: %s", receiver.c_str(), message.c_str());
+        sendToPlayer(message, receiver);
+    }
+    else if (line == "getchars")
+    {
+        get_characters();
+    }
+    else if (line == "quit" || line == "exit" || line == "logout")
+    {
+        // an explicit logout, the session must not be resumable
+        sSocketConnectorTokens->Revoke(m_ResumeNonce);
+        m_ResumeNonce.clear();
+        return -1;
     }
 
     return 0;
@@ -25,51 +25,265 @@
 
 #include "Common.h"
 #include "Player.h"
+#include "SocketConnectorProtocol.h"
+#include "SocketConnectorUring.h"
+#include "SocketConnectorWebSocket.h"
+#include "SocketConnectorInbox.h"
+#include "SocketConnectorTimerWheel.h"
+#include "SocketConnectorCharacters.h"
 
 #include <ace/Synch_Traits.h>
 #include <ace/Svc_Handler.h>
 #include <ace/SOCK_Stream.h>
 #include <ace/SOCK_Acceptor.h>
+#include <ace/Atomic_Op.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Lock_Adapter_T.h>
 #include <map>
-#include <list>
+#include <vector>
 
 
+class SocketConnectorAuthRequest;
+class SocketConnectorShard;
+
 /// Remote chat socket
-class SocketConnector: public ACE_Svc_Handler<ACE_SOCK_STREAM, ACE_MT_SYNCH>
+/// Connections are driven by the SocketConnectorRunnable reactor, no thread is
+/// spawned per client. Each connection walks through the login states below.
+/// With SocketConnector.Engine = 1 the socket I/O goes through SocketConnectorUring instead.
+class SocketConnector: public ACE_Svc_Handler<ACE_SOCK_STREAM, ACE_NULL_SYNCH>
 {
+    friend class SocketConnectorUring;
+
     public:
+        enum ConnectorState
+        {
+            STATE_WAIT_USER,                                // account name, resume token (or flash policy request)
+            STATE_WAIT_PASS,                                // account password
+            STATE_QUEUED,                                   // password received, waiting for a login slot, input is held back
+            STATE_AUTHENTICATING,                           // login in the auth pipeline, input is held back
+            STATE_WAIT_CHARACTER,                           // character name
+            STATE_CHAT,                                     // logged in, chat commands
+            STATE_CLOSING
+        };
+
+        /// Wire format, chosen from the first bytes the client sends
+        enum Transport
+        {
+            TRANSPORT_PENDING,                              // nothing received yet
+            TRANSPORT_LINES,                                // legacy newline delimited lines
+            TRANSPORT_WEBSOCKET_HANDSHAKE,                  // HTTP upgrade request being received
+            TRANSPORT_WEBSOCKET                             // RFC 6455 text messages, one line each
+        };
+
+        /// Message format on top of the transport, v2 is requested by the client
+        enum Protocol
+        {
+            PROTOCOL_LEGACY,                                // backslash separated text lines
+            PROTOCOL_V2                                     // length prefixed typed frames, see SocketConnectorProtocol.h
+        };
+
+        /// What to do when a client does not read fast enough to keep its queue bounded
+        enum SlowConsumerPolicy
+        {
+            SLOW_CONSUMER_DROP_OLDEST   = 0,                // discard the oldest unsent lines
+            SLOW_CONSUMER_COALESCE      = 1,                // replace the unsent backlog by a single "skipped" notice
+            SLOW_CONSUMER_DISCONNECT    = 2                 // close the connection
+        };
+
         SocketConnector();
         virtual ~SocketConnector();
 
-        virtual int svc(void);
         virtual int open(void * = 0);
+        virtual int handle_input(ACE_HANDLE = ACE_INVALID_HANDLE);
+        virtual int handle_output(ACE_HANDLE = ACE_INVALID_HANDLE);
+        virtual int handle_exception(ACE_HANDLE = ACE_INVALID_HANDLE);
+        virtual int handle_timeout(const ACE_Time_Value& current_time, const void* act = 0);
         virtual int handle_close(ACE_HANDLE = ACE_INVALID_HANDLE, ACE_Reactor_Mask = ACE_Event_Handler::ALL_EVENTS_MASK);
+
+        /// Queue a line for the client, never blocks the caller.
+        /// Safe to call from any thread, the reactor writes it once the socket is writable.
         int sendMessage(const std::string& message);
         int send(const std::string& line);
-        
-        typedef std::list<SocketConnector*> Connections;
-        static Connections *connections;
+
+        /// Broadcast support: the line is encoded once and every recipient queues a
+        /// reference to the same data block. The caller releases its own reference.
+        static ACE_Data_Block* BuildFrame(char type, const std::string& senderName, const std::string& message);
+        int sendFrame(ACE_Data_Block* frame);
+
+        /// v2 reply to a CHAT / WHISPER / GUILD request, sent by the world thread once it is delivered
+        int SendAck(uint32 id, uint8 status);
+
+        /// Close the connection from any thread, pending output is discarded
+        void Kick();
+
+        ConnectorState GetState() const { return m_state; }
+        /// Unique for the lifetime of the process, unlike the address of a freed connection
+        uint32 GetSerial() const { return m_Serial; }
+        bool IsLoggedIn() const { return m_state == STATE_CHAT; }
+        bool UsesProtocolV2() const { return m_Protocol == PROTOCOL_V2; }
+        /// Lines after the password wait until the login is resolved
+        bool login_pending() const { return m_state == STATE_QUEUED || m_state == STATE_AUTHENTICATING; }
+        /// Shard the connection was opened on, stays valid after close
+        uint32 GetShardIndex() const { return m_ShardIndex; }
+
+        /// Outbound queue statistics
+        size_t GetQueuedFrames() const;
+        size_t GetQueuedBytes() const;
+        uint32 GetDroppedFrames() const;
+        static uint32 GetTotalDroppedFrames() { return s_totalDroppedFrames.value(); }
+        static uint32 GetTotalSlowConsumerKicks() { return s_totalSlowConsumerKicks.value(); }
+
+        /// Write coalescing statistics: frames per syscall is WrittenFrames / WriteCalls,
+        /// the mean delay between queueing and writing is FlushDelay / Flushes (microseconds)
+        static uint64 GetTotalWriteCalls() { return s_totalWriteCalls.value(); }
+        static uint64 GetTotalWrittenFrames() { return s_totalWrittenFrames.value(); }
+        static uint64 GetTotalFlushes() { return s_totalFlushes.value(); }
+        static uint64 GetTotalFlushDelay() { return s_totalFlushDelay.value(); }
+        /// recv calls of the reactor engine
+        static uint64 GetTotalReadCalls() { return s_totalReadCalls.value(); }
+        /// Connections closed by a login deadline or an unanswered keepalive
+        static uint32 GetTotalTimeouts() { return s_totalTimeouts.value(); }
+
+        /// Reads SocketConnector.* settings, called before the listener opens
+        static void LoadConfig();
 
         std::string playerName;
         uint64 accountGuid;
         uint64 playerGuid;
-        uint32 guildGuid;
+        /// Changed by the guild code on the world thread while the connection's threads read it
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> guildGuid;
         uint8 playerFaction;
 
     private:
-        int recv_line(std::string& out_line);
-        int recv_line(ACE_Message_Block& buffer);
-        int authenticate();
-        int fill_user_data(const std::string& user);
-        int check_password(const std::string& user, const std::string& pass);
+        int process_input();
+        int process_handshake();
+        int process_frames();
+        int process_packets(const char* begin, const char* end, size_t& consumed);
+        int write_lines();
+        int write_staged();
+        int gather_lines(iovec* iov, size_t& total);
+        void consume_lines(size_t written);
+        void fill_stage();
+        void begin_flush();
+        int hold_input(bool hold);
+        int handle_received(const char* data, size_t length);
+        int drain_backlog();
+        int uring_output();
+        int uring_flush();
+        int uring_sent(int result);
+        void uring_detached();
+        void shut_output();
+        void encode_frame(ACE_Data_Block* frame, std::string& out);
+        int send_raw(const std::string& data);
+        int enqueue(ACE_Data_Block* frame);
+        int start_output();
+        void set_cork(bool cork);
+        void release_queue();
+        void close_after_flush();
+        void request_close();
+        int process_line(const std::string& line);
+        int handle_user_line(const std::string& line);
+        int handle_pass_line(const std::string& line);
+        void start_login(const std::string& pass);
+        int handle_character_line(const std::string& line);
+        int handle_resume_line(const std::string& token);
+        int issue_token();
+        int handle_chat_line(const std::string& line);
+        int handle_line_packet(SocketConnectorPacketReader& packet);
+        int handle_chat_packet(SocketConnectorPacketReader& packet);
+        int handle_whisper_packet(SocketConnectorPacketReader& packet);
+        int handle_guild_packet(SocketConnectorPacketReader& packet);
+        int handle_ping_packet(SocketConnectorPacketReader& packet);
+        void arm_timer(uint32 seconds);
+        void enter_chat();
+        int handle_deadline();
+        int send_ping();
+        void set_keepalive();
+        void announce_presence(bool online);
+        int authenticated();
         int get_characters();
-        int select_character();
-        int sendToLFG(const std::string& message);
-        int sendToPlayer(const std::string& message, std::string& receiverName);
-        int sendToGuild(const std::string& message);
-        typedef std::map<std::wstring, Channel*> ChannelMap;
+        int select_character(std::string& name);
+        void set_character(SocketConnectorCharacters::CharacterInfo const& info);
+        /// 0 once the line is queued for the world thread, which acknowledges it after delivery,
+        /// -1 if it never will be and the v2 caller acknowledges V2_ACK_UNDELIVERED itself
+        int post(SocketConnectorInbox::Request* request, const std::string& message, const uint32* ackId);
+        int sendToLFG(const std::string& message, const uint32* ackId = NULL);
+        int sendToPlayer(const std::string& message, std::string& receiverName, const uint32* ackId = NULL);
+        int sendToGuild(const std::string& message, const uint32* ackId = NULL);
+
+        typedef int (SocketConnector::*PacketHandler)(SocketConnectorPacketReader& packet);
+
+        /// v2 client frames by opcode, NULL for opcodes only the server sends
+        static const PacketHandler s_packetHandlers[MAX_V2_OPCODE];
 
     private:
+        uint32 m_Serial;
+        ConnectorState m_state;
+        std::string m_user;                                 // account name until the password arrives
+        std::string m_QueuedPass;                           // password of a login waiting for admission
+        uint32 m_RemoteHost;                                // IPv4 address for per host admission limits, 0 otherwise
+        SocketConnectorAuthRequest* m_AuthRequest;          // login in flight
+        std::string m_ResumeNonce;                          // names the resume token issued last
+        SocketConnectorShard* m_Shard;                      // reactor thread owning the connection
+        uint32 m_ShardIndex;                                // kept after close, fan-out partitions by it
+        SocketConnectorUring* m_Uring;                      // io_uring engine of the shard, NULL with the reactor engine
+        SocketConnectorUring::Link* m_UringLink;
+        std::string m_InBacklog;                            // io_uring: received bytes that do not fit m_InBuffer yet
+        ACE_Message_Block m_InBuffer;                       // received bytes, holds at most one partial line
+        Transport m_Transport;
+        SocketConnectorWebSocket* m_WebSocket;              // framing state in websocket mode
+        Protocol m_Protocol;
+        SocketConnectorTimerWheel* m_Timers;                // wheel of the shard, kept after close
+        SocketConnectorTimerWheel::Timer m_Deadline;        // login step or keepalive, whichever the state needs
+        volatile uint64 m_LastInput;                        // wheel tick of the last received bytes
+        bool m_PingSent;                                    // keepalive unanswered so far
+
+        /// Outbound ring of frames, guarded by m_OutLock
+        mutable ACE_Thread_Mutex m_OutLock;
+        std::vector<ACE_Data_Block*> m_OutQueue;
+        size_t m_OutHead;
+        size_t m_OutCount;
+        size_t m_OutBytes;
+        size_t m_OutOffset;                                 // bytes of the head frame already written
+        std::string m_OutStage;                             // websocket or v2 mode: head frame encoded for this connection
+        size_t m_OutStageOffset;
+        uint32 m_OutStageFrames;                            // queued frames encoded into m_OutStage
+        size_t m_OutInFlight;                               // io_uring: head frames referenced by the send in the ring
+        bool m_OutSending;                                  // io_uring: a send is in the ring
+        uint32 m_OutDropped;
+        long m_FlushTimer;                                  // flush window timer, -1 if none
+        ACE_Time_Value m_FlushStart;                        // first line queued since the last write
+        bool m_OutActive;                                   // WRITE_MASK is scheduled
+        bool m_OutClosed;                                   // no more frames are accepted
+        bool m_CloseAfterFlush;                             // close once the queue is drained
+        bool m_KickRequested;                               // closed by the next handle_exception
+
+        static uint32 s_maxLineLength;
+        static uint32 s_sendQueueMaxFrames;
+        static uint32 s_sendQueueMaxBytes;
+        static SlowConsumerPolicy s_slowConsumerPolicy;
+        static ACE_Time_Value s_flushWindow;
+        static uint32 s_flushMaxBytes;
+        static bool s_flushCork;
+        static uint32 s_loginTimeout;
+        static uint32 s_idleTimeout;
+        static uint32 s_pongTimeout;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint32> s_totalTimeouts;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint64> s_totalWriteCalls;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint64> s_totalWrittenFrames;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint64> s_totalFlushes;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint64> s_totalFlushDelay;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint64> s_totalReadCalls;
+        static bool s_webSocketEnabled;
+        static SocketConnectorWebSocket::Settings s_webSocket;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint32> s_totalDroppedFrames;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint32> s_totalSlowConsumerKicks;
+
+        /// Reference counts of shared frames are touched from several threads
+        static ACE_Lock_Adapter<ACE_Thread_Mutex> s_frameLocks[];
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint32> s_frameLockIndex;
+
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint32> s_nextSerial;
 };
 #endif
 /// @}
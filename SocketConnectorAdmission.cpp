@@ -0,0 +1,212 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "Util.h"
+#include "SocketConnectorAdmission.h"
+#include "SocketConnector.h"
+
+#include <sstream>
+
+#include <ace/ACE.h>
+#include <ace/OS_NS_sys_socket.h>
+#include <ace/os_include/netinet/os_tcp.h>
+
+#define ADMISSION_UPDATE_INTERVAL 10                        // seconds between queue position lines
+#define ADMISSION_RETRY_MIN 5                               // refused clients retry after 5 to 30 seconds
+#define ADMISSION_RETRY_SPREAD 25
+
+SocketConnectorAdmission::SocketConnectorAdmission() : m_running(0), m_peakQueued(0), m_refused(0), m_nextUpdate(0),
+    m_maxLogins(16), m_maxQueue(2000), m_maxQueuedPerHost(4), m_acceptBatch(32), m_deferAccept(5), m_backlog(1024),
+    m_queueTimeout(120)
+{
+}
+
+void SocketConnectorAdmission::LoadConfig()
+{
+    m_maxLogins = ConfigMgr::GetIntDefault("SocketConnector.Admission.MaxLogins", 16);
+    if (!m_maxLogins)
+        m_maxLogins = 1;
+
+    m_maxQueue = ConfigMgr::GetIntDefault("SocketConnector.Admission.MaxQueue", 2000);
+    m_maxQueuedPerHost = ConfigMgr::GetIntDefault("SocketConnector.Admission.MaxQueuedPerHost", 4);
+
+    m_acceptBatch = ConfigMgr::GetIntDefault("SocketConnector.Admission.AcceptBatch", 32);
+    if (!m_acceptBatch)
+        m_acceptBatch = 1;
+
+    // seconds the kernel holds a connection that has not sent anything yet
+    m_deferAccept = ConfigMgr::GetIntDefault("SocketConnector.Admission.DeferAccept", 5);
+    m_backlog = ConfigMgr::GetIntDefault("SocketConnector.Admission.Backlog", 1024);
+    m_queueTimeout = ConfigMgr::GetIntDefault("SocketConnector.Admission.QueueTimeout", 120);
+}
+
+SocketConnectorAdmission::AdmitResult SocketConnectorAdmission::Request(SocketConnector* conn, uint32 host, uint32& position)
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, ADMIT_NOW);
+
+    // nobody may overtake the queue
+    if (m_running < m_maxLogins && m_queue.empty())
+    {
+        ++m_running;
+        return ADMIT_NOW;
+    }
+
+    // the address is unknown for IPv6 peers, they only share the global limit
+    HostCounts::iterator count = host ? m_hosts.find(host) : m_hosts.end();
+    bool hostFull = count != m_hosts.end() && count->second >= m_maxQueuedPerHost;
+
+    if (m_queue.size() >= m_maxQueue || hostFull)
+    {
+        // a spread out retry keeps the refused clients from coming back as one wave
+        ++m_refused;
+        position = ADMISSION_RETRY_MIN + urand(0, ADMISSION_RETRY_SPREAD);
+        return ADMIT_REFUSED;
+    }
+
+    if (host)
+        ++m_hosts[host];
+
+    Entry entry;
+    entry.conn = conn;
+    entry.host = host;
+    m_index[conn] = m_queue.insert(m_queue.end(), entry);
+
+    position = uint32(m_queue.size());
+    if (position > m_peakQueued)
+        m_peakQueued = position;
+
+    return ADMIT_QUEUED;
+}
+
+void SocketConnectorAdmission::Finish()
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    if (m_running)
+        --m_running;
+
+    Grant();
+}
+
+bool SocketConnectorAdmission::Cancel(SocketConnector* conn)
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, false);
+
+    QueueIndex::iterator itr = m_index.find(conn);
+    if (itr == m_index.end())
+        return false;
+
+    Unlink(itr->second);
+    return true;
+}
+
+void SocketConnectorAdmission::Grant()
+{
+    while (m_running < m_maxLogins && !m_queue.empty())
+    {
+        SocketConnector* conn = m_queue.front().conn;
+        Unlink(m_queue.begin());
+        ++m_running;
+
+        // notified under the lock: a closing connection cancels before it purges its notifications
+        conn->reactor()->notify(conn, ACE_Event_Handler::EXCEPT_MASK);
+    }
+}
+
+void SocketConnectorAdmission::Unlink(Queue::iterator itr)
+{
+    if (itr->host)
+    {
+        HostCounts::iterator count = m_hosts.find(itr->host);
+        if (count != m_hosts.end() && --count->second == 0)
+            m_hosts.erase(count);
+    }
+
+    m_index.erase(itr->conn);
+    m_queue.erase(itr);
+}
+
+void SocketConnectorAdmission::Update()
+{
+    time_t now = time(NULL);
+    if (now < m_nextUpdate)
+        return;
+
+    m_nextUpdate = now + ADMISSION_UPDATE_INTERVAL;
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    // queued connections are alive while they are in the queue, see Cancel
+    uint32 position = 0;
+    for (Queue::const_iterator itr = m_queue.begin(); itr != m_queue.end(); ++itr)
+    {
+        std::ostringstream ss;
+        ss << "q\\" << ++position;
+        (void) itr->conn->send(ss.str());
+    }
+}
+
+void SocketConnectorAdmission::ConfigureListener(ACE_HANDLE listener) const
+{
+#ifdef TCP_DEFER_ACCEPT
+    // a browser that never sends its first line costs nothing but a kernel entry
+    if (m_deferAccept)
+    {
+        int value = int(m_deferAccept);
+        ACE_OS::setsockopt(listener, IPPROTO_TCP, TCP_DEFER_ACCEPT, (const char*)&value, sizeof(value));
+    }
+#endif
+
+    // the acceptor listens with ACE's small default backlog, listening again raises it
+    ACE_OS::listen(listener, int(m_backlog));
+}
+
+uint32 SocketConnectorAdmission::GetRunning() const
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, 0);
+    return m_running;
+}
+
+uint32 SocketConnectorAdmission::GetQueued() const
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, 0);
+    return uint32(m_queue.size());
+}
+
+int SocketConnectorAcceptor::handle_input(ACE_HANDLE listener)
+{
+    uint32 batch = sSocketConnectorAdmission->GetAcceptBatch();
+
+    for (uint32 accepted = 0; accepted < batch; ++accepted)
+    {
+        ACE_Time_Value poll = ACE_Time_Value::zero;
+        if (accepted && ACE::handle_read_ready(listener, &poll) != 1)
+            break;
+
+        if (ACE_Acceptor<SocketConnector, ACE_SOCK_ACCEPTOR>::handle_input(listener) == -1)
+            return -1;
+    }
+
+    return 0;
+}
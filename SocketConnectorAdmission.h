@@ -0,0 +1,127 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorAdmission_H
+#define _SocketConnectorAdmission_H
+
+#include "Common.h"
+#include "UnorderedMap.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Acceptor.h>
+#include <ace/SOCK_Acceptor.h>
+
+#include <list>
+
+class SocketConnector;
+
+/// Admission of logins after a restart, when every browser reconnects at once.
+/// At most MaxLogins password checks run at a time; further logins wait in a FIFO
+/// queue and are told their position. A host may only hold a few queue places,
+/// so one address cannot crowd out the others, and once the queue is full new
+/// logins are refused with a randomized retry delay instead of piling up.
+/// Resumed sessions need no password check and never wait.
+class SocketConnectorAdmission
+{
+    friend class ACE_Singleton<SocketConnectorAdmission, ACE_Null_Mutex>;
+
+    public:
+        enum AdmitResult
+        {
+            ADMIT_NOW,
+            ADMIT_QUEUED,
+            ADMIT_REFUSED
+        };
+
+        /// Reads SocketConnector.Admission.* settings
+        void LoadConfig();
+
+        /// Connection thread. ADMIT_QUEUED reports the place in the queue (1 is next),
+        /// ADMIT_REFUSED the seconds the client should wait before trying again.
+        AdmitResult Request(SocketConnector* conn, uint32 host, uint32& position);
+        /// A login that was admitted left the password check, the next one in the queue starts
+        void Finish();
+        /// A queued connection closes. False if it was already admitted and still owns a slot.
+        bool Cancel(SocketConnector* conn);
+
+        /// Connector thread, sends the queued clients their current position now and then
+        void Update();
+
+        /// Deferred accept and listen backlog of the listen socket
+        void ConfigureListener(ACE_HANDLE listener) const;
+        uint32 GetAcceptBatch() const { return m_acceptBatch; }
+        uint32 GetQueueTimeout() const { return m_queueTimeout; }
+
+        uint32 GetRunning() const;
+        uint32 GetQueued() const;
+        uint32 GetPeakQueued() const { return m_peakQueued; }
+        uint32 GetRefused() const { return m_refused; }
+
+    private:
+        SocketConnectorAdmission();
+        ~SocketConnectorAdmission() { }
+
+        struct Entry
+        {
+            SocketConnector* conn;
+            uint32 host;
+        };
+
+        typedef std::list<Entry> Queue;
+        typedef UNORDERED_MAP<SocketConnector*, Queue::iterator> QueueIndex;
+        typedef UNORDERED_MAP<uint32, uint32> HostCounts;
+
+        /// Called with m_lock held
+        void Grant();
+        void Unlink(Queue::iterator itr);
+
+        mutable ACE_Thread_Mutex m_lock;
+        Queue m_queue;
+        QueueIndex m_index;
+        HostCounts m_hosts;
+        uint32 m_running;
+        uint32 m_peakQueued;
+        uint32 m_refused;
+        time_t m_nextUpdate;
+
+        uint32 m_maxLogins;
+        uint32 m_maxQueue;
+        uint32 m_maxQueuedPerHost;
+        uint32 m_acceptBatch;
+        uint32 m_deferAccept;
+        uint32 m_backlog;
+        uint32 m_queueTimeout;
+};
+
+#define sSocketConnectorAdmission ACE_Singleton<SocketConnectorAdmission, ACE_Null_Mutex>::instance()
+
+/// Reactor engine listener that takes at most Admission.AcceptBatch connections per
+/// wakeup, the rest of a storm waits in the backlog behind the I/O of open connections
+class SocketConnectorAcceptor : public ACE_Acceptor<SocketConnector, ACE_SOCK_ACCEPTOR>
+{
+    public:
+        virtual int handle_input(ACE_HANDLE listener);
+};
+
+#endif
+/// @}
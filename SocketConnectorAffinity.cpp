@@ -0,0 +1,331 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "SocketConnectorAffinity.h"
+
+#ifdef __linux__
+
+#include <sched.h>
+#include <pthread.h>
+#include <sys/resource.h>
+#include <cstdio>
+#include <cstdlib>
+
+#define PROCESS_HIGH_PRIORITY -15                           // nice value for ProcessPriority = 1
+
+static const char* s_roleNames[SocketConnectorAffinity::MAX_AFFINITY_ROLES] =
+{
+    "World",
+    "Network",
+    "WebChat",
+    "Database",
+    "FreezeDetector"
+};
+
+static bool s_enabled = false;
+static cpu_set_t s_original;                                // placement of the main thread, after UseProcessors
+static cpu_set_t s_roles[SocketConnectorAffinity::MAX_AFFINITY_ROLES];
+static int s_worldPolicy = SCHED_OTHER;
+static int s_worldPriority = 0;
+
+/// "0-3,8,10-11" as used by taskset and /sys, returns false on garbage
+static bool ParseCpuList(std::string const& list, cpu_set_t& set)
+{
+    CPU_ZERO(&set);
+
+    char const* p = list.c_str();
+    while (*p)
+    {
+        while (*p == ' ' || *p == ',' || *p == '\n')
+            ++p;
+        if (!*p)
+            break;
+
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p || first < 0 || first >= CPU_SETSIZE)
+            return false;
+
+        long last = first;
+        p = end;
+        if (*p == '-')
+        {
+            last = strtol(++p, &end, 10);
+            if (end == p || last < first || last >= CPU_SETSIZE)
+                return false;
+            p = end;
+        }
+
+        for (long cpu = first; cpu <= last; ++cpu)
+            CPU_SET(cpu, &set);
+    }
+
+    return true;
+}
+
+static bool ReadCpuList(std::string const& path, cpu_set_t& set)
+{
+    FILE* file = fopen(path.c_str(), "r");
+    if (!file)
+        return false;
+
+    char line[1024];
+    bool ok = fgets(line, sizeof(line), file) && ParseCpuList(line, set);
+    fclose(file);
+    return ok;
+}
+
+static std::string FormatCpuList(cpu_set_t const& set)
+{
+    std::string list;
+    char buf[32];
+
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+    {
+        if (!CPU_ISSET(cpu, &set))
+            continue;
+
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set))
+            ++last;
+
+        if (last == cpu)
+            snprintf(buf, sizeof(buf), "%s%d", list.empty() ? "" : ",", cpu);
+        else
+            snprintf(buf, sizeof(buf), "%s%d-%d", list.empty() ? "" : ",", cpu, last);
+
+        list += buf;
+        cpu = last;
+    }
+
+    return list;
+}
+
+static void Remove(cpu_set_t& set, cpu_set_t const& removed)
+{
+    for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu)
+        if (CPU_ISSET(cpu, &removed))
+            CPU_CLR(cpu, &set);
+}
+
+/// Fills every role with the topology defaults, configured roles are overwritten afterwards
+static void SetDefaults()
+{
+    for (uint8 i = 0; i < SocketConnectorAffinity::MAX_AFFINITY_ROLES; ++i)
+        s_roles[i] = s_original;
+
+    // one cpu has nothing to share out
+    if (CPU_COUNT(&s_original) < 2)
+        return;
+
+    cpu_set_t node0, node1;
+    if (!ReadCpuList("/sys/devices/system/node/node0/cpulist", node0))
+        node0 = s_original;
+    CPU_AND(&node0, &node0, &s_original);
+    if (!CPU_COUNT(&node0))
+        node0 = s_original;
+
+    if (!ReadCpuList("/sys/devices/system/node/node1/cpulist", node1))
+        CPU_ZERO(&node1);
+    CPU_AND(&node1, &node1, &s_original);
+
+    int first = 0;
+    while (!CPU_ISSET(first, &node0))
+        ++first;
+
+    // the whole physical core, a hyperthread sibling busy with packets slows the world thread as well
+    cpu_set_t world;
+    char path[128];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list", first);
+    if (!ReadCpuList(path, world))
+        CPU_ZERO(&world);
+    CPU_AND(&world, &world, &s_original);
+    CPU_SET(first, &world);
+
+    cpu_set_t rest = node0;
+    Remove(rest, world);
+    if (!CPU_COUNT(&rest))
+    {
+        rest = s_original;
+        Remove(rest, world);
+    }
+    // a single core with siblings, only the world thread's cpu is kept apart
+    if (!CPU_COUNT(&rest))
+    {
+        CPU_ZERO(&world);
+        CPU_SET(first, &world);
+        rest = s_original;
+        CPU_CLR(first, &rest);
+    }
+
+    s_roles[SocketConnectorAffinity::ROLE_WORLD] = world;
+    s_roles[SocketConnectorAffinity::ROLE_NETWORK] = rest;
+    s_roles[SocketConnectorAffinity::ROLE_DATABASE] = rest;
+    s_roles[SocketConnectorAffinity::ROLE_FREEZE_DETECTOR] = rest;
+    // the web chat is not latency bound for the game, it takes the far node when there is one
+    s_roles[SocketConnectorAffinity::ROLE_WEBCHAT] = CPU_COUNT(&node1) ? node1 : rest;
+}
+
+void SocketConnectorAffinity::Load()
+{
+    if (sched_getaffinity(0, sizeof(s_original), &s_original))
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "Can't read the processors of the worldserver, thread placement disabled");
+        return;
+    }
+
+    // same meaning as on Windows, the threads started from here on inherit it
+    uint32 aff = ConfigMgr::GetIntDefault("UseProcessors", 0);
+    if (aff > 0)
+    {
+        cpu_set_t used;
+        CPU_ZERO(&used);
+        for (int cpu = 0; cpu < 32; ++cpu)
+            if ((aff & (1u << cpu)) && CPU_ISSET(cpu, &s_original))
+                CPU_SET(cpu, &used);
+
+        if (!CPU_COUNT(&used))
+            sLog->outError(LOG_FILTER_WORLDSERVER, "Processors marked in UseProcessors bitmask (hex) %x are not accessible for the worldserver. Accessible processors: %s",
+                aff, FormatCpuList(s_original).c_str());
+        else if (sched_setaffinity(0, sizeof(used), &used))
+            sLog->outError(LOG_FILTER_WORLDSERVER, "Can't set used processors: %s", FormatCpuList(used).c_str());
+        else
+        {
+            s_original = used;
+            sLog->outInfo(LOG_FILTER_WORLDSERVER, "Using processors: %s", FormatCpuList(used).c_str());
+        }
+    }
+
+    if (ConfigMgr::GetBoolDefault("ProcessPriority", false))
+    {
+        if (setpriority(PRIO_PROCESS, 0, PROCESS_HIGH_PRIORITY))
+            sLog->outError(LOG_FILTER_WORLDSERVER, "Can't set worldserver process priority.");
+        else
+            sLog->outInfo(LOG_FILTER_WORLDSERVER, "worldserver process priority set to %d", PROCESS_HIGH_PRIORITY);
+    }
+
+    s_enabled = ConfigMgr::GetBoolDefault("ThreadAffinity.Enable", false);
+    if (!s_enabled)
+        return;
+
+    SetDefaults();
+
+    for (uint8 i = 0; i < MAX_AFFINITY_ROLES; ++i)
+    {
+        std::string key = std::string("ThreadAffinity.") + s_roleNames[i];
+        std::string list = ConfigMgr::GetStringDefault(key.c_str(), "");
+        if (list.empty())
+            continue;
+
+        cpu_set_t set;
+        if (!ParseCpuList(list, set))
+        {
+            sLog->outError(LOG_FILTER_WORLDSERVER, "%s: invalid processor list '%s', using the default", key.c_str(), list.c_str());
+            continue;
+        }
+
+        CPU_AND(&set, &set, &s_original);
+        if (!CPU_COUNT(&set))
+        {
+            sLog->outError(LOG_FILTER_WORLDSERVER, "%s: processors %s are not accessible for the worldserver, using the default", key.c_str(), list.c_str());
+            continue;
+        }
+
+        s_roles[i] = set;
+    }
+
+    switch (ConfigMgr::GetIntDefault("WorldThread.SchedPolicy", 0))
+    {
+        case 1: s_worldPolicy = SCHED_FIFO; break;
+        case 2: s_worldPolicy = SCHED_RR; break;
+        default: s_worldPolicy = SCHED_OTHER; break;
+    }
+
+    if (s_worldPolicy != SCHED_OTHER)
+    {
+        int minPriority = sched_get_priority_min(s_worldPolicy);
+        int maxPriority = sched_get_priority_max(s_worldPolicy);
+        s_worldPriority = ConfigMgr::GetIntDefault("WorldThread.SchedPriority", 10);
+        if (s_worldPriority < minPriority)
+            s_worldPriority = minPriority;
+        else if (s_worldPriority > maxPriority)
+            s_worldPriority = maxPriority;
+    }
+
+    for (uint8 i = 0; i < MAX_AFFINITY_ROLES; ++i)
+        sLog->outInfo(LOG_FILTER_WORLDSERVER, "%s threads on processors %s", s_roleNames[i], FormatCpuList(s_roles[i]).c_str());
+}
+
+void SocketConnectorAffinity::Enter(Role role)
+{
+    if (!s_enabled)
+        return;
+
+    if (sched_setaffinity(0, sizeof(s_roles[role]), &s_roles[role]))
+        sLog->outError(LOG_FILTER_WORLDSERVER, "Can't place %s threads on processors %s", s_roleNames[role], FormatCpuList(s_roles[role]).c_str());
+
+    // ACE starts threads with inherited scheduling, a real time policy needs CAP_SYS_NICE or RLIMIT_RTPRIO
+    if (role == ROLE_WORLD && s_worldPolicy != SCHED_OTHER)
+    {
+        sched_param param;
+        param.sched_priority = s_worldPriority;
+        if (pthread_setschedparam(pthread_self(), s_worldPolicy, &param))
+        {
+            sLog->outError(LOG_FILTER_WORLDSERVER, "Can't set the scheduling policy of the world thread (%s %d)",
+                s_worldPolicy == SCHED_FIFO ? "SCHED_FIFO" : "SCHED_RR", s_worldPriority);
+
+            // the world thread starts with the usual policy and gets its usual priority
+            s_worldPolicy = SCHED_OTHER;
+        }
+    }
+}
+
+bool SocketConnectorAffinity::IsWorldRealtime()
+{
+    return s_enabled && s_worldPolicy != SCHED_OTHER;
+}
+
+void SocketConnectorAffinity::Restore()
+{
+    if (!s_enabled)
+        return;
+
+    sched_setaffinity(0, sizeof(s_original), &s_original);
+
+    if (s_worldPolicy != SCHED_OTHER)
+    {
+        sched_param param;
+        param.sched_priority = 0;
+        pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+    }
+}
+
+#else
+
+void SocketConnectorAffinity::Load() { }
+void SocketConnectorAffinity::Enter(Role /*role*/) { }
+void SocketConnectorAffinity::Restore() { }
+bool SocketConnectorAffinity::IsWorldRealtime() { return false; }
+
+#endif
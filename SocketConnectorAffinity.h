@@ -0,0 +1,60 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorAffinity_H
+#define _SocketConnectorAffinity_H
+
+#include "Common.h"
+
+/// Thread placement of the worldserver on Linux, what UseProcessors and ProcessPriority do on Windows.
+/// Linux threads start with the CPU mask and scheduling policy of the thread that creates them, so
+/// Master::Run enters a role before it starts the threads of that role and restores its own
+/// placement afterwards; the threads those threads start (reactors, web chat shards, DB workers)
+/// follow. Roles without a configured CPU list get defaults from the NUMA topology: the world
+/// thread keeps a physical core of node 0 to itself, the web chat goes to node 1 when there is one.
+/// Everything is a no-op on other platforms.
+class SocketConnectorAffinity
+{
+    public:
+        enum Role
+        {
+            ROLE_WORLD,
+            ROLE_NETWORK,                                   // world sockets, RA, SOAP
+            ROLE_WEBCHAT,
+            ROLE_DATABASE,
+            ROLE_FREEZE_DETECTOR,
+            MAX_AFFINITY_ROLES
+        };
+
+        /// Reads ThreadAffinity.* and WorldThread.*, called by Master::Run before any thread starts
+        static void Load();
+
+        /// Threads started by the calling thread until Restore() get the placement of the role
+        static void Enter(Role role);
+        static void Restore();
+
+        /// The world thread runs with SCHED_FIFO or SCHED_RR. ACE_Based::Thread::setPriority must not
+        /// be called on it then, it would apply a SCHED_OTHER priority the kernel refuses.
+        static bool IsWorldRealtime();
+};
+
+#endif
+/// @}
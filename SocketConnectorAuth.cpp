@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Log.h"
+#include "AccountMgr.h"
+#include "SocketConnectorAuth.h"
+#include "SocketConnector.h"
+#include "SocketConnectorDatabase.h"
+#include "SocketConnectorCharacters.h"
+
+#include <ace/Method_Request.h>
+
+/// Runs the hashing step of a request on an auth worker
+class AuthHashTask : public ACE_Method_Request
+{
+    public:
+        AuthHashTask(SocketConnectorAuthRequest* request) : m_request(request) { }
+
+        virtual int call()
+        {
+            m_request->Hash();
+            return 0;
+        }
+
+    private:
+        SocketConnectorAuthRequest* m_request;
+};
+
+SocketConnectorAuthRequest::SocketConnectorAuthRequest(SocketConnector* conn, const std::string& user, const std::string& pass) :
+    m_conn(conn), m_user(user), m_pass(pass), m_accountId(0), m_done(false), m_abandoned(false)
+{
+}
+
+SocketConnectorAuthRequest::~SocketConnectorAuthRequest()
+{
+    if (m_accountId)
+        sSocketConnectorCharacters->Release(m_accountId);
+}
+
+void SocketConnectorAuthRequest::Hash()
+{
+    {
+        ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+        if (m_abandoned)
+        {
+            guard.release();
+            delete this;
+            return;
+        }
+    }
+
+    std::string safe_user = m_user;
+    AccountMgr::normalizeString(safe_user);
+
+    std::string safe_pass = m_pass;
+    AccountMgr::normalizeString(safe_pass);
+    m_pass.clear();
+
+    // id, mutetime and ban state in one round trip
+    LoginDatabaseWorkerPool& database = SocketConnectorDatabase::Login();
+    PreparedStatement* stmt = database.GetPreparedStatement(LOGIN_SEL_SOCKET_CONNECTOR_AUTH);
+    stmt->setString(0, safe_user);
+    stmt->setString(1, AccountMgr::CalculateShaPassHash(safe_user, safe_pass));
+
+    // update() is called on the database worker that sets the future
+    m_future = database.AsyncQuery(stmt);
+    m_future.attach(this);
+}
+
+void SocketConnectorAuthRequest::update(const ACE_Future<PreparedQueryResult>& future)
+{
+    PreparedQueryResult result;
+    future.get(result);
+
+    {
+        ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+        if (m_abandoned)
+        {
+            guard.release();
+            delete this;
+            return;
+        }
+
+        m_result = result;
+    }
+
+    // the character list is cached before the login resumes, the reactor never waits for the database
+    if (result)
+    {
+        Field* fields = result->Fetch();
+        if (!fields[2].GetBool())
+        {
+            m_accountId = fields[0].GetUInt32();
+            if (!sSocketConnectorCharacters->Acquire(m_accountId, this))
+                return;                                     // CharactersLoaded() follows from the query
+        }
+    }
+
+    CharactersLoaded();
+}
+
+void SocketConnectorAuthRequest::CharactersLoaded()
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    if (m_abandoned)
+    {
+        guard.release();
+        delete this;
+        return;
+    }
+
+    m_done = true;
+
+    // resume the login on the connection's reactor thread, see SocketConnector::handle_exception
+    m_conn->reactor()->notify(m_conn, ACE_Event_Handler::EXCEPT_MASK);
+}
+
+bool SocketConnectorAuthRequest::Abandon()
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, false);
+
+    if (m_done)
+        return true;
+
+    m_abandoned = true;
+    return false;
+}
+
+bool SocketConnectorAuth::Start(uint32 threads)
+{
+    if (activate(THR_NEW_LWP | THR_JOINABLE, int(threads)) == -1)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorAuth: can not start %u auth worker threads", threads);
+        return false;
+    }
+
+    return true;
+}
+
+void SocketConnectorAuth::Stop()
+{
+    m_queue.queue()->deactivate();
+    wait();
+}
+
+void SocketConnectorAuth::Enqueue(SocketConnectorAuthRequest* request)
+{
+    m_queue.enqueue(new AuthHashTask(request));
+}
+
+int SocketConnectorAuth::svc()
+{
+    for (;;)
+    {
+        ACE_Method_Request* task = m_queue.dequeue();
+        if (!task)
+            break;                                          // queue deactivated
+
+        task->call();
+        delete task;
+    }
+
+    return 0;
+}
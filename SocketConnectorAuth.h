@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorAuth_H
+#define _SocketConnectorAuth_H
+
+#include "Common.h"
+#include "DatabaseEnv.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Task.h>
+#include <ace/Activation_Queue.h>
+#include <ace/Future.h>
+
+class SocketConnector;
+
+/// One login in flight.
+/// Shared by the connection and the pipeline; whichever side finishes last deletes it.
+/// A successful login also has the account's characters cached before it completes.
+class SocketConnectorAuthRequest : public ACE_Future_Observer<PreparedQueryResult>
+{
+    public:
+        SocketConnectorAuthRequest(SocketConnector* conn, const std::string& user, const std::string& pass);
+        ~SocketConnectorAuthRequest();
+
+        /// Pipeline steps: password hash on an auth worker, lookup on the LoginDatabase workers,
+        /// characters from SocketConnectorCharacters, which may query the CharacterDatabase workers
+        void Hash();
+        virtual void update(const ACE_Future<PreparedQueryResult>& future);
+        void CharactersLoaded();
+
+        /// Called by the connection on the reactor thread. Returns true if the request
+        /// was already completed and the caller has to delete it.
+        bool Abandon();
+
+        /// Valid after completion
+        PreparedQueryResult GetResult() const { return m_result; }
+        /// The connection takes over the reference on the account's cached characters
+        void TakeCharacters() { m_accountId = 0; }
+
+    private:
+        ACE_Thread_Mutex m_lock;
+        SocketConnector* m_conn;
+        std::string m_user;
+        std::string m_pass;
+        PreparedQueryResultFuture m_future;
+        PreparedQueryResult m_result;
+        uint32 m_accountId;                                 // characters referenced, released unless taken
+        bool m_done;
+        bool m_abandoned;
+};
+
+/// Worker threads that take password hashing off the connector reactor
+class SocketConnectorAuth : public ACE_Task_Base
+{
+    friend class ACE_Singleton<SocketConnectorAuth, ACE_Null_Mutex>;
+
+    public:
+        bool Start(uint32 threads);
+        void Stop();
+
+        void Enqueue(SocketConnectorAuthRequest* request);
+
+        virtual int svc();
+
+    private:
+        SocketConnectorAuth() { }
+        ~SocketConnectorAuth() { }
+
+        ACE_Activation_Queue m_queue;
+};
+
+#define sSocketConnectorAuth ACE_Singleton<SocketConnectorAuth, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "SharedDefines.h"
+#include "ChannelMgr.h"
+#include "SocketConnectorChannels.h"
+
+SocketConnectorChannels::SocketConnectorChannels() : m_deletions(0)
+{
+    for (uint8 i = 0; i < MAX_CONNECTOR_CHANNEL_TEAMS; ++i)
+        m_lfg[i] = NULL;
+}
+
+uint8 SocketConnectorChannels::TeamIndex(uint32 team)
+{
+    return team == HORDE ? 1 : 0;
+}
+
+Channel* SocketConnectorChannels::GetLFG(uint32 team)
+{
+    uint8 index = TeamIndex(team);
+    if (Channel* channel = m_lfg[index])
+        return channel;
+
+    // the channel existed before the hooks saw it, find it once; ChannelMgr::channels
+    // is only changed by the world thread, the caller
+    if (ChannelMgr* cMgr = channelMgr(team))
+    {
+        for (std::map<std::wstring, Channel*>::const_iterator i = cMgr->channels.begin(); i != cMgr->channels.end(); ++i)
+        {
+            if (i->second->IsLFG())
+            {
+                m_lfg[index] = i->second;
+                return i->second;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+Channel* SocketConnectorChannels::Find(SocketConnectorChannelHandle const& handle, std::string const& name) const
+{
+    if (!handle.channel || handle.deletions != m_deletions || handle.name != name)
+        return NULL;
+
+    return handle.channel;
+}
+
+void SocketConnectorChannels::Remember(SocketConnectorChannelHandle& handle, std::string const& name, Channel* channel) const
+{
+    handle.name = name;
+    handle.channel = channel;
+    handle.deletions = m_deletions;
+}
+
+void SocketConnectorChannels::OnChannelCreated(uint32 team, Channel* channel)
+{
+    if (channel->IsLFG())
+        m_lfg[TeamIndex(team)] = channel;
+}
+
+void SocketConnectorChannels::OnChannelDeleted(Channel* channel)
+{
+    // with cross faction channels both teams share one ChannelMgr, check every slot
+    for (uint8 i = 0; i < MAX_CONNECTOR_CHANNEL_TEAMS; ++i)
+        if (m_lfg[i] == channel)
+            m_lfg[i] = NULL;
+
+    // channels are deleted rarely, the sessions resolve their channel once more
+    ++m_deletions;
+}
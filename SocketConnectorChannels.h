@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorChannels_H
+#define _SocketConnectorChannels_H
+
+#include "Common.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+
+class Channel;
+
+#define MAX_CONNECTOR_CHANNEL_TEAMS 2                       // alliance, horde channel managers
+
+/// Channel a game session spoke in last, WorldSession::m_lastChannel
+struct SocketConnectorChannelHandle
+{
+    SocketConnectorChannelHandle() : channel(NULL), deletions(0) { }
+
+    std::string name;
+    Channel* channel;
+    uint32 deletions;                                       // SocketConnectorChannels deletions when it was resolved
+};
+
+/// Resolved channel handles, so chat lines do not search ChannelMgr::channels.
+/// Everything here belongs to the world thread, like ChannelMgr itself: the LFG
+/// handle is resolved when the inbox delivers web chat lines, every game session
+/// keeps the channel it spoke in last, and the ChannelMgr hooks report created
+/// and deleted channels. Connector threads post their lines to
+/// SocketConnectorInbox and never call in here.
+class SocketConnectorChannels
+{
+    friend class ACE_Singleton<SocketConnectorChannels, ACE_Null_Mutex>;
+
+    public:
+        /// World thread only. LFG channel of the team, NULL until someone joined it
+        Channel* GetLFG(uint32 team);
+
+        /// World thread only. NULL if the handle names another channel or a channel was deleted since
+        Channel* Find(SocketConnectorChannelHandle const& handle, std::string const& name) const;
+        void Remember(SocketConnectorChannelHandle& handle, std::string const& name, Channel* channel) const;
+
+        /// Hooks for ChannelMgr::GetJoinChannel / ChannelMgr::LeftChannel
+        void OnChannelCreated(uint32 team, Channel* channel);
+        void OnChannelDeleted(Channel* channel);
+
+    private:
+        SocketConnectorChannels();
+        ~SocketConnectorChannels() { }
+
+        static uint8 TeamIndex(uint32 team);
+
+        Channel* m_lfg[MAX_CONNECTOR_CHANNEL_TEAMS];
+        uint32 m_deletions;                                 // a deleted channel invalidates every session handle
+};
+
+#define sSocketConnectorChannels ACE_Singleton<SocketConnectorChannels, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
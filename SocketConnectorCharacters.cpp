@@ -0,0 +1,309 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Log.h"
+#include "DatabaseEnv.h"
+#include "SocketConnectorCharacters.h"
+#include "SocketConnectorDatabase.h"
+#include "SocketConnectorAuth.h"
+
+#include <algorithm>
+
+/// Query of one account's characters, deletes itself once the rows are handed over
+class SocketConnectorCharacterLoad : public ACE_Future_Observer<PreparedQueryResult>
+{
+    public:
+        SocketConnectorCharacterLoad(uint32 accountId, uint32 generation) : m_accountId(accountId), m_generation(generation) { }
+
+        /// update() may already run from here if the query completes at once
+        void Start()
+        {
+            // guid, name, race and guild in one round trip
+            CharacterDatabaseWorkerPool& database = SocketConnectorDatabase::Character();
+            PreparedStatement* stmt = database.GetPreparedStatement(CHAR_SEL_SOCKET_CONNECTOR_CHARACTERS);
+            stmt->setUInt32(0, m_accountId);
+
+            PreparedQueryResultFuture future = database.AsyncQuery(stmt);
+            future.attach(this);
+        }
+
+        virtual void update(const ACE_Future<PreparedQueryResult>& future)
+        {
+            PreparedQueryResult result;
+            future.get(result);
+
+            sSocketConnectorCharacters->Loaded(m_accountId, m_generation, result);
+            delete this;
+        }
+
+    private:
+        uint32 m_accountId;
+        uint32 m_generation;
+};
+
+bool SocketConnectorCharacters::Acquire(uint32 accountId, SocketConnectorAuthRequest* request)
+{
+    SocketConnectorCharacterLoad* load;
+    {
+        ACE_WRITE_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, m_lock, true);
+
+        Account& account = m_accounts[accountId];
+        ++account.references;
+
+        // a reload after a change serves the old list meanwhile
+        if (account.loaded)
+            return true;
+
+        if (request)
+            account.waiters.push_back(request);
+
+        // a reconnect storm of one account waits for a single query
+        if (account.loading)
+            return false;
+
+        account.loading = true;
+        ++m_loading;
+        load = new SocketConnectorCharacterLoad(accountId, account.generation);
+    }
+
+    // Loaded() takes the lock
+    load->Start();
+    return false;
+}
+
+void SocketConnectorCharacters::Release(uint32 accountId)
+{
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+    AccountMap::iterator itr = m_accounts.find(accountId);
+    if (itr == m_accounts.end() || --itr->second.references)
+        return;
+
+    // a running query drops the account once it returns
+    if (!itr->second.loading)
+        EraseLocked(itr);
+}
+
+void SocketConnectorCharacters::EraseLocked(AccountMap::iterator itr)
+{
+    for (CharacterList::const_iterator character = itr->second.characters.begin(); character != itr->second.characters.end(); ++character)
+        m_owners.erase(character->guid);
+
+    m_accounts.erase(itr);
+}
+
+void SocketConnectorCharacters::Loaded(uint32 accountId, uint32 generation, PreparedQueryResult result)
+{
+    CharacterList characters;
+    if (result)
+    {
+        do
+        {
+            Field* fields = result->Fetch();
+
+            CharacterInfo info;
+            info.guid = fields[0].GetUInt32();
+            info.name = fields[1].GetString();
+            info.race = fields[2].GetUInt8();
+            info.guildId = fields[3].GetUInt32();
+            characters.push_back(info);
+        }
+        while (result->NextRow());
+    }
+
+    std::vector<SocketConnectorAuthRequest*> waiters;
+    SocketConnectorCharacterLoad* again = NULL;
+    {
+        ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+        AccountMap::iterator itr = m_accounts.find(accountId);
+        if (itr == m_accounts.end())
+            return;
+
+        Account& account = itr->second;
+
+        if (account.references && account.generation != generation)
+        {
+            // the characters changed while the query ran, its rows may not show it
+            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnectorCharacters: characters of account %u changed during load, loading again", accountId);
+            again = new SocketConnectorCharacterLoad(accountId, account.generation);
+        }
+        else
+        {
+            for (CharacterList::iterator character = characters.begin(); character != characters.end(); ++character)
+            {
+                GuildMap::const_iterator guild = m_loadingGuilds.find(character->guid);
+                if (guild != m_loadingGuilds.end())
+                    character->guildId = guild->second;
+
+                if (std::find(m_loadingDisbands.begin(), m_loadingDisbands.end(), character->guildId) != m_loadingDisbands.end())
+                    character->guildId = 0;
+            }
+
+            account.loading = false;
+            if (--m_loading == 0)
+            {
+                m_loadingGuilds.clear();
+                m_loadingDisbands.clear();
+            }
+
+            waiters.swap(account.waiters);
+
+            if (!account.references)
+                EraseLocked(itr);
+            else
+            {
+                for (CharacterList::const_iterator character = account.characters.begin(); character != account.characters.end(); ++character)
+                    m_owners.erase(character->guid);
+
+                for (CharacterList::const_iterator character = characters.begin(); character != characters.end(); ++character)
+                    m_owners[character->guid] = accountId;
+
+                account.characters.swap(characters);
+                account.loaded = true;
+            }
+        }
+    }
+
+    if (again)
+    {
+        again->Start();
+        return;
+    }
+
+    // outside the lock, a login abandoned meanwhile releases its reference when it is deleted
+    for (std::vector<SocketConnectorAuthRequest*>::const_iterator itr = waiters.begin(); itr != waiters.end(); ++itr)
+        (*itr)->CharactersLoaded();
+}
+
+void SocketConnectorCharacters::GetCharacters(uint32 accountId, CharacterList& characters) const
+{
+    ACE_READ_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+    AccountMap::const_iterator itr = m_accounts.find(accountId);
+    if (itr != m_accounts.end() && itr->second.loaded)
+        characters = itr->second.characters;
+}
+
+bool SocketConnectorCharacters::FindCharacter(uint32 accountId, std::string const& name, CharacterInfo& info) const
+{
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, m_lock, false);
+
+    AccountMap::const_iterator account = m_accounts.find(accountId);
+    if (account == m_accounts.end())
+        return false;
+
+    for (CharacterList::const_iterator itr = account->second.characters.begin(); itr != account->second.characters.end(); ++itr)
+    {
+        if (itr->name == name)
+        {
+            info = *itr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool SocketConnectorCharacters::FindCharacter(uint32 accountId, uint64 guid, CharacterInfo& info) const
+{
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, m_lock, false);
+
+    OwnerMap::const_iterator owner = m_owners.find(guid);
+    if (owner == m_owners.end() || owner->second != accountId)
+        return false;
+
+    AccountMap::const_iterator account = m_accounts.find(accountId);
+    if (account == m_accounts.end())
+        return false;
+
+    for (CharacterList::const_iterator itr = account->second.characters.begin(); itr != account->second.characters.end(); ++itr)
+    {
+        if (itr->guid == guid)
+        {
+            info = *itr;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SocketConnectorCharacters::InvalidateAccount(uint32 accountId)
+{
+    SocketConnectorCharacterLoad* load;
+    {
+        ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+        // accounts without web sessions are loaded fresh at login
+        AccountMap::iterator itr = m_accounts.find(accountId);
+        if (itr == m_accounts.end())
+            return;
+
+        Account& account = itr->second;
+        ++account.generation;
+
+        if (account.loading)
+            return;
+
+        account.loading = true;
+        ++m_loading;
+        load = new SocketConnectorCharacterLoad(accountId, account.generation);
+    }
+
+    load->Start();
+}
+
+void SocketConnectorCharacters::SetGuild(uint64 playerGuid, uint32 guildId)
+{
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+    // the owner of the character may be among the accounts being loaded
+    if (m_loading)
+        m_loadingGuilds[playerGuid] = guildId;
+
+    OwnerMap::const_iterator owner = m_owners.find(playerGuid);
+    if (owner == m_owners.end())
+        return;
+
+    AccountMap::iterator account = m_accounts.find(owner->second);
+    if (account == m_accounts.end())
+        return;
+
+    CharacterList& characters = account->second.characters;
+    for (CharacterList::iterator itr = characters.begin(); itr != characters.end(); ++itr)
+        if (itr->guid == playerGuid)
+            itr->guildId = guildId;
+}
+
+void SocketConnectorCharacters::DisbandGuild(uint32 guildId)
+{
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+    if (m_loading)
+        m_loadingDisbands.push_back(guildId);
+
+    for (AccountMap::iterator account = m_accounts.begin(); account != m_accounts.end(); ++account)
+        for (CharacterList::iterator itr = account->second.characters.begin(); itr != account->second.characters.end(); ++itr)
+            if (itr->guildId == guildId)
+                itr->guildId = 0;
+}
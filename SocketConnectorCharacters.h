@@ -0,0 +1,115 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorCharacters_H
+#define _SocketConnectorCharacters_H
+
+#include "Common.h"
+#include "UnorderedMap.h"
+#include "DatabaseEnv.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/RW_Thread_Mutex.h>
+#include <vector>
+
+class SocketConnectorAuthRequest;
+
+/// Characters of accounts with web chat sessions.
+/// The first login of an account loads them with one joined query on the
+/// character database workers, before the login resumes on its reactor; later
+/// logins and the character selection are answered from memory. Sessions and
+/// resume tokens hold a reference, the account is dropped with the last one.
+/// The character and guild code report changes, a change to the characters of
+/// an account while its query runs makes the query run again.
+class SocketConnectorCharacters
+{
+    friend class ACE_Singleton<SocketConnectorCharacters, ACE_Null_Mutex>;
+    friend class SocketConnectorCharacterLoad;
+
+    public:
+        struct CharacterInfo
+        {
+            uint64 guid;
+            std::string name;
+            uint8 race;
+            uint32 guildId;
+        };
+
+        typedef std::vector<CharacterInfo> CharacterList;
+
+        /// Takes a reference for a login, a session or a resume token. Returns true if the characters
+        /// are cached, otherwise one query serves every waiting login and request->CharactersLoaded()
+        /// is called from a database worker once it is done (request may be NULL).
+        bool Acquire(uint32 accountId, SocketConnectorAuthRequest* request);
+        void Release(uint32 accountId);
+
+        /// From memory only, empty while the account is not loaded
+        void GetCharacters(uint32 accountId, CharacterList& characters) const;
+        /// name as returned by normalizePlayerName
+        bool FindCharacter(uint32 accountId, std::string const& name, CharacterInfo& info) const;
+        /// False if the character was deleted or does not belong to the account anymore
+        bool FindCharacter(uint32 accountId, uint64 guid, CharacterInfo& info) const;
+
+        /// Hooks for the character code: create, delete, rename, race/faction change, account transfer
+        void InvalidateAccount(uint32 accountId);
+        /// Guild changes, see SocketConnectorRegistry::SetGuild
+        void SetGuild(uint64 playerGuid, uint32 guildId);
+        void DisbandGuild(uint32 guildId);
+
+    private:
+        SocketConnectorCharacters() : m_loading(0) { }
+        ~SocketConnectorCharacters() { }
+
+        struct Account
+        {
+            Account() : references(0), generation(0), loaded(false), loading(false) { }
+
+            CharacterList characters;
+            uint32 references;
+            uint32 generation;                              // bumped by InvalidateAccount, a query that raced it runs again
+            bool loaded;
+            bool loading;
+            std::vector<SocketConnectorAuthRequest*> waiters;
+        };
+
+        typedef UNORDERED_MAP<uint32, Account> AccountMap;
+        typedef UNORDERED_MAP<uint64, uint32> OwnerMap;
+        typedef UNORDERED_MAP<uint64, uint32> GuildMap;
+
+        /// Called by the database worker that completed the query
+        void Loaded(uint32 accountId, uint32 generation, PreparedQueryResult result);
+        void EraseLocked(AccountMap::iterator itr);
+
+        mutable ACE_RW_Thread_Mutex m_lock;
+        AccountMap m_accounts;
+        OwnerMap m_owners;                                  // character guid -> account of cached characters
+
+        /// Guild changes made while queries run, applied to the rows they return
+        uint32 m_loading;
+        GuildMap m_loadingGuilds;
+        std::vector<uint32> m_loadingDisbands;
+};
+
+#define sSocketConnectorCharacters ACE_Singleton<SocketConnectorCharacters, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
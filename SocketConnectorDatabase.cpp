@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "SocketConnectorDatabase.h"
+
+bool SocketConnectorDatabase::s_enabled = false;
+LoginDatabaseWorkerPool SocketConnectorDatabase::s_login;
+CharacterDatabaseWorkerPool SocketConnectorDatabase::s_character;
+
+/// The replica is preferred, then the connector's own primary, then the game's
+static std::string GetInfoString(const char* name, const char* gameName)
+{
+    std::string key = std::string("SocketConnector.") + name;
+
+    std::string dbstring = ConfigMgr::GetStringDefault((key + ".ReplicaInfo").c_str(), "");
+    if (dbstring.empty())
+        dbstring = ConfigMgr::GetStringDefault((key + "Info").c_str(), "");
+    if (dbstring.empty())
+        dbstring = ConfigMgr::GetStringDefault(gameName, "");
+
+    return dbstring;
+}
+
+bool SocketConnectorDatabase::Open()
+{
+    if (!ConfigMgr::GetBoolDefault("SocketConnector.Enable", false) ||
+        !ConfigMgr::GetBoolDefault("SocketConnector.Database.Enable", false))
+        return true;
+
+    std::string dbstring = GetInfoString("LoginDatabase", "LoginDatabaseInfo");
+
+    uint8 async_threads = ConfigMgr::GetIntDefault("SocketConnector.LoginDatabase.WorkerThreads", 1);
+    if (async_threads < 1 || async_threads > 32)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector login database: invalid number of worker threads specified. "
+            "Please pick a value between 1 and 32.");
+        return false;
+    }
+
+    // the auth pipeline only queries asynchronously
+    uint8 synch_threads = ConfigMgr::GetIntDefault("SocketConnector.LoginDatabase.SynchThreads", 1);
+    if (!s_login.Open(dbstring, async_threads, synch_threads))
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "Cannot connect to SocketConnector login database %s", dbstring.c_str());
+        return false;
+    }
+
+    dbstring = GetInfoString("CharacterDatabase", "CharacterDatabaseInfo");
+
+    async_threads = ConfigMgr::GetIntDefault("SocketConnector.CharacterDatabase.WorkerThreads", 1);
+    if (async_threads < 1 || async_threads > 32)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector character database: invalid number of worker threads specified. "
+            "Please pick a value between 1 and 32.");
+        s_login.Close();
+        return false;
+    }
+
+    // character lists are queried asynchronously by the auth pipeline as well
+    synch_threads = ConfigMgr::GetIntDefault("SocketConnector.CharacterDatabase.SynchThreads", 1);
+    if (!s_character.Open(dbstring, async_threads, synch_threads))
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "Cannot connect to SocketConnector character database %s", dbstring.c_str());
+        s_login.Close();
+        return false;
+    }
+
+    s_enabled = true;
+    sLog->outInfo(LOG_FILTER_WORLDSERVER, "SocketConnector uses database pools of its own");
+    return true;
+}
+
+void SocketConnectorDatabase::Close()
+{
+    if (!s_enabled)
+        return;
+
+    s_enabled = false;
+    s_character.Close();
+    s_login.Close();
+}
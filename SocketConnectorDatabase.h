@@ -0,0 +1,50 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorDatabase_H
+#define _SocketConnectorDatabase_H
+
+#include "Common.h"
+#include "DatabaseEnv.h"
+
+/// Database connections of the web chat connector.
+/// With SocketConnector.Database.Enable the login lookup and the character lists run
+/// on pools of their own, so a web login storm and the game do not wait for each other.
+/// Every connector query only reads, a pool may point at a read replica.
+/// Without it the connector shares the game's LoginDatabase and CharacterDatabase.
+class SocketConnectorDatabase
+{
+    public:
+        /// Called from Master::_StartDB once the game pools are open
+        static bool Open();
+        static void Close();
+
+        static LoginDatabaseWorkerPool& Login() { return s_enabled ? s_login : LoginDatabase; }
+        static CharacterDatabaseWorkerPool& Character() { return s_enabled ? s_character : CharacterDatabase; }
+
+    private:
+        static bool s_enabled;
+        static LoginDatabaseWorkerPool s_login;
+        static CharacterDatabaseWorkerPool s_character;
+};
+
+#endif
+/// @}
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "SocketConnectorEventBus.h"
+#include "SocketConnector.h"
+#include "SocketConnectorRegistry.h"
+#include "SocketConnectorFanout.h"
+
+#include <ace/OS_NS_sys_time.h>
+
+#define EVENT_BUS_IDLE_WAIT 100000                          // microseconds the bus thread sleeps without a wakeup
+
+SocketConnectorEventBus::SocketConnectorEventBus() : m_wakeup(0), m_sleeping(0), m_pending(0),
+    m_maxPending(16384), m_running(false)
+{
+}
+
+SocketConnectorEventBus::~SocketConnectorEventBus()
+{
+    Event* last = NULL;
+    Event* event = m_posted.TakeAll(last);
+    while (event)
+    {
+        Event* next = event->next;
+        delete event;
+        event = next;
+    }
+}
+
+void SocketConnectorEventBus::LoadConfig()
+{
+    m_maxPending = ConfigMgr::GetIntDefault("SocketConnector.EventBus.MaxPending", 16384);
+    if (m_maxPending < 256)
+        m_maxPending = 256;
+}
+
+bool SocketConnectorEventBus::Start()
+{
+    m_running = true;
+
+    if (activate(THR_NEW_LWP | THR_JOINABLE, 1) == -1)
+    {
+        m_running = false;
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorEventBus: can not start the bus thread");
+        return false;
+    }
+
+    return true;
+}
+
+void SocketConnectorEventBus::Stop()
+{
+    m_running = false;
+    m_wakeup.release();
+    wait();
+}
+
+void SocketConnectorEventBus::Publish(EventType type, uint64 senderGuid, std::string const& senderName, uint32 lang,
+    uint32 guildId, std::string const& target, std::string const& message, bool fromWeb)
+{
+    if (!m_running)
+        return;
+
+    // the world thread never waits for the web, a backlog loses lines instead
+    if (++m_pending > m_maxPending)
+    {
+        --m_pending;
+        ++m_dropped;
+        return;
+    }
+
+    m_posted.Push(new Event(type, senderGuid, senderName, lang, guildId, target, message, fromWeb));
+    ++m_published;
+
+    // the push is a full barrier, a bus thread going to sleep sees either the event or this flag
+    if (m_sleeping.value())
+        m_wakeup.release();
+}
+
+int SocketConnectorEventBus::svc()
+{
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector event bus thread started");
+
+    while (m_running || !m_posted.IsEmpty())
+    {
+        Event* last = NULL;
+        Event* event = m_posted.TakeAll(last);
+
+        if (!event)
+        {
+            m_sleeping = 1;
+
+            if (m_running && m_posted.IsEmpty())
+            {
+                ACE_Time_Value timeout = ACE_OS::gettimeofday() + ACE_Time_Value(0, EVENT_BUS_IDLE_WAIT);
+                m_wakeup.acquire(timeout);
+            }
+
+            m_sleeping = 0;
+            continue;
+        }
+
+        while (event)
+        {
+            Event* next = event->next;
+
+            Dispatch(*event);
+
+            delete event;
+            --m_pending;
+            event = next;
+        }
+    }
+
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector event bus thread exiting");
+    return 0;
+}
+
+void SocketConnectorEventBus::Dispatch(Event const& event)
+{
+    switch (event.type)
+    {
+        case EVENT_LFG:
+            DispatchLFG(event);
+            break;
+        case EVENT_GUILD:
+            DispatchGuild(event);
+            break;
+        case EVENT_WHISPER:
+            DispatchWhisper(event);
+            break;
+    }
+}
+
+void SocketConnectorEventBus::DispatchLFG(Event const& event)
+{
+    SocketConnectorRegistry::ReadGuard connections;
+    uint32 audience = SocketConnectorRegistry::GetLFGAudience(event.lang);
+
+    SocketConnectorRegistry::ConnectionList const* lists[MAX_CONNECTOR_FACTIONS];
+    size_t count = 0;
+    for (uint8 faction = 0; faction < MAX_CONNECTOR_FACTIONS; ++faction)
+        if (audience & (1 << faction))
+            lists[count++] = &connections->lfg[faction];
+
+    ACE_Data_Block* frame = SocketConnector::BuildFrame('m', event.senderName, event.message);
+    sSocketConnectorFanout->Broadcast(frame, lists, count, event.fromWeb ? event.senderGuid : 0);
+    frame->release();
+}
+
+void SocketConnectorEventBus::DispatchGuild(Event const& event)
+{
+    SocketConnectorRegistry::ReadGuard connections;
+    SocketConnectorRegistry::ConnectionList const* members = connections.FindGuildMembers(event.guildId);
+    if (!members)
+        return;
+
+    ACE_Data_Block* frame = SocketConnector::BuildFrame('g', event.senderName, event.message);
+    sSocketConnectorFanout->Broadcast(frame, *members, event.fromWeb ? event.senderGuid : 0);
+    frame->release();
+}
+
+void SocketConnectorEventBus::DispatchWhisper(Event const& event)
+{
+    // the publisher already checked faction and language; the receiver may have left since
+    SocketConnectorRegistry::ReadGuard connections;
+    SocketConnector* receiver = connections.FindByName(event.target);
+    if (!receiver)
+        return;
+
+    ACE_Data_Block* frame = SocketConnector::BuildFrame('w', event.senderName, event.message);
+    receiver->sendFrame(frame);
+    frame->release();
+}
@@ -0,0 +1,112 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorEventBus_H
+#define _SocketConnectorEventBus_H
+
+#include "Common.h"
+#include "SocketConnectorPostStack.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Thread_Semaphore.h>
+#include <ace/Atomic_Op.h>
+#include <ace/Task.h>
+
+/// Game chat on its way to the web sessions.
+/// The chat hooks publish one immutable event per line, a single lock-free push
+/// on the world thread; the bus thread resolves the recipients in the registry and
+/// queues the frames. Nothing in the game waits for a web client.
+class SocketConnectorEventBus : public ACE_Task_Base
+{
+    friend class ACE_Singleton<SocketConnectorEventBus, ACE_Null_Mutex>;
+
+    public:
+        enum EventType
+        {
+            EVENT_LFG,
+            EVENT_GUILD,
+            EVENT_WHISPER
+        };
+
+        /// Built by the publisher, read only afterwards
+        struct Event
+        {
+            Event(EventType type, uint64 senderGuid, std::string const& senderName, uint32 lang,
+                uint32 guildId, std::string const& target, std::string const& message, bool fromWeb) :
+                type(type), senderGuid(senderGuid), senderName(senderName), lang(lang), guildId(guildId),
+                target(target), message(message), fromWeb(fromWeb), next(NULL) { }
+
+            EventType const type;
+            uint64 const senderGuid;
+            std::string const senderName;
+            uint32 const lang;
+            uint32 const guildId;                           // guild: recipients
+            std::string const target;                       // whisper: receiver name, LFG: channel name
+            std::string const message;
+            bool const fromWeb;                             // the sender's own session gets no echo
+            Event* next;                                    // bus link
+        };
+
+        /// Reads SocketConnector.EventBus.* settings
+        void LoadConfig();
+
+        bool Start();
+        void Stop();
+
+        /// Any thread. Never blocks; the event is dropped if the bus is full or not running.
+        void Publish(EventType type, uint64 senderGuid, std::string const& senderName, uint32 lang,
+            uint32 guildId, std::string const& target, std::string const& message, bool fromWeb = false);
+
+        virtual int svc();
+
+        uint32 GetPending() const { return uint32(m_pending.value()); }
+        uint32 GetPublished() const { return m_published.value(); }
+        uint32 GetDropped() const { return m_dropped.value(); }
+
+    private:
+        SocketConnectorEventBus();
+        ~SocketConnectorEventBus();
+
+        void Dispatch(Event const& event);
+        void DispatchLFG(Event const& event);
+        void DispatchGuild(Event const& event);
+        void DispatchWhisper(Event const& event);
+
+        SocketConnectorPostStack<Event> m_posted;
+
+        /// Released by a publisher only while the bus thread sleeps
+        ACE_Thread_Semaphore m_wakeup;
+        ACE_Atomic_Op<ACE_Thread_Mutex, long> m_sleeping;
+
+        ACE_Atomic_Op<ACE_Thread_Mutex, long> m_pending;
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_published;
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_dropped;
+
+        long m_maxPending;
+        volatile bool m_running;
+};
+
+#define sSocketConnectorEventBus ACE_Singleton<SocketConnectorEventBus, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
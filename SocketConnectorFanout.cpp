@@ -0,0 +1,228 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "SocketConnectorFanout.h"
+#include "SocketConnector.h"
+
+#include <ace/OS_NS_sys_time.h>
+
+#define FANOUT_CHUNK_SIZE 128                               // recipients per unit of work, what a steal moves
+
+SocketConnectorFanout::SocketConnectorFanout() : m_work(0), m_nextWorker(0), m_threads(0), m_threshold(512),
+    m_shards(1), m_running(false)
+{
+}
+
+void SocketConnectorFanout::LoadConfig()
+{
+    m_threads = ConfigMgr::GetIntDefault("SocketConnector.Fanout.Threads", 2);
+    m_threshold = ConfigMgr::GetIntDefault("SocketConnector.Fanout.Threshold", 512);
+    if (m_threshold < FANOUT_CHUNK_SIZE * 2)
+        m_threshold = FANOUT_CHUNK_SIZE * 2;
+}
+
+bool SocketConnectorFanout::Start(uint32 shards)
+{
+    m_shards = shards ? shards : 1;
+
+    // no workers, every broadcast stays on the calling thread
+    if (!m_threads)
+        return true;
+
+    for (uint32 i = 0; i < m_threads; ++i)
+        m_workers.push_back(new Worker());
+
+    m_running = true;
+
+    if (activate(THR_NEW_LWP | THR_JOINABLE, int(m_threads)) == -1)
+    {
+        m_running = false;
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorFanout: can not start %u fan-out worker threads", m_threads);
+        return false;
+    }
+
+    return true;
+}
+
+void SocketConnectorFanout::Stop()
+{
+    if (m_running)
+    {
+        m_running = false;
+        m_work.release(m_threads);
+        wait();
+    }
+
+    for (size_t i = 0; i < m_workers.size(); ++i)
+        delete m_workers[i];
+
+    m_workers.clear();
+}
+
+void SocketConnectorFanout::Broadcast(ACE_Data_Block* frame, SocketConnectorRegistry::ConnectionList const* const* lists, size_t count,
+    uint64 excludeGuid, bool v2Only)
+{
+    Job job(frame, excludeGuid, v2Only);
+
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i)
+        total += lists[i]->size();
+
+    if (!m_running || total < m_threshold)
+    {
+        for (size_t i = 0; i < count; ++i)
+            if (!lists[i]->empty())
+                Send(job, &(*lists[i])[0], &(*lists[i])[0] + lists[i]->size());
+        return;
+    }
+
+    ACE_Time_Value start = ACE_OS::gettimeofday();
+
+    job.buckets.resize(m_shards);
+    for (size_t i = 0; i < count; ++i)
+    {
+        SocketConnectorRegistry::ConnectionList::const_iterator iterator;
+        for (iterator = lists[i]->begin(); iterator != lists[i]->end(); ++iterator)
+            job.buckets[(*iterator)->GetShardIndex() % m_shards].push_back(*iterator);
+    }
+
+    // every chunk is counted before the first one can finish
+    long chunks = 0;
+    for (size_t s = 0; s < job.buckets.size(); ++s)
+        chunks += long((job.buckets[s].size() + FANOUT_CHUNK_SIZE - 1) / FANOUT_CHUNK_SIZE);
+
+    job.remaining = chunks;
+
+    for (size_t s = 0; s < job.buckets.size(); ++s)
+    {
+        SocketConnectorRegistry::ConnectionList const& bucket = job.buckets[s];
+        if (bucket.empty())
+            continue;
+
+        Worker* worker = m_workers[s % m_workers.size()];
+        ACE_GUARD(ACE_Thread_Mutex, guard, worker->lock);
+
+        for (size_t offset = 0; offset < bucket.size(); offset += FANOUT_CHUNK_SIZE)
+        {
+            Chunk chunk;
+            chunk.job = &job;
+            chunk.begin = &bucket[0] + offset;
+            chunk.end = &bucket[0] + std::min(offset + FANOUT_CHUNK_SIZE, bucket.size());
+            worker->chunks.push_back(chunk);
+        }
+    }
+
+    m_work.release(uint32(chunks));
+
+    // the caller steals along instead of idling until the workers are done
+    Chunk chunk;
+    while (Take(uint32(m_workers.size()), chunk))
+        Run(chunk);
+
+    job.done.acquire();
+
+    ACE_Time_Value elapsed = ACE_OS::gettimeofday() - start;
+    m_parallelTime += uint64(elapsed.sec()) * 1000000 + elapsed.usec();
+    ++m_parallelBroadcasts;
+}
+
+void SocketConnectorFanout::Send(Job const& job, SocketConnector* const* begin, SocketConnector* const* end)
+{
+    for (SocketConnector* const* itr = begin; itr != end; ++itr)
+    {
+        SocketConnector* conn = *itr;
+
+        if (job.excludeGuid && conn->playerGuid == job.excludeGuid)
+            continue;
+
+        if (job.v2Only && !conn->UsesProtocolV2())
+            continue;
+
+        conn->sendFrame(job.frame);
+    }
+}
+
+bool SocketConnectorFanout::Take(uint32 home, Chunk& chunk)
+{
+    if (home < m_workers.size())
+    {
+        Worker* worker = m_workers[home];
+        ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, worker->lock, false);
+
+        if (!worker->chunks.empty())
+        {
+            chunk = worker->chunks.front();
+            worker->chunks.pop_front();
+            return true;
+        }
+    }
+
+    for (size_t i = 1; i <= m_workers.size(); ++i)
+    {
+        size_t victim = (home + i) % m_workers.size();
+        if (victim == home)
+            continue;
+
+        Worker* worker = m_workers[victim];
+        ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, worker->lock, false);
+
+        if (!worker->chunks.empty())
+        {
+            chunk = worker->chunks.back();
+            worker->chunks.pop_back();
+            ++m_steals;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void SocketConnectorFanout::Run(Chunk const& chunk)
+{
+    Send(*chunk.job, chunk.begin, chunk.end);
+
+    // the caller may return once the last chunk is released, the job must not be touched after it
+    if (--chunk.job->remaining == 0)
+        chunk.job->done.release();
+}
+
+int SocketConnectorFanout::svc()
+{
+    uint32 home = m_nextWorker++;
+
+    for (;;)
+    {
+        m_work.acquire();
+        if (!m_running)
+            break;
+
+        // the chunk of this release may already be taken by a stealer
+        Chunk chunk;
+        if (Take(home, chunk))
+            Run(chunk);
+    }
+
+    return 0;
+}
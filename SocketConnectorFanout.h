@@ -0,0 +1,130 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorFanout_H
+#define _SocketConnectorFanout_H
+
+#include "Common.h"
+#include "SocketConnectorRegistry.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Thread_Semaphore.h>
+#include <ace/Atomic_Op.h>
+#include <ace/Task.h>
+
+#include <deque>
+
+class ACE_Data_Block;
+
+/// Worker pool for broadcasts with many recipients.
+/// Recipients are bucketed by connection shard and cut into chunks; each shard's
+/// chunks go to the deque of one worker, and a worker that runs dry steals from
+/// the back of the others, so a shard with slow queues does not hold the rest.
+/// The caller works along and returns once every chunk is done, which keeps its
+/// registry read section valid for the workers. Small broadcasts stay inline.
+class SocketConnectorFanout : public ACE_Task_Base
+{
+    friend class ACE_Singleton<SocketConnectorFanout, ACE_Null_Mutex>;
+
+    public:
+        /// Reads SocketConnector.Fanout.* settings
+        void LoadConfig();
+
+        bool Start(uint32 shards);
+        void Stop();
+
+        /// Queues the frame on every recipient in the lists, skipping the session of
+        /// excludeGuid (0 for none) and, with v2Only, legacy clients. The caller holds
+        /// a SocketConnectorRegistry::ReadGuard that covers the lists and its frame reference.
+        void Broadcast(ACE_Data_Block* frame, SocketConnectorRegistry::ConnectionList const* const* lists, size_t count,
+            uint64 excludeGuid = 0, bool v2Only = false);
+        void Broadcast(ACE_Data_Block* frame, SocketConnectorRegistry::ConnectionList const& list,
+            uint64 excludeGuid = 0, bool v2Only = false)
+        {
+            SocketConnectorRegistry::ConnectionList const* lists[1] = { &list };
+            Broadcast(frame, lists, 1, excludeGuid, v2Only);
+        }
+
+        virtual int svc();
+
+        uint32 GetParallelBroadcasts() const { return m_parallelBroadcasts.value(); }
+        uint32 GetSteals() const { return m_steals.value(); }
+        /// Microseconds from the first enqueue to the last chunk of parallel broadcasts
+        uint64 GetParallelTime() const { return m_parallelTime.value(); }
+
+    private:
+        SocketConnectorFanout();
+        ~SocketConnectorFanout() { }
+
+        /// One broadcast split over the pool, lives on the caller's stack
+        struct Job
+        {
+            Job(ACE_Data_Block* frame, uint64 excludeGuid, bool v2Only) :
+                frame(frame), excludeGuid(excludeGuid), v2Only(v2Only), remaining(0), done(0) { }
+
+            ACE_Data_Block* frame;
+            uint64 excludeGuid;
+            bool v2Only;
+            std::vector<SocketConnectorRegistry::ConnectionList> buckets;   // by shard
+            ACE_Atomic_Op<ACE_Thread_Mutex, long> remaining;                // chunks not yet sent
+            ACE_Thread_Semaphore done;                                      // released by the last chunk
+        };
+
+        struct Chunk
+        {
+            Job* job;
+            SocketConnector* const* begin;
+            SocketConnector* const* end;
+        };
+
+        typedef std::deque<Chunk> ChunkQueue;
+
+        struct Worker
+        {
+            ACE_Thread_Mutex lock;
+            ChunkQueue chunks;
+        };
+
+        static void Send(Job const& job, SocketConnector* const* begin, SocketConnector* const* end);
+        /// Own deque first, then the back of the others; home past the last worker only steals
+        bool Take(uint32 home, Chunk& chunk);
+        void Run(Chunk const& chunk);
+
+        std::vector<Worker*> m_workers;
+        ACE_Thread_Semaphore m_work;                        // one release per queued chunk
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_nextWorker;
+
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_parallelBroadcasts;
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_steals;
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint64> m_parallelTime;
+
+        uint32 m_threads;
+        uint32 m_threshold;
+        uint32 m_shards;
+        volatile bool m_running;
+};
+
+#define sSocketConnectorFanout ACE_Singleton<SocketConnectorFanout, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
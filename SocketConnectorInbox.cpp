@@ -0,0 +1,297 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "SocketConnectorInbox.h"
+#include "SocketConnector.h"
+#include "SocketConnectorRegistry.h"
+#include "SocketConnectorChannels.h"
+#include "SocketConnectorProtocol.h"
+#include "SocketConnectorEventBus.h"
+#include "Channel.h"
+#include "GuildMgr.h"
+#include "ObjectAccessor.h"
+#include "World.h"
+
+#include <ace/OS_NS_sys_time.h>
+
+#define INBOX_CLOCK_STRIDE 16                               // requests delivered between two clock reads
+
+SocketConnectorInbox::SocketConnectorInbox() : m_head(NULL), m_tail(NULL), m_pending(0),
+    m_maxPending(4096), m_tickBudget(0, 2000)
+{
+}
+
+SocketConnectorInbox::~SocketConnectorInbox()
+{
+    TakePosted();
+
+    while (m_head)
+    {
+        Request* request = m_head;
+        m_head = request->next;
+        delete request;
+    }
+}
+
+void SocketConnectorInbox::LoadConfig()
+{
+    m_maxPending = ConfigMgr::GetIntDefault("SocketConnector.Inbox.MaxPending", 4096);
+    if (m_maxPending < 64)
+        m_maxPending = 64;
+
+    // microseconds of every world tick the web chat may take, what is left waits for the next one
+    uint32 budget = ConfigMgr::GetIntDefault("SocketConnector.Inbox.TickBudgetUs", 2000);
+    m_tickBudget.set(0, 0);
+    m_tickBudget.usec(budget < 100 ? 100 : budget);
+}
+
+bool SocketConnectorInbox::Post(Request* request)
+{
+    // a flood from the web is refused here instead of piling up for the world thread
+    if (++m_pending > m_maxPending)
+    {
+        --m_pending;
+        ++m_rejected;
+        delete request;
+        return false;
+    }
+
+    m_posted.Push(request);
+    return true;
+}
+
+void SocketConnectorInbox::TakePosted()
+{
+    Request* last = NULL;
+    Request* first = m_posted.TakeAll(last);
+    if (!first)
+        return;
+
+    // behind what was left over by the last budget
+    if (m_tail)
+        m_tail->next = first;
+    else
+        m_head = first;
+
+    m_tail = last;
+}
+
+void SocketConnectorInbox::Update()
+{
+    TakePosted();
+
+    if (!m_head)
+        return;
+
+    ACE_Time_Value deadline = ACE_OS::gettimeofday() + m_tickBudget;
+    Batch batch;
+
+    for (uint32 delivered = 0; m_head; ++delivered)
+    {
+        if (delivered && delivered % INBOX_CLOCK_STRIDE == 0 && ACE_OS::gettimeofday() >= deadline)
+        {
+            ++m_deferredTicks;
+            break;
+        }
+
+        Request* request = m_head;
+        m_head = request->next;
+        if (!m_head)
+            m_tail = NULL;
+
+        Deliver(*request, batch);
+
+        delete request;
+        --m_pending;
+    }
+}
+
+void SocketConnectorInbox::Deliver(Request const& request, Batch& batch)
+{
+    uint8 status = V2_ACK_UNDELIVERED;
+
+    switch (request.type)
+    {
+        case REQUEST_LFG:
+            status = DeliverLFG(request, batch);
+            break;
+        case REQUEST_GUILD:
+            status = DeliverGuild(request, batch);
+            break;
+        case REQUEST_WHISPER:
+            status = DeliverWhisper(request, batch);
+            break;
+    }
+
+    Acknowledge(request, status);
+}
+
+uint8 SocketConnectorInbox::DeliverLFG(Request const& request, Batch& batch)
+{
+    uint32 team = request.faction == 0 ? ALLIANCE : HORDE;
+
+    Channel* ch = batch.GetLFG(team);
+    if (!ch)
+        return V2_ACK_UNDELIVERED;
+
+    uint32 messageLength = strlen(request.message.c_str()) + 1;
+    uint32 lang = request.faction == 0 ? LANG_COMMON : LANG_ORCISH;
+
+    WorldPacket data(SMSG_MESSAGECHAT, 1+4+8+4+(ch->GetName()).size()+1+8+4+messageLength+1);
+    data << (uint8)CHAT_MSG_CHANNEL;
+    data << lang;
+    data << request.senderGuid;
+    data << uint32(0);
+    data << ch->GetName();
+    data << request.senderGuid;
+    data << messageLength;
+    data << request.message.c_str();
+    data << uint8(0);
+
+    ch->SendToAll(&data, false);
+
+    sSocketConnectorEventBus->Publish(SocketConnectorEventBus::EVENT_LFG, request.senderGuid, request.senderName,
+        lang, 0, ch->GetName(), request.message, true);
+
+    return V2_ACK_OK;
+}
+
+uint8 SocketConnectorInbox::DeliverGuild(Request const& request, Batch& batch)
+{
+    Guild* guild = batch.GetGuild(request.guildId);
+    if (!guild)
+        return V2_ACK_UNDELIVERED;
+
+    WorldPacket data(SMSG_MESSAGECHAT, 200);
+    data << (uint8)CHAT_MSG_GUILD;
+    data << LANG_UNIVERSAL;
+    data << request.senderGuid;
+    data << uint32(0);
+    data << request.senderGuid;
+    data << (strlen(request.message.c_str()) + 1);
+    data << request.message.c_str();
+    data << uint8(0);
+
+    guild->BroadcastPacket(&data);
+
+    sSocketConnectorEventBus->Publish(SocketConnectorEventBus::EVENT_GUILD, request.senderGuid, request.senderName,
+        LANG_UNIVERSAL, request.guildId, "", request.message, true);
+
+    return V2_ACK_OK;
+}
+
+uint8 SocketConnectorInbox::DeliverWhisper(Request const& request, Batch& batch)
+{
+    bool twoSided = sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT);
+
+    if (Player* player = batch.GetPlayer(request.receiver))
+    {
+        uint8 r = player->getRace();
+        uint8 receiverFaction = r != 1 && r != 3 && r != 4 && r != 7 && r != 11;
+
+        if (!twoSided && request.faction != receiverFaction)
+            return V2_ACK_UNDELIVERED;
+
+        WorldPacket data(SMSG_MESSAGECHAT, 200);
+        data << uint8(CHAT_MSG_WHISPER);
+        data << uint32(LANG_UNIVERSAL);
+        data << uint64(request.senderGuid);
+        data << uint32(LANG_UNIVERSAL);
+        data << uint64(request.senderGuid);
+        data << uint32(request.message.length() + 1);
+        data << request.message;
+        data << uint8(0);
+        player->GetSession()->SendPacket(&data);
+        return V2_ACK_OK;
+    }
+
+    SocketConnectorRegistry::ReadGuard connections;
+    SocketConnector* receiver = connections.FindByName(request.receiver);
+
+    if (!receiver)
+        return V2_ACK_UNDELIVERED;
+
+    if (receiver->playerFaction != request.faction && !twoSided)
+        return V2_ACK_UNDELIVERED;
+
+    sSocketConnectorEventBus->Publish(SocketConnectorEventBus::EVENT_WHISPER, request.senderGuid, request.senderName,
+        LANG_UNIVERSAL, 0, request.receiver, request.message, true);
+
+    return V2_ACK_OK;
+}
+
+void SocketConnectorInbox::Acknowledge(Request const& request, uint8 status)
+{
+    if (!request.ack)
+        return;
+
+    // the id only means something to the connection that sent it, a session that dropped meanwhile gets none
+    SocketConnectorRegistry::ReadGuard connections;
+    if (SocketConnector* conn = connections.FindSession(request.senderGuid, request.senderSerial))
+        conn->SendAck(request.ackId, status);
+}
+
+SocketConnectorInbox::Batch::Batch()
+{
+    for (uint8 i = 0; i < MAX_INBOX_TEAMS; ++i)
+    {
+        lfg[i] = NULL;
+        lfgResolved[i] = false;
+    }
+}
+
+Channel* SocketConnectorInbox::Batch::GetLFG(uint32 team)
+{
+    uint8 index = team == HORDE ? 1 : 0;
+    if (!lfgResolved[index])
+    {
+        lfg[index] = sSocketConnectorChannels->GetLFG(team);
+        lfgResolved[index] = true;
+    }
+
+    return lfg[index];
+}
+
+Guild* SocketConnectorInbox::Batch::GetGuild(uint32 guildId)
+{
+    UNORDERED_MAP<uint32, Guild*>::const_iterator itr = guilds.find(guildId);
+    if (itr != guilds.end())
+        return itr->second;
+
+    Guild* guild = sGuildMgr->GetGuildById(guildId);
+    guilds[guildId] = guild;
+    return guild;
+}
+
+Player* SocketConnectorInbox::Batch::GetPlayer(std::string const& name)
+{
+    // players only log out between two world updates, a drain may keep the pointers
+    UNORDERED_MAP<std::string, Player*>::const_iterator itr = players.find(name);
+    if (itr != players.end())
+        return itr->second;
+
+    Player* player = sObjectAccessor->FindPlayerByName(name.c_str());
+    players[name] = player;
+    return player;
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorInbox_H
+#define _SocketConnectorInbox_H
+
+#include "Common.h"
+#include "UnorderedMap.h"
+#include "SocketConnectorPostStack.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Atomic_Op.h>
+#include <ace/Time_Value.h>
+
+class Channel;
+class Guild;
+class Player;
+
+#define MAX_INBOX_TEAMS 2                                   // alliance, horde LFG channels
+
+/// Chat lines of web sessions that have to reach the game.
+/// Connector threads push requests onto a lock-free multi producer stack; the
+/// world thread takes the whole stack in World::Update and delivers it in FIFO
+/// order within a time budget, leaving the rest for the next tick. Channels,
+/// guilds and players are looked up once per drain, and nothing from a
+/// connector thread touches game objects.
+class SocketConnectorInbox
+{
+    friend class ACE_Singleton<SocketConnectorInbox, ACE_Null_Mutex>;
+
+    public:
+        enum RequestType
+        {
+            REQUEST_LFG,
+            REQUEST_GUILD,
+            REQUEST_WHISPER
+        };
+
+        /// One chat line, the sender's fields are copied from the connection when it is posted
+        struct Request
+        {
+            Request() : type(REQUEST_LFG), senderGuid(0), senderSerial(0), guildId(0), faction(0), ackId(0), ack(false), next(NULL) { }
+
+            RequestType type;
+            uint64 senderGuid;
+            uint32 senderSerial;                            // connection that posted it, SocketConnector::GetSerial
+            std::string senderName;
+            uint32 guildId;
+            uint8 faction;
+            std::string receiver;                           // whisper: name as returned by normalizePlayerName
+            std::string message;
+            uint32 ackId;                                   // v2 request id, acknowledged once delivered
+            bool ack;
+            Request* next;
+        };
+
+        /// Reads SocketConnector.Inbox.* settings
+        void LoadConfig();
+
+        /// Any thread. Takes ownership of the request, returns false if the inbox is full.
+        bool Post(Request* request);
+
+        /// World thread, called from World::Update
+        void Update();
+
+        uint32 GetPending() const { return uint32(m_pending.value()); }
+        uint32 GetRejected() const { return m_rejected.value(); }
+        uint32 GetDeferredTicks() const { return m_deferredTicks.value(); }
+
+    private:
+        SocketConnectorInbox();
+        ~SocketConnectorInbox();
+
+        /// Lookups shared by the requests of one drain
+        struct Batch
+        {
+            Batch();
+
+            Channel* GetLFG(uint32 team);
+            Guild* GetGuild(uint32 guildId);
+            Player* GetPlayer(std::string const& name);
+
+            Channel* lfg[MAX_INBOX_TEAMS];
+            bool lfgResolved[MAX_INBOX_TEAMS];
+            UNORDERED_MAP<uint32, Guild*> guilds;
+            UNORDERED_MAP<std::string, Player*> players;
+        };
+
+        void TakePosted();
+        void Deliver(Request const& request, Batch& batch);
+        uint8 DeliverLFG(Request const& request, Batch& batch);
+        uint8 DeliverGuild(Request const& request, Batch& batch);
+        uint8 DeliverWhisper(Request const& request, Batch& batch);
+        void Acknowledge(Request const& request, uint8 status);
+
+        /// Pushed by the connector threads
+        SocketConnectorPostStack<Request> m_posted;
+
+        /// World thread only: taken requests in FIFO order that did not fit the last budget
+        Request* m_head;
+        Request* m_tail;
+
+        ACE_Atomic_Op<ACE_Thread_Mutex, long> m_pending;
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_rejected;
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_deferredTicks;
+
+        long m_maxPending;
+        ACE_Time_Value m_tickBudget;
+};
+
+#define sSocketConnectorInbox ACE_Singleton<SocketConnectorInbox, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
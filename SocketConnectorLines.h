@@ -0,0 +1,54 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorLines_H
+#define _SocketConnectorLines_H
+
+#include "Common.h"
+
+/// Returns the first '\n' or '\0' in [begin, end) or end if there is none.
+/// Checks a machine word per step: a byte matches when (word ^ pattern) has a zero byte.
+inline const char* FindLineEnd(const char* begin, const char* end)
+{
+    const uint64 ones = UI64LIT(0x0101010101010101);
+    const uint64 highs = UI64LIT(0x8080808080808080);
+    const uint64 newlines = ones * uint64('\n');
+
+    const char* p = begin;
+    for (; p + sizeof(uint64) <= end; p += sizeof(uint64))
+    {
+        uint64 word;
+        memcpy(&word, p, sizeof(word));
+
+        uint64 nl = word ^ newlines;
+        if (((word - ones) & ~word & highs) | ((nl - ones) & ~nl & highs))
+            break;
+    }
+
+    for (; p < end; ++p)
+        if (*p == '\n' || *p == '\0')
+            return p;
+
+    return end;
+}
+
+#endif
+/// @}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Log.h"
+#include "SocketConnectorModeration.h"
+#include "SocketConnectorRegistry.h"
+#include "SocketConnector.h"
+
+void SocketConnectorModeration::Acquire(uint32 accountId, time_t muteTime, bool banned)
+{
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+    AccountStateMap::iterator itr = m_accounts.find(accountId);
+    if (itr != m_accounts.end())
+    {
+        // an earlier session may hold newer state than the login query, keep it
+        ++itr->second.sessions;
+        return;
+    }
+
+    AccountState& state = m_accounts[accountId];
+    state.muteTime = muteTime;
+    state.banned = banned;
+    state.sessions = 1;
+}
+
+void SocketConnectorModeration::Release(uint32 accountId)
+{
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+    AccountStateMap::iterator itr = m_accounts.find(accountId);
+    if (itr != m_accounts.end() && --itr->second.sessions == 0)
+        m_accounts.erase(itr);
+}
+
+bool SocketConnectorModeration::CanSpeak(uint32 accountId) const
+{
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, m_lock, false);
+
+    AccountStateMap::const_iterator itr = m_accounts.find(accountId);
+    if (itr == m_accounts.end())
+        return false;
+
+    return !itr->second.banned && itr->second.muteTime <= time(NULL);
+}
+
+bool SocketConnectorModeration::IsBanned(uint32 accountId) const
+{
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, m_lock, true);
+
+    AccountStateMap::const_iterator itr = m_accounts.find(accountId);
+    return itr != m_accounts.end() && itr->second.banned;
+}
+
+time_t SocketConnectorModeration::GetMuteTime(uint32 accountId) const
+{
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, m_lock, 0);
+
+    AccountStateMap::const_iterator itr = m_accounts.find(accountId);
+    return itr != m_accounts.end() ? itr->second.muteTime : 0;
+}
+
+void SocketConnectorModeration::SetMuteTime(uint32 accountId, time_t muteTime)
+{
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+    // accounts without web sessions load their state at login
+    AccountStateMap::iterator itr = m_accounts.find(accountId);
+    if (itr != m_accounts.end())
+        itr->second.muteTime = muteTime;
+}
+
+void SocketConnectorModeration::SetBanned(uint32 accountId, bool banned)
+{
+    {
+        ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, guard, m_lock);
+
+        AccountStateMap::iterator itr = m_accounts.find(accountId);
+        if (itr == m_accounts.end())
+            return;
+
+        itr->second.banned = banned;
+    }
+
+    if (!banned)
+        return;
+
+    SocketConnectorRegistry::ReadGuard connections;
+    SocketConnectorRegistry::ConnectionList::const_iterator iterator;
+    for (iterator = connections->connections.begin(); iterator != connections->connections.end(); ++iterator)
+    {
+        if ((*iterator)->accountGuid == accountId)
+        {
+            sLog->outDebug(LOG_FILTER_REMOTECOMMAND, "SocketConnector: account %u banned, closing web session of %s", accountId, (*iterator)->playerName.c_str());
+            (*iterator)->Kick();
+        }
+    }
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorModeration_H
+#define _SocketConnectorModeration_H
+
+#include "Common.h"
+#include "UnorderedMap.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/RW_Thread_Mutex.h>
+
+/// Mute and ban state of accounts with open web chat sessions.
+/// Filled once at login and kept current by the same code that changes
+/// WorldSession::m_muteTime and bans accounts, so the chat path never
+/// queries the login database.
+class SocketConnectorModeration
+{
+    friend class ACE_Singleton<SocketConnectorModeration, ACE_Null_Mutex>;
+
+    public:
+        /// A web session of the account logged in / closed
+        void Acquire(uint32 accountId, time_t muteTime, bool banned);
+        void Release(uint32 accountId);
+
+        bool CanSpeak(uint32 accountId) const;
+        bool IsBanned(uint32 accountId) const;
+        time_t GetMuteTime(uint32 accountId) const;
+
+        /// Hooks for the mute / ban code, a ban also closes the account's web sessions
+        void SetMuteTime(uint32 accountId, time_t muteTime);
+        void SetBanned(uint32 accountId, bool banned);
+
+    private:
+        SocketConnectorModeration() { }
+        ~SocketConnectorModeration() { }
+
+        struct AccountState
+        {
+            time_t muteTime;
+            bool banned;
+            uint32 sessions;
+        };
+
+        typedef UNORDERED_MAP<uint32, AccountState> AccountStateMap;
+
+        mutable ACE_RW_Thread_Mutex m_lock;
+        AccountStateMap m_accounts;
+};
+
+#define sSocketConnectorModeration ACE_Singleton<SocketConnectorModeration, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorPostStack_H
+#define _SocketConnectorPostStack_H
+
+#include "Common.h"
+
+/// Single word compare and swap, a full barrier on both compilers
+template<class T>
+inline T* SocketConnectorCompareExchange(T* volatile* target, T* exchange, T* comparand)
+{
+#if COMPILER == COMPILER_MICROSOFT
+    return (T*)InterlockedCompareExchangePointer((PVOID volatile*)target, exchange, comparand);
+#else
+    return __sync_val_compare_and_swap(target, comparand, exchange);
+#endif
+}
+
+/// Lock-free hand-over of intrusive nodes (T::next) from any number of threads to one consumer.
+/// Producers push with a compare and swap. The consumer takes the whole stack at once
+/// and never pops single nodes, so there is no ABA problem.
+template<class T>
+class SocketConnectorPostStack
+{
+    public:
+        SocketConnectorPostStack() : m_top(NULL) { }
+
+        void Push(T* node)
+        {
+            T* top = m_top;
+            for (;;)
+            {
+                node->next = top;
+
+                T* seen = SocketConnectorCompareExchange(&m_top, node, top);
+                if (seen == top)
+                    return;
+
+                top = seen;
+            }
+        }
+
+        /// Consumer only. Returns the nodes in push order, last is set to the final one.
+        T* TakeAll(T*& last)
+        {
+            T* taken = m_top;
+            for (;;)
+            {
+                T* seen = SocketConnectorCompareExchange(&m_top, (T*)NULL, taken);
+                if (seen == taken)
+                    break;
+
+                taken = seen;
+            }
+
+            // newest first on the stack
+            T* first = NULL;
+            last = taken;
+            while (taken)
+            {
+                T* next = taken->next;
+                taken->next = first;
+                first = taken;
+                taken = next;
+            }
+
+            return first;
+        }
+
+        bool IsEmpty() const { return m_top == NULL; }
+
+    private:
+        T* volatile m_top;
+};
+
+#endif
+/// @}
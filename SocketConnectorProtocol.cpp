@@ -0,0 +1,161 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "SocketConnectorProtocol.h"
+
+#include <algorithm>
+
+bool SocketConnectorPacketReader::ReadUInt8(uint8& value)
+{
+    if (m_end - m_pos < 1)
+        return false;
+
+    value = uint8(*m_pos++);
+    return true;
+}
+
+bool SocketConnectorPacketReader::ReadUInt32(uint32& value)
+{
+    if (m_end - m_pos < 4)
+        return false;
+
+    const uint8* p = (const uint8*)m_pos;
+    value = (uint32(p[0]) << 24) | (uint32(p[1]) << 16) | (uint32(p[2]) << 8) | uint32(p[3]);
+    m_pos += 4;
+    return true;
+}
+
+bool SocketConnectorPacketReader::ReadString(ByteView& value)
+{
+    if (m_end - m_pos < 2)
+        return false;
+
+    const uint8* p = (const uint8*)m_pos;
+    size_t length = (size_t(p[0]) << 8) | size_t(p[1]);
+    if (size_t(m_end - m_pos) - 2 < length)
+        return false;
+
+    value.data = m_pos + 2;
+    value.length = length;
+    m_pos += 2 + length;
+    return true;
+}
+
+SocketConnectorProtocol::PeekResult SocketConnectorProtocol::Peek(const char* begin, const char* end, uint8& opcode, ByteView& payload, size_t& frameSize)
+{
+    size_t available = size_t(end - begin);
+    if (available < V2_HEADER_SIZE)
+    {
+        frameSize = V2_HEADER_SIZE;
+        return PEEK_MORE;
+    }
+
+    const uint8* p = (const uint8*)begin;
+    size_t length = (size_t(p[0]) << 24) | (size_t(p[1]) << 16) | (size_t(p[2]) << 8) | size_t(p[3]);
+
+    frameSize = V2_HEADER_SIZE + length;
+    if (available < frameSize)
+        return PEEK_MORE;
+
+    opcode = p[4];
+    payload.data = begin + V2_HEADER_SIZE;
+    payload.length = length;
+    return PEEK_FRAME;
+}
+
+void SocketConnectorProtocol::AppendHeader(std::string& out, uint8 opcode, size_t payloadLength)
+{
+    AppendUInt32(out, uint32(payloadLength));
+    AppendUInt8(out, opcode);
+}
+
+void SocketConnectorProtocol::AppendUInt8(std::string& out, uint8 value)
+{
+    out += char(value);
+}
+
+void SocketConnectorProtocol::AppendUInt32(std::string& out, uint32 value)
+{
+    out += char(value >> 24);
+    out += char((value >> 16) & 0xFF);
+    out += char((value >> 8) & 0xFF);
+    out += char(value & 0xFF);
+}
+
+void SocketConnectorProtocol::AppendString(std::string& out, const char* data, size_t length)
+{
+    if (length > 0xFFFF)
+        length = 0xFFFF;
+
+    out += char(length >> 8);
+    out += char(length & 0xFF);
+    out.append(data, length);
+}
+
+void SocketConnectorProtocol::Encode(ACE_Data_Block* frame, std::string& out)
+{
+    const char* begin = frame->base();
+    const char* end = begin + frame->size();
+
+    if (frame->msg_type() == SOCKET_CONNECTOR_V2_FRAME)
+    {
+        out.append(begin, frame->size());
+        return;
+    }
+
+    if (frame->msg_type() != SOCKET_CONNECTOR_TYPED_FRAME)
+    {
+        size_t length = std::min(frame->size(), size_t(0xFFFF));
+        AppendHeader(out, V2_TEXT, 2 + length);
+        AppendString(out, begin, length);
+        return;
+    }
+
+    // "<type>\\<sender>\\<message>", names never contain a backslash
+    const char* sender = begin + 2;
+    const char* separator = std::find(sender, end, '\\');
+    const char* message = separator < end ? separator + 1 : end;
+    size_t senderLength = std::min(size_t(separator - sender), size_t(0xFFFF));
+    size_t messageLength = std::min(size_t(end - message), size_t(0xFFFF));
+
+    switch (*begin)
+    {
+        case 'p':
+            AppendHeader(out, V2_PRESENCE, 2 + senderLength + 1);
+            AppendString(out, sender, senderLength);
+            AppendUInt8(out, messageLength && *message == '1' ? 1 : 0);
+            return;
+        case 'm':
+            AppendHeader(out, V2_CHAT, 2 + senderLength + 2 + messageLength);
+            break;
+        case 'g':
+            AppendHeader(out, V2_GUILD, 2 + senderLength + 2 + messageLength);
+            break;
+        case 'w':
+        default:
+            AppendHeader(out, V2_WHISPER, 2 + senderLength + 2 + messageLength);
+            break;
+    }
+
+    AppendString(out, sender, senderLength);
+    AppendString(out, message, messageLength);
+}
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorProtocol_H
+#define _SocketConnectorProtocol_H
+
+#include "Common.h"
+
+#include <ace/Message_Block.h>
+
+/// Web chat protocol v2, negotiated by sending the line "v2" instead of the account name.
+/// Every frame is <uint32 length><uint8 opcode><payload>, length counts the payload.
+/// Integers are big endian, strings are <uint16 length><bytes>.
+enum ProtocolV2Opcode
+{
+    V2_LINE         = 0x00,                                 // c->s string line: a legacy command (login steps, getchars, quit)
+    V2_CHAT         = 0x01,                                 // c->s uint32 id, string message / s->c string sender, string message
+    V2_WHISPER      = 0x02,                                 // c->s uint32 id, string receiver, string message / s->c string sender, string message
+    V2_GUILD        = 0x03,                                 // c->s uint32 id, string message / s->c string sender, string message
+    V2_PRESENCE     = 0x04,                                 // s->c string name, uint8 online: a guild member's web session
+    V2_ACK          = 0x05,                                 // s->c uint32 id, uint8 AckStatus
+    V2_TEXT         = 0x06,                                 // s->c string text: any other server line
+    V2_PING         = 0x07,                                 // s->c keepalive of an idle session, the client answers with an empty V2_PING
+    MAX_V2_OPCODE
+};
+
+enum ProtocolV2AckStatus
+{
+    V2_ACK_OK           = 0,
+    V2_ACK_MUTED        = 1,
+    V2_ACK_UNDELIVERED  = 2
+};
+
+#define V2_HEADER_SIZE 5
+
+/// Data blocks built by SocketConnector::BuildFrame, "<type>\\<sender>\\<message>"
+#define SOCKET_CONNECTOR_TYPED_FRAME ACE_Message_Block::MB_USER
+/// Data blocks that already hold a v2 frame, only queued for v2 clients
+#define SOCKET_CONNECTOR_V2_FRAME (ACE_Message_Block::MB_USER + 1)
+
+/// Bytes inside a receive buffer, only valid until the buffer is modified
+struct ByteView
+{
+    ByteView() : data(NULL), length(0) { }
+
+    std::string ToString() const { return std::string(data, length); }
+
+    const char* data;
+    size_t length;
+};
+
+/// Reads the payload of one v2 frame in place
+class SocketConnectorPacketReader
+{
+    public:
+        SocketConnectorPacketReader(const char* data, size_t length) : m_pos(data), m_end(data + length) { }
+
+        bool ReadUInt8(uint8& value);
+        bool ReadUInt32(uint32& value);
+        bool ReadString(ByteView& value);
+        bool AtEnd() const { return m_pos == m_end; }
+
+    private:
+        const char* m_pos;
+        const char* m_end;
+};
+
+class SocketConnectorProtocol
+{
+    public:
+        enum PeekResult
+        {
+            PEEK_MORE,                                      // the frame is incomplete
+            PEEK_FRAME
+        };
+
+        /// Locates the frame at begin, frameSize is set in both cases once the header is complete
+        static PeekResult Peek(const char* begin, const char* end, uint8& opcode, ByteView& payload, size_t& frameSize);
+
+        static void AppendHeader(std::string& out, uint8 opcode, size_t payloadLength);
+        static void AppendUInt8(std::string& out, uint8 value);
+        static void AppendUInt32(std::string& out, uint32 value);
+        static void AppendString(std::string& out, const char* data, size_t length);
+
+        /// v2 form of a queued line: typed frames keep their type, everything else becomes V2_TEXT
+        static void Encode(ACE_Data_Block* frame, std::string& out);
+};
+
+#endif
+/// @}
@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Log.h"
+#include "SocketConnectorRegistry.h"
+#include "SocketConnector.h"
+#include "SocketConnectorTokens.h"
+#include "SocketConnectorCharacters.h"
+#include "SharedDefines.h"
+#include "World.h"
+
+#include <ace/TSS_T.h>
+#include <algorithm>
+
+/// Reader slot of the calling thread, claimed on first use and given back when the thread exits
+struct ReaderSlot
+{
+    ReaderSlot() : index(sSocketConnectorRegistry->AcquireSlot()), depth(0) { }
+    ~ReaderSlot() { sSocketConnectorRegistry->ReleaseSlot(index); }
+
+    int32 index;                                            // -1 when all slots are taken
+    uint32 depth;                                           // nested read sections
+};
+
+static ACE_TSS<ReaderSlot> s_readerSlot;
+
+/// Drops a session from a character index, the key goes with its last session
+template<class Index>
+static void RemoveSession(Index& index, typename Index::key_type const& key, SocketConnector* conn)
+{
+    typename Index::iterator itr = index.find(key);
+    if (itr == index.end())
+        return;
+
+    SocketConnectorRegistry::ConnectionList& sessions = itr->second;
+    sessions.erase(std::remove(sessions.begin(), sessions.end(), conn), sessions.end());
+    if (sessions.empty())
+        index.erase(itr);
+}
+
+SocketConnectorRegistry::ReadGuard::ReadGuard() : m_snapshot(NULL), m_overflow(false)
+{
+    SocketConnectorRegistry* registry = sSocketConnectorRegistry;
+    ReaderSlot* slot = s_readerSlot;
+
+    // both stores are full barriers, so the snapshot load below can not be
+    // reordered before them and a concurrent Update() sees this reader
+    if (slot->index < 0)
+    {
+        ++registry->m_overflowReaders;
+        m_overflow = true;
+    }
+    else if (slot->depth++ == 0)
+        registry->m_readerEpochs[slot->index] = registry->m_epoch.value();
+
+    m_snapshot = registry->Current();
+}
+
+SocketConnectorRegistry::ReadGuard::~ReadGuard()
+{
+    SocketConnectorRegistry* registry = sSocketConnectorRegistry;
+
+    if (m_overflow)
+    {
+        --registry->m_overflowReaders;
+        return;
+    }
+
+    ReaderSlot* slot = s_readerSlot;
+    if (--slot->depth == 0)
+        registry->m_readerEpochs[slot->index] = 0;
+}
+
+SocketConnector* SocketConnectorRegistry::ReadGuard::FindByName(std::string const& name) const
+{
+    SocketConnectorRegistry* registry = sSocketConnectorRegistry;
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, registry->m_IndexLock, NULL);
+
+    // the latest login of a character receives its whispers
+    NameIndex::const_iterator itr = registry->m_byName.find(name);
+    return itr != registry->m_byName.end() ? itr->second.back() : NULL;
+}
+
+SocketConnector* SocketConnectorRegistry::ReadGuard::FindByGuid(uint64 guid) const
+{
+    SocketConnectorRegistry* registry = sSocketConnectorRegistry;
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, registry->m_IndexLock, NULL);
+
+    GuidIndex::const_iterator itr = registry->m_byGuid.find(guid);
+    return itr != registry->m_byGuid.end() ? itr->second.back() : NULL;
+}
+
+SocketConnector* SocketConnectorRegistry::ReadGuard::FindSession(uint64 guid, uint32 serial) const
+{
+    SocketConnectorRegistry* registry = sSocketConnectorRegistry;
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, registry->m_IndexLock, NULL);
+
+    GuidIndex::const_iterator itr = registry->m_byGuid.find(guid);
+    if (itr == registry->m_byGuid.end())
+        return NULL;
+
+    for (ConnectionList::const_iterator session = itr->second.begin(); session != itr->second.end(); ++session)
+        if ((*session)->GetSerial() == serial)
+            return *session;
+
+    return NULL;
+}
+
+void SocketConnectorRegistry::ReadGuard::FindSessions(uint64 guid, ConnectionList& sessions) const
+{
+    SocketConnectorRegistry* registry = sSocketConnectorRegistry;
+    ACE_READ_GUARD(ACE_RW_Thread_Mutex, guard, registry->m_IndexLock);
+
+    // the index changes in place, the caller gets a copy
+    GuidIndex::const_iterator itr = registry->m_byGuid.find(guid);
+    if (itr != registry->m_byGuid.end())
+        sessions = itr->second;
+}
+
+SocketConnectorRegistry::ConnectionList const* SocketConnectorRegistry::ReadGuard::FindGuildMembers(uint32 guildId) const
+{
+    SocketConnectorRegistry* registry = sSocketConnectorRegistry;
+    ACE_READ_GUARD_RETURN(ACE_RW_Thread_Mutex, guard, registry->m_IndexLock, NULL);
+
+    GuildIndex::const_iterator itr = registry->m_byGuild.find(guildId);
+    return itr != registry->m_byGuild.end() ? itr->second : NULL;
+}
+
+SocketConnectorRegistry::SocketConnectorRegistry() : m_current(new Snapshot()), m_epoch(1), m_overflowReaders(0)
+{
+    for (uint32 i = 0; i < MAX_CONNECTOR_READER_SLOTS; ++i)
+    {
+        m_readerEpochs[i] = 0;
+        m_slotUsed[i] = false;
+    }
+}
+
+SocketConnectorRegistry::~SocketConnectorRegistry()
+{
+    // the connector thread drained the connections before the shards went away; one that
+    // did not close in time is left alone, destroying it would touch its deleted reactor
+    for (RetiredList::iterator itr = m_retired.begin(); itr != m_retired.end(); ++itr)
+    {
+        delete itr->snapshot;
+        delete itr->list;
+    }
+
+    for (GuildIndex::iterator itr = m_byGuild.begin(); itr != m_byGuild.end(); ++itr)
+        delete itr->second;
+
+    delete m_current;
+}
+
+int32 SocketConnectorRegistry::AcquireSlot()
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_WriteLock, -1);
+
+    for (int32 i = 0; i < MAX_CONNECTOR_READER_SLOTS; ++i)
+    {
+        if (!m_slotUsed[i])
+        {
+            m_slotUsed[i] = true;
+            return i;
+        }
+    }
+
+    sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorRegistry: more than %u reader threads, reclamation is delayed while extra threads read", MAX_CONNECTOR_READER_SLOTS);
+    return -1;
+}
+
+void SocketConnectorRegistry::ReleaseSlot(int32 slot)
+{
+    if (slot < 0)
+        return;
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_WriteLock);
+
+    m_readerEpochs[slot] = 0;
+    m_slotUsed[slot] = false;
+}
+
+void SocketConnectorRegistry::Add(SocketConnector* conn)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_WriteLock);
+    m_added.push_back(conn);
+}
+
+void SocketConnectorRegistry::Activate(SocketConnector* conn)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_WriteLock);
+
+    if (conn->playerFaction < MAX_CONNECTOR_FACTIONS)
+        m_activated[conn->playerFaction].push_back(conn);
+
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, indexGuard, m_IndexLock);
+
+    m_byName[conn->playerName].push_back(conn);
+    m_byGuid[conn->playerGuid].push_back(conn);
+
+    if (uint32 guildId = conn->guildGuid.value())
+        AddGuildMember(guildId, conn);
+}
+
+void SocketConnectorRegistry::Remove(SocketConnector* conn)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_WriteLock);
+
+    {
+        ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, indexGuard, m_IndexLock);
+
+        // an older session of the character takes over its whispers
+        RemoveSession(m_byName, conn->playerName, conn);
+        RemoveSession(m_byGuid, conn->playerGuid, conn);
+
+        if (uint32 guildId = conn->guildGuid.value())
+            RemoveGuildMember(guildId, conn);
+    }
+
+    // retired by the Update() that publishes a snapshot without it
+    m_removed.push_back(conn);
+}
+
+void SocketConnectorRegistry::SetGuild(uint64 playerGuid, uint32 guildId)
+{
+    // the character may be between a dropped connection and its resume
+    sSocketConnectorTokens->SetGuild(playerGuid, guildId);
+    sSocketConnectorCharacters->SetGuild(playerGuid, guildId);
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_WriteLock);
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, indexGuard, m_IndexLock);
+
+    GuidIndex::iterator itr = m_byGuid.find(playerGuid);
+    if (itr == m_byGuid.end())
+        return;
+
+    // an older tab of a kicked character must stop receiving the guild as well
+    for (ConnectionList::const_iterator session = itr->second.begin(); session != itr->second.end(); ++session)
+    {
+        SocketConnector* conn = *session;
+        uint32 previous = conn->guildGuid.value();
+        if (previous == guildId)
+            continue;
+
+        if (previous)
+            RemoveGuildMember(previous, conn);
+
+        conn->guildGuid = guildId;
+
+        if (guildId)
+            AddGuildMember(guildId, conn);
+    }
+}
+
+void SocketConnectorRegistry::DisbandGuild(uint32 guildId)
+{
+    sSocketConnectorTokens->DisbandGuild(guildId);
+    sSocketConnectorCharacters->DisbandGuild(guildId);
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_WriteLock);
+    ACE_WRITE_GUARD(ACE_RW_Thread_Mutex, indexGuard, m_IndexLock);
+
+    GuildIndex::iterator itr = m_byGuild.find(guildId);
+    if (itr == m_byGuild.end())
+        return;
+
+    ConnectionList* members = itr->second;
+    for (ConnectionList::const_iterator member = members->begin(); member != members->end(); ++member)
+        (*member)->guildGuid = 0;
+
+    m_byGuild.erase(itr);
+    Retire(NULL, members);
+}
+
+void SocketConnectorRegistry::AddGuildMember(uint32 guildId, SocketConnector* conn)
+{
+    ConnectionList* members;
+
+    GuildIndex::iterator itr = m_byGuild.find(guildId);
+    if (itr != m_byGuild.end())
+    {
+        members = new ConnectionList(*itr->second);
+        Retire(NULL, itr->second);
+    }
+    else
+        members = new ConnectionList();
+
+    members->push_back(conn);
+    m_byGuild[guildId] = members;
+}
+
+void SocketConnectorRegistry::RemoveGuildMember(uint32 guildId, SocketConnector* conn)
+{
+    GuildIndex::iterator itr = m_byGuild.find(guildId);
+    if (itr == m_byGuild.end())
+        return;
+
+    ConnectionList* old = itr->second;
+    if (std::find(old->begin(), old->end(), conn) == old->end())
+        return;
+
+    if (old->size() == 1)
+        m_byGuild.erase(itr);
+    else
+    {
+        ConnectionList* members = new ConnectionList();
+        members->reserve(old->size() - 1);
+        for (ConnectionList::const_iterator member = old->begin(); member != old->end(); ++member)
+            if (*member != conn)
+                members->push_back(*member);
+
+        itr->second = members;
+    }
+
+    Retire(NULL, old);
+}
+
+void SocketConnectorRegistry::Retire(SocketConnector* conn, ConnectionList* list)
+{
+    // readers that entered before the epoch bump may still hold it
+    Retired retired;
+    retired.epoch = m_epoch.value();
+    retired.snapshot = NULL;
+    retired.connection = conn;
+    retired.list = list;
+    m_retired.push_back(retired);
+    ++m_epoch;
+}
+
+void SocketConnectorRegistry::Publish(Snapshot* snapshot)
+{
+    Retired retired;
+    retired.epoch = m_epoch.value();
+    retired.snapshot = m_current;
+    retired.connection = NULL;
+    retired.list = NULL;
+    m_retired.push_back(retired);
+
+    // publish first, then bump the epoch: a reader that sees the new epoch sees the new snapshot
+    m_current = snapshot;
+    ++m_epoch;
+}
+
+void SocketConnectorRegistry::CopyExcept(ConnectionList const& from, ConnectionList& to, ConnectionList const& removed)
+{
+    to.reserve(to.size() + from.size());
+    for (ConnectionList::const_iterator itr = from.begin(); itr != from.end(); ++itr)
+        if (removed.empty() || !std::binary_search(removed.begin(), removed.end(), *itr))
+            to.push_back(*itr);
+}
+
+void SocketConnectorRegistry::CommitLocked()
+{
+    bool activated = false;
+    for (uint8 faction = 0; faction < MAX_CONNECTOR_FACTIONS; ++faction)
+        activated = activated || !m_activated[faction].empty();
+
+    if (m_added.empty() && m_removed.empty() && !activated)
+        return;
+
+    // one pass over the current lists, whatever number of changes queued up
+    std::sort(m_removed.begin(), m_removed.end());
+
+    Snapshot* snapshot = new Snapshot();
+    CopyExcept(m_current->connections, snapshot->connections, m_removed);
+    CopyExcept(m_added, snapshot->connections, m_removed);
+
+    for (uint8 faction = 0; faction < MAX_CONNECTOR_FACTIONS; ++faction)
+    {
+        CopyExcept(m_current->lfg[faction], snapshot->lfg[faction], m_removed);
+        CopyExcept(m_activated[faction], snapshot->lfg[faction], m_removed);
+        m_activated[faction].clear();
+    }
+
+    Publish(snapshot);
+    m_added.clear();
+
+    for (ConnectionList::const_iterator itr = m_removed.begin(); itr != m_removed.end(); ++itr)
+        Retire(*itr, NULL);
+
+    m_removed.clear();
+}
+
+void SocketConnectorRegistry::Update()
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_WriteLock);
+    CommitLocked();
+    ReclaimLocked();
+}
+
+void SocketConnectorRegistry::ReclaimLocked()
+{
+    if (m_retired.empty() || m_overflowReaders.value() > 0)
+        return;
+
+    // oldest epoch a reader may still be working in
+    uint32 oldest = m_epoch.value();
+    for (uint32 i = 0; i < MAX_CONNECTOR_READER_SLOTS; ++i)
+    {
+        uint32 epoch = m_readerEpochs[i].value();
+        if (epoch && epoch < oldest)
+            oldest = epoch;
+    }
+
+    RetiredList::iterator keep = m_retired.begin();
+    for (RetiredList::iterator itr = m_retired.begin(); itr != m_retired.end(); ++itr)
+    {
+        if (itr->epoch < oldest)
+        {
+            delete itr->snapshot;
+            delete itr->list;
+            if (itr->connection)
+                itr->connection->destroy();
+        }
+        else
+            *keep++ = *itr;
+    }
+
+    m_retired.erase(keep, m_retired.end());
+}
+
+size_t SocketConnectorRegistry::GetConnectionCount() const
+{
+    ReadGuard guard;
+    return guard->connections.size();
+}
+
+bool SocketConnectorRegistry::IsDrained() const
+{
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_WriteLock, false);
+
+    if (!m_current->connections.empty() || !m_added.empty() || !m_removed.empty())
+        return false;
+
+    for (RetiredList::const_iterator itr = m_retired.begin(); itr != m_retired.end(); ++itr)
+        if (itr->connection)
+            return false;
+
+    return true;
+}
+
+uint32 SocketConnectorRegistry::GetLFGAudience(uint32 lang)
+{
+    if (lang == LANG_UNIVERSAL || sWorld->getBoolConfig(CONFIG_ALLOW_TWO_SIDE_INTERACTION_CHAT))
+        return (1 << MAX_CONNECTOR_FACTIONS) - 1;
+
+    if (lang == LANG_COMMON)
+        return 1 << 0;
+
+    if (lang == LANG_ORCISH)
+        return 1 << 1;
+
+    return 0;
+}
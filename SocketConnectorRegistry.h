@@ -0,0 +1,170 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorRegistry_H
+#define _SocketConnectorRegistry_H
+
+#include "Common.h"
+#include "UnorderedMap.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/RW_Thread_Mutex.h>
+#include <ace/Atomic_Op.h>
+#include <vector>
+
+class SocketConnector;
+
+#define MAX_CONNECTOR_READER_SLOTS 128
+#define MAX_CONNECTOR_FACTIONS 2                            // SocketConnector::playerFaction, 0 alliance, 1 horde
+
+/// Set of live web chat connections.
+/// Readers walk an immutable snapshot without taking a lock. Writers only queue
+/// their change under m_WriteLock; the connector thread publishes everything
+/// queued as one new snapshot per reactor pass, so a reconnect storm costs one
+/// copy per pass instead of one per connection. Replaced snapshots and
+/// removed connections are only freed once every reader that could still see
+/// them has left its read section (epoch based reclamation), so a broadcast
+/// never touches a destroyed connection.
+class SocketConnectorRegistry
+{
+    friend class ACE_Singleton<SocketConnectorRegistry, ACE_Null_Mutex>;
+
+    public:
+        typedef std::vector<SocketConnector*> ConnectionList;
+
+        struct Snapshot
+        {
+            ConnectionList connections;                     // every open connection, logged in or not
+            ConnectionList lfg[MAX_CONNECTOR_FACTIONS];     // logged in sessions by faction
+        };
+
+        /// Read section. The snapshot and every connection in it stay valid while the guard lives.
+        class ReadGuard
+        {
+            public:
+                ReadGuard();
+                ~ReadGuard();
+
+                Snapshot const* operator->() const { return m_snapshot; }
+                Snapshot const& operator*() const { return *m_snapshot; }
+
+                /// Newest logged in web session of a character, name as returned by normalizePlayerName
+                SocketConnector* FindByName(std::string const& name) const;
+                SocketConnector* FindByGuid(uint64 guid) const;
+                /// Logged in session of a character with the given SocketConnector::GetSerial, NULL once it is closed
+                SocketConnector* FindSession(uint64 guid, uint32 serial) const;
+                /// Every logged in session of a character, oldest first
+                void FindSessions(uint64 guid, ConnectionList& sessions) const;
+                /// Logged in web sessions of a guild, NULL if there are none
+                ConnectionList const* FindGuildMembers(uint32 guildId) const;
+
+            private:
+                ReadGuard(ReadGuard const&);
+                ReadGuard& operator=(ReadGuard const&);
+
+                Snapshot const* m_snapshot;
+                bool m_overflow;                            // no free slot, counted in m_overflowReaders
+        };
+
+        friend class ReadGuard;
+
+        /// Called from the connector threads, the snapshot lists change with the next Update()
+        void Add(SocketConnector* conn);
+        /// Indexes a connection by character once the character is selected
+        void Activate(SocketConnector* conn);
+        /// Takes ownership of the connection, it is destroyed once no reader can reach it
+        void Remove(SocketConnector* conn);
+
+        /// Guild membership changes of a character, called from the guild code (guildId 0 when leaving)
+        void SetGuild(uint64 playerGuid, uint32 guildId);
+        void DisbandGuild(uint32 guildId);
+        /// Connector thread, once per reactor pass. Publishes the queued changes as one
+        /// snapshot and frees retired snapshots and connections that no reader can reach anymore.
+        void Update();
+
+        size_t GetConnectionCount() const;
+        /// True once every connection was closed and destroyed, see SocketConnectorRunnable::CloseConnections
+        bool IsDrained() const;
+
+        /// Bit (1 << faction) is set for every faction that understands an LFG line in this language
+        static uint32 GetLFGAudience(uint32 lang);
+
+        /// Per thread reader slot bookkeeping, see ReaderSlot in the .cpp
+        int32 AcquireSlot();
+        void ReleaseSlot(int32 slot);
+
+    private:
+        SocketConnectorRegistry();
+        ~SocketConnectorRegistry();
+
+        struct Retired
+        {
+            uint32 epoch;
+            Snapshot* snapshot;
+            SocketConnector* connection;
+            ConnectionList* list;
+        };
+
+        typedef std::vector<Retired> RetiredList;
+        /// Every session of the character, oldest first; two tabs may log in the same character
+        typedef UNORDERED_MAP<std::string, ConnectionList> NameIndex;
+        typedef UNORDERED_MAP<uint64, ConnectionList> GuidIndex;
+        typedef UNORDERED_MAP<uint32, ConnectionList*> GuildIndex;
+
+        void Publish(Snapshot* snapshot);
+        void CommitLocked();
+        static void CopyExcept(ConnectionList const& from, ConnectionList& to, ConnectionList const& removed);
+        void Retire(SocketConnector* conn, ConnectionList* list);
+        void AddGuildMember(uint32 guildId, SocketConnector* conn);
+        void RemoveGuildMember(uint32 guildId, SocketConnector* conn);
+        void ReclaimLocked();
+        Snapshot const* Current() const { return m_current; }
+
+        mutable ACE_Thread_Mutex m_WriteLock;
+        Snapshot* volatile m_current;
+        RetiredList m_retired;
+
+        /// Changes queued for the next snapshot
+        ConnectionList m_added;
+        ConnectionList m_activated[MAX_CONNECTOR_FACTIONS];
+        ConnectionList m_removed;
+
+        /// Character lookups, entries are erased before the connection is retired.
+        /// Guild member lists are immutable, a change replaces and retires the list.
+        mutable ACE_RW_Thread_Mutex m_IndexLock;
+        NameIndex m_byName;
+        GuidIndex m_byGuid;
+        GuildIndex m_byGuild;
+
+        /// Epoch 0 marks an idle slot, the global epoch starts at 1
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_epoch;
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_readerEpochs[MAX_CONNECTOR_READER_SLOTS];
+        bool m_slotUsed[MAX_CONNECTOR_READER_SLOTS];
+        /// Readers without a slot, nothing is reclaimed while there are any
+        ACE_Atomic_Op<ACE_Thread_Mutex, uint32> m_overflowReaders;
+};
+
+#define sSocketConnectorRegistry ACE_Singleton<SocketConnectorRegistry, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
@@ -30,10 +30,25 @@
 #include <ace/Dev_Poll_Reactor.h>
 #include <ace/Acceptor.h>
 #include <ace/SOCK_Acceptor.h>
+#include <ace/OS_NS_sys_time.h>
 
 #include "SocketConnector.h"
+#include "SocketConnectorRegistry.h"
+#include "SocketConnectorAuth.h"
+#include "SocketConnectorTokens.h"
+#include "SocketConnectorUring.h"
+#include "SocketConnectorInbox.h"
+#include "SocketConnectorEventBus.h"
+#include "SocketConnectorFanout.h"
+#include "SocketConnectorTimerWheel.h"
+#include "SocketConnectorAdmission.h"
 
-SocketConnectorRunnable::SocketConnectorRunnable() : m_Reactor(NULL)
+#define SOCKET_CONNECTOR_STATS_INTERVAL 60                  // seconds between statistics lines
+#define SOCKET_CONNECTOR_CLOSE_TIMEOUT 5                    // seconds the shards get to close their connections at shutdown
+
+SocketConnectorRunnable::ShardList SocketConnectorRunnable::s_Shards;
+
+SocketConnectorShard::SocketConnectorShard(uint32 index) : m_Index(index), m_Reactor(NULL), m_Uring(NULL), m_Timers(NULL), m_Connections(0), m_CpuTime(0)
 {
     ACE_Reactor_Impl* imp = 0;
 
@@ -52,32 +67,270 @@ SocketConnectorRunnable::SocketConnectorRunnable() : m_Reactor(NULL)
 #endif
 
     m_Reactor = new ACE_Reactor (imp, 1);
+
+    // the wheel only needs the reactor timer, a failure shows up as connections that never time out
+    m_Timers = new SocketConnectorTimerWheel(m_Reactor);
+    m_Timers->Open();
+
+    // the io_uring engine falls back to the reactor when the kernel lacks it
+    if (SocketConnectorUring::IsEnabled())
+    {
+        m_Uring = new SocketConnectorUring(m_Reactor);
+        if (!m_Uring->Open())
+        {
+            delete m_Uring;
+            m_Uring = NULL;
+        }
+    }
 }
 
-SocketConnectorRunnable::~SocketConnectorRunnable()
+SocketConnectorShard::~SocketConnectorShard()
 {
+    delete m_Timers;
+    delete m_Uring;
     delete m_Reactor;
 }
 
+void SocketConnectorShard::SampleCpu()
+{
+#ifdef CLOCK_THREAD_CPUTIME_ID
+    timespec ts;
+    if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+        m_CpuTime = uint64(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+#endif
+}
+
+int SocketConnectorShard::Start()
+{
+    return activate(THR_NEW_LWP | THR_JOINABLE, 1);
+}
+
+void SocketConnectorShard::Stop()
+{
+    m_Reactor->end_reactor_event_loop();
+}
+
+int SocketConnectorShard::svc()
+{
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector shard thread started");
+
+    while (!m_Reactor->reactor_event_loop_done())
+    {
+        // don't be too smart to move this outside the loop
+        // the run_reactor_event_loop will modify interval
+        ACE_Time_Value interval(0, 100000);
+
+        if (m_Reactor->run_reactor_event_loop(interval) == -1)
+            break;
+
+        SampleCpu();
+    }
+
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector shard thread exiting");
+    return 0;
+}
+
+SocketConnectorRunnable::SocketConnectorRunnable() : m_StatsFrames(0), m_StatsSyscalls(0), m_StatsCpuTime(0)
+{
+}
+
+SocketConnectorRunnable::~SocketConnectorRunnable()
+{
+}
+
+SocketConnectorShard* SocketConnectorRunnable::PickShard()
+{
+    // connections live for hours, balance by what each shard holds now
+    SocketConnectorShard* best = s_Shards[0];
+    for (size_t i = 1; i < s_Shards.size(); ++i)
+        if (s_Shards[i]->GetConnections() < best->GetConnections())
+            best = s_Shards[i];
+
+    return best;
+}
+
+void SocketConnectorRunnable::CloseConnections()
+{
+    // nothing is accepted anymore, this publishes the last connections opened
+    sSocketConnectorRegistry->Update();
+
+    {
+        SocketConnectorRegistry::ReadGuard connections;
+        for (SocketConnectorRegistry::ConnectionList::const_iterator itr = connections->connections.begin(); itr != connections->connections.end(); ++itr)
+            (*itr)->Kick();
+    }
+
+    // shard 0 is driven by this thread, the other shards close theirs meanwhile
+    ACE_Reactor* reactor = s_Shards[0]->GetReactor();
+    ACE_Time_Value deadline = ACE_OS::gettimeofday() + ACE_Time_Value(SOCKET_CONNECTOR_CLOSE_TIMEOUT);
+
+    while (!sSocketConnectorRegistry->IsDrained())
+    {
+        if (ACE_OS::gettimeofday() >= deadline)
+        {
+            sLog->outError(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector: %u connections did not close in time and are leaked",
+                uint32(sSocketConnectorRegistry->GetConnectionCount()));
+            break;
+        }
+
+        ACE_Time_Value interval(0, 10000);
+        if (reactor->run_reactor_event_loop(interval) == -1)
+            break;
+
+        sSocketConnectorRegistry->Update();
+    }
+}
+
+void SocketConnectorRunnable::StopShards()
+{
+    for (size_t i = 1; i < s_Shards.size(); ++i)
+    {
+        s_Shards[i]->Stop();
+        s_Shards[i]->Wait();
+    }
+
+    for (size_t i = 0; i < s_Shards.size(); ++i)
+        delete s_Shards[i];
+
+    s_Shards.clear();
+}
+
+void SocketConnectorRunnable::LogStats()
+{
+    uint64 calls = SocketConnector::GetTotalWriteCalls();
+    uint64 flushes = SocketConnector::GetTotalFlushes();
+
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "SocketConnector: %u connections, %.2f frames per write, %.0f us mean flush delay, %u dropped frames, %u slow consumer kicks",
+        uint32(sSocketConnectorRegistry->GetConnectionCount()),
+        calls ? double(SocketConnector::GetTotalWrittenFrames()) / calls : 0.0,
+        flushes ? double(SocketConnector::GetTotalFlushDelay()) / flushes : 0.0,
+        SocketConnector::GetTotalDroppedFrames(), SocketConnector::GetTotalSlowConsumerKicks());
+
+    // the same load on both engines compares them: I/O syscalls per frame and connector CPU per 10k frames
+    bool uring = s_Shards[0]->GetUring() != NULL;
+    uint64 frames = SocketConnector::GetTotalWrittenFrames();
+    uint64 syscalls = uring ? SocketConnectorUring::GetTotalSyscalls() : calls + SocketConnector::GetTotalReadCalls();
+    uint64 cpuTime = 0;
+    for (size_t i = 0; i < s_Shards.size(); ++i)
+        cpuTime += s_Shards[i]->GetCpuTime();
+
+    uint64 intervalFrames = frames - m_StatsFrames;
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "SocketConnector %s engine: %u frames, %.3f I/O syscalls per frame, %.1f ms CPU per 10k frames, %u zero copy sends",
+        uring ? "io_uring" : "reactor", uint32(intervalFrames),
+        intervalFrames ? double(syscalls - m_StatsSyscalls) / intervalFrames : 0.0,
+        intervalFrames ? double(cpuTime - m_StatsCpuTime) / 1000.0 * 10000.0 / intervalFrames : 0.0,
+        uint32(SocketConnectorUring::GetTotalZeroCopySends()));
+
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "SocketConnector world inbox: %u pending, %u rejected, %u ticks over budget",
+        sSocketConnectorInbox->GetPending(), sSocketConnectorInbox->GetRejected(), sSocketConnectorInbox->GetDeferredTicks());
+
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "SocketConnector event bus: %u published, %u pending, %u dropped",
+        sSocketConnectorEventBus->GetPublished(), sSocketConnectorEventBus->GetPending(), sSocketConnectorEventBus->GetDropped());
+
+    uint32 timers = 0;
+    for (size_t i = 0; i < s_Shards.size(); ++i)
+        timers += s_Shards[i]->GetTimers()->GetScheduled();
+
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "SocketConnector timers: %u scheduled, %u connections timed out",
+        timers, SocketConnector::GetTotalTimeouts());
+
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "SocketConnector admission: %u logins running, %u queued (peak %u), %u refused",
+        sSocketConnectorAdmission->GetRunning(), sSocketConnectorAdmission->GetQueued(),
+        sSocketConnectorAdmission->GetPeakQueued(), sSocketConnectorAdmission->GetRefused());
+
+    uint32 parallel = sSocketConnectorFanout->GetParallelBroadcasts();
+    sLog->outDebug(LOG_FILTER_WORLDSERVER, "SocketConnector fan-out: %u parallel broadcasts, %.0f us mean completion, %u chunks stolen",
+        parallel, parallel ? double(sSocketConnectorFanout->GetParallelTime()) / parallel : 0.0, sSocketConnectorFanout->GetSteals());
+
+    m_StatsFrames = frames;
+    m_StatsSyscalls = syscalls;
+    m_StatsCpuTime = cpuTime;
+}
+
 void SocketConnectorRunnable::run()
 {
     if (!ConfigMgr::GetBoolDefault("SocketConnector.Enable", false))
         return;
     
-    ACE_Acceptor<SocketConnector, ACE_SOCK_ACCEPTOR> acceptor;
+    SocketConnector::LoadConfig();
+    SocketConnectorUring::LoadConfig();
+    sSocketConnectorInbox->LoadConfig();
+    sSocketConnectorEventBus->LoadConfig();
+    sSocketConnectorFanout->LoadConfig();
+    sSocketConnectorAdmission->LoadConfig();
+    sSocketConnectorTokens->LoadConfig();
+
+    uint32 authThreads = ConfigMgr::GetIntDefault("SocketConnector.AuthThreads", 2);
+    if (!sSocketConnectorAuth->Start(authThreads ? authThreads : 1))
+        return;
+
+    if (!sSocketConnectorEventBus->Start())
+    {
+        sSocketConnectorAuth->Stop();
+        return;
+    }
+
+    uint32 threads = ConfigMgr::GetIntDefault("SocketConnector.Threads", 1);
+    if (!threads)
+        threads = 1;
+
+    // shard 0 runs on this thread together with the acceptor
+    for (uint32 i = 0; i < threads; ++i)
+        s_Shards.push_back(new SocketConnectorShard(i));
+
+    if (!sSocketConnectorFanout->Start(threads))
+    {
+        sSocketConnectorEventBus->Stop();
+        StopShards();
+        sSocketConnectorFanout->Stop();
+        sSocketConnectorAuth->Stop();
+        return;
+    }
+
+    for (uint32 i = 1; i < threads; ++i)
+    {
+        if (s_Shards[i]->Start() == -1)
+        {
+            sLog->outError(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector can not start shard thread %u", i);
+            sSocketConnectorEventBus->Stop();
+            StopShards();
+            sSocketConnectorFanout->Stop();
+            sSocketConnectorAuth->Stop();
+            return;
+        }
+    }
+
+    ACE_Reactor* reactor = s_Shards[0]->GetReactor();
+    SocketConnectorAcceptor acceptor;
+
+    // the io_uring engine accepts with a multishot accept on a plain listen socket
+    SocketConnectorUring* uring = s_Shards[0]->GetUring();
+    ACE_SOCK_Acceptor listener;
 
     uint16 SocketConnectorPort = ConfigMgr::GetIntDefault("SocketConnector.Port", 3448);
     std::string stringip = ConfigMgr::GetStringDefault("SocketConnector.IP", "0.0.0.0");
 
     ACE_INET_Addr listen_addr(SocketConnectorPort, stringip.c_str());
 
-    if (acceptor.open(listen_addr, m_Reactor) == -1)
+    // the acceptor takes connections in batches itself, ACE's own accept loop stays off
+    int opened = uring ? listener.open(listen_addr, 1) : acceptor.open(listen_addr, reactor, 0, 0);
+    if (opened != -1)
+        sSocketConnectorAdmission->ConfigureListener(uring ? listener.get_handle() : acceptor.get_handle());
+
+    if (opened == -1 || (uring && !uring->Listen(listener.get_handle())))
     {
         sLog->outError(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector can not bind to port %d on %s", SocketConnectorPort, stringip.c_str());
+        listener.close();
+        sSocketConnectorEventBus->Stop();
+        StopShards();
+        sSocketConnectorFanout->Stop();
+        sSocketConnectorAuth->Stop();
         return;
     }
 
-    sLog->outInfo(LOG_FILTER_WORLDSERVER, "Starting Trinity Socket Connector on port %d on %s", SocketConnectorPort, stringip.c_str());
+    sLog->outInfo(LOG_FILTER_WORLDSERVER, "Starting Trinity Socket Connector on port %d on %s with %u threads (%s engine)", SocketConnectorPort, stringip.c_str(), threads, uring ? "io_uring" : "reactor");
+
+    time_t nextStats = time(NULL) + SOCKET_CONNECTOR_STATS_INTERVAL;
 
     while (!World::IsStopped())
     {
@@ -85,9 +338,32 @@ void SocketConnectorRunnable::run()
         // the run_reactor_event_loop will modify interval
         ACE_Time_Value interval(0, 100000);
 
-        if (m_Reactor->run_reactor_event_loop(interval) == -1)
+        if (reactor->run_reactor_event_loop(interval) == -1)
             break;
+
+        s_Shards[0]->SampleCpu();
+
+        // one snapshot for the connections opened and closed since the last pass,
+        // closed connections are freed once no broadcast can reach them
+        sSocketConnectorRegistry->Update();
+        sSocketConnectorTokens->Update();
+        sSocketConnectorAdmission->Update();
+
+        if (time(NULL) >= nextStats)
+        {
+            nextStats = time(NULL) + SOCKET_CONNECTOR_STATS_INTERVAL;
+            LogStats();
+        }
     }
 
+    acceptor.close();
+    listener.close();
+    sSocketConnectorEventBus->Stop();
+    // the shards' reactors, timer wheels and rings must outlive every connection on them
+    CloseConnections();
+    StopShards();
+    sSocketConnectorFanout->Stop();
+    sSocketConnectorAuth->Stop();
+
     sLog->outDebug(LOG_FILTER_WORLDSERVER, "Trinity Socket Connector thread exiting");
 }
@@ -25,6 +25,54 @@
 #include "Common.h"
 
 #include <ace/Reactor.h>
+#include <ace/Task.h>
+#include <ace/Atomic_Op.h>
+#include <ace/Thread_Mutex.h>
+#include <vector>
+
+class SocketConnectorUring;
+class SocketConnectorTimerWheel;
+
+/// One reactor of the web chat connector and the connections pinned to it.
+/// Shard 0 is driven by the connector thread, every other shard by a thread of its own.
+/// With SocketConnector.Engine = 1 the socket I/O of the shard goes through an io_uring
+/// engine that the reactor drives.
+class SocketConnectorShard : protected ACE_Task_Base
+{
+public:
+    explicit SocketConnectorShard(uint32 index);
+    virtual ~SocketConnectorShard();
+
+    int Start();
+    void Stop();
+    void Wait() { ACE_Task_Base::wait(); }
+
+    uint32 GetIndex() const { return m_Index; }
+    ACE_Reactor* GetReactor() { return m_Reactor; }
+    /// NULL with the reactor engine
+    SocketConnectorUring* GetUring() { return m_Uring; }
+    /// Login deadlines and keepalives of the shard's connections
+    SocketConnectorTimerWheel* GetTimers() { return m_Timers; }
+
+    long GetConnections() { return m_Connections.value(); }
+    void AddConnection() { ++m_Connections; }
+    void RemoveConnection() { --m_Connections; }
+
+    /// Called by the thread driving the shard, CPU time of that thread in microseconds
+    void SampleCpu();
+    uint64 GetCpuTime() { return m_CpuTime.value(); }
+
+protected:
+    virtual int svc();
+
+private:
+    uint32 m_Index;
+    ACE_Reactor* m_Reactor;
+    SocketConnectorUring* m_Uring;
+    SocketConnectorTimerWheel* m_Timers;
+    ACE_Atomic_Op<ACE_Thread_Mutex, long> m_Connections;
+    ACE_Atomic_Op<ACE_Thread_Mutex, uint64> m_CpuTime;
+};
 
 class SocketConnectorRunnable : public ACE_Based::Runnable
 {
@@ -33,9 +81,23 @@ public:
     virtual ~SocketConnectorRunnable();
     void run();
 
+    /// Shard with the fewest connections, called by SocketConnector::open on the accepting thread
+    static SocketConnectorShard* PickShard();
+
 private:
-    ACE_Reactor* m_Reactor;
+    void LogStats();
+    /// Closes every connection on its shard thread and waits until the registry destroyed them
+    void CloseConnections();
+    void StopShards();
+
+    /// Totals at the previous statistics line
+    uint64 m_StatsFrames;
+    uint64 m_StatsSyscalls;
+    uint64 m_StatsCpuTime;
+
+    typedef std::vector<SocketConnectorShard*> ShardList;
 
+    static ShardList s_Shards;
 };
 
 #endif /* _TRINITY_SocketConnectorRunnable_H_ */
@@ -0,0 +1,194 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Log.h"
+#include "SocketConnectorTimerWheel.h"
+
+#include <ace/OS_NS_sys_time.h>
+
+#define TIMER_WHEEL_SPAN (uint64(1) << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+SocketConnectorTimerWheel::SocketConnectorTimerWheel(ACE_Reactor* reactor) : ACE_Event_Handler(reactor),
+    m_tick(0), m_scheduled(0), m_timerId(-1)
+{
+    for (uint32 level = 0; level < TIMER_WHEEL_LEVELS; ++level)
+    {
+        for (uint32 slot = 0; slot < TIMER_WHEEL_SLOTS; ++slot)
+        {
+            Timer& head = m_slots[level][slot];
+            head.prev = &head;
+            head.next = &head;
+        }
+    }
+}
+
+SocketConnectorTimerWheel::~SocketConnectorTimerWheel()
+{
+    Close();
+}
+
+bool SocketConnectorTimerWheel::Open()
+{
+    m_start = ACE_OS::gettimeofday();
+
+    ACE_Time_Value interval(0, TIMER_WHEEL_TICK_MS * 1000);
+    m_timerId = reactor()->schedule_timer(this, NULL, interval, interval);
+    if (m_timerId == -1)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorTimerWheel: can not schedule the wheel timer errno = %s", ACE_OS::strerror(errno));
+        return false;
+    }
+
+    return true;
+}
+
+void SocketConnectorTimerWheel::Close()
+{
+    if (m_timerId == -1)
+        return;
+
+    reactor()->cancel_timer(m_timerId);
+    m_timerId = -1;
+}
+
+void SocketConnectorTimerWheel::Schedule(Timer* timer, ACE_Event_Handler* handler, uint64 ticks)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    if (timer->IsScheduled())
+        Unlink(timer);
+    else
+        ++m_scheduled;
+
+    // the slot of the current tick is already done, the earliest expiry is the next one
+    timer->handler = handler;
+    timer->expires = m_tick + (ticks ? ticks : 1);
+    Link(timer);
+}
+
+void SocketConnectorTimerWheel::Cancel(Timer* timer)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    if (!timer->IsScheduled())
+        return;
+
+    Unlink(timer);
+    --m_scheduled;
+}
+
+void SocketConnectorTimerWheel::Link(Timer* timer)
+{
+    uint64 tick = m_tick;
+
+    // beyond the top level the timer waits in its last slot and is linked again from there
+    uint64 due = std::min(timer->expires, tick + TIMER_WHEEL_SPAN - 1);
+    uint64 delta = due > tick ? due - tick : 0;
+
+    uint32 level = 0;
+    while (level + 1 < TIMER_WHEEL_LEVELS && delta >= (uint64(1) << (TIMER_WHEEL_SLOT_BITS * (level + 1))))
+        ++level;
+
+    uint32 slot = uint32(std::max(due, tick) >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+
+    Timer& head = m_slots[level][slot];
+    timer->prev = head.prev;
+    timer->next = &head;
+    head.prev->next = timer;
+    head.prev = timer;
+}
+
+void SocketConnectorTimerWheel::Unlink(Timer* timer)
+{
+    timer->prev->next = timer->next;
+    timer->next->prev = timer->prev;
+    timer->prev = NULL;
+    timer->next = NULL;
+}
+
+void SocketConnectorTimerWheel::Cascade(uint32 level, uint32 slot)
+{
+    Timer& head = m_slots[level][slot];
+
+    while (head.next != &head)
+    {
+        Timer* timer = head.next;
+        Unlink(timer);
+        Link(timer);
+    }
+}
+
+int SocketConnectorTimerWheel::handle_timeout(const ACE_Time_Value& current_time, const void*)
+{
+    ACE_Time_Value elapsed = current_time - m_start;
+    uint64 target = uint64(elapsed.msec()) / TIMER_WHEEL_TICK_MS;
+
+    std::vector<Timer*> expired;
+
+    {
+        ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, 0);
+
+        // a late reactor catches up tick by tick, each one costs a slot
+        while (m_tick < target)
+        {
+            ++m_tick;
+
+            uint32 index = uint32(m_tick) & (TIMER_WHEEL_SLOTS - 1);
+            for (uint32 level = 1; index == 0 && level < TIMER_WHEEL_LEVELS; ++level)
+            {
+                index = uint32(m_tick >> (TIMER_WHEEL_SLOT_BITS * level)) & (TIMER_WHEEL_SLOTS - 1);
+                Cascade(level, index);
+            }
+
+            Timer& head = m_slots[0][uint32(m_tick) & (TIMER_WHEEL_SLOTS - 1)];
+            while (head.next != &head)
+            {
+                Timer* timer = head.next;
+                Unlink(timer);
+
+                if (timer->expires > m_tick)
+                {
+                    Link(timer);
+                    continue;
+                }
+
+                --m_scheduled;
+                expired.push_back(timer);
+            }
+        }
+    }
+
+    // handlers run unlocked and may schedule again; timers are only touched by the shard thread
+    // once their owner is open, so nothing cancels an expired timer before its call
+    for (size_t i = 0; i < expired.size(); ++i)
+    {
+        Timer* timer = expired[i];
+        if (timer->IsScheduled())
+            continue;
+
+        ACE_Event_Handler* handler = timer->handler;
+        if (handler->handle_timeout(current_time, timer) == -1)
+            handler->handle_close(ACE_INVALID_HANDLE, ACE_Event_Handler::TIMER_MASK);
+    }
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorTimerWheel_H
+#define _SocketConnectorTimerWheel_H
+
+#include "Common.h"
+
+#include <ace/Event_Handler.h>
+#include <ace/Reactor.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Time_Value.h>
+
+#define TIMER_WHEEL_TICK_MS 250                             // resolution of every connection timeout
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_SLOT_BITS 6
+#define TIMER_WHEEL_SLOTS (1 << TIMER_WHEEL_SLOT_BITS)
+
+/// Connection timeouts of one shard.
+/// Four levels of 64 slots cover 16 s, 17 min, 18 h and 48 days at 250 ms per tick.
+/// Scheduling and cancelling unlink or link one intrusive node; a tick only looks at
+/// the slot that comes due and, every 64 ticks, spreads one slot of the level above
+/// over the one below. The shard reactor drives the wheel with a single periodic
+/// timer, expired timers call handle_timeout of their handler with the timer as act,
+/// and handle_close follows when it returns -1, as with reactor timers.
+class SocketConnectorTimerWheel : public ACE_Event_Handler
+{
+    public:
+        /// Embedded in the owner, one pending expiry at a time
+        struct Timer
+        {
+            Timer() : handler(NULL), expires(0), prev(NULL), next(NULL) { }
+
+            bool IsScheduled() const { return next != NULL; }
+
+            ACE_Event_Handler* handler;
+            uint64 expires;                                 // tick
+            Timer* prev;
+            Timer* next;
+        };
+
+        explicit SocketConnectorTimerWheel(ACE_Reactor* reactor);
+        ~SocketConnectorTimerWheel();
+
+        bool Open();
+        void Close();
+
+        /// Any thread. Replaces a pending expiry of the timer.
+        void Schedule(Timer* timer, ACE_Event_Handler* handler, uint64 ticks);
+        void Cancel(Timer* timer);
+
+        /// Ticks since the wheel was opened
+        uint64 GetTick() const { return m_tick; }
+        static uint64 SecondsToTicks(uint32 seconds) { return uint64(seconds) * 1000 / TIMER_WHEEL_TICK_MS; }
+
+        uint32 GetScheduled() const { return m_scheduled; }
+
+        /// Driven by the reactor
+        virtual int handle_timeout(const ACE_Time_Value& current_time, const void* act = 0);
+
+    private:
+        void Link(Timer* timer);
+        static void Unlink(Timer* timer);
+        /// Moves the timers of a slot down to where they belong now
+        void Cascade(uint32 level, uint32 slot);
+
+        ACE_Thread_Mutex m_lock;
+        Timer m_slots[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];   // list heads
+        volatile uint64 m_tick;
+        uint32 m_scheduled;
+        ACE_Time_Value m_start;
+        long m_timerId;
+};
+
+#endif
+/// @}
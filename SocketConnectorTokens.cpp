@@ -0,0 +1,208 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "Util.h"
+#include "SocketConnectorTokens.h"
+#include "SocketConnectorModeration.h"
+#include "SocketConnectorCharacters.h"
+
+#include <openssl/rand.h>
+#include <openssl/hmac.h>
+#include <openssl/evp.h>
+#include <sstream>
+
+#define TOKEN_UPDATE_INTERVAL 10                            // seconds between expiry sweeps
+
+SocketConnectorTokens::SocketConnectorTokens() : m_ttl(0), m_nextUpdate(0), m_keyValid(false)
+{
+    // a fresh key per start, tokens of the previous run are useless anyway
+    m_keyValid = RAND_bytes(m_key, SOCKET_CONNECTOR_TOKEN_KEY_SIZE) == 1;
+}
+
+void SocketConnectorTokens::LoadConfig()
+{
+    m_ttl = ConfigMgr::GetIntDefault("SocketConnector.ResumeTokenTTL", 300);
+
+    if (m_ttl && !m_keyValid)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorTokens: no random source for the signing key, session resume disabled");
+        m_ttl = 0;
+    }
+}
+
+std::string SocketConnectorTokens::Sign(std::string const& nonce, ResumeState const& state) const
+{
+    std::ostringstream ss;
+    ss << nonce << '.' << state.accountId << '.' << state.playerGuid;
+    std::string data = ss.str();
+
+    uint8 digest[EVP_MAX_MD_SIZE];
+    unsigned int length = 0;
+    HMAC(EVP_sha1(), m_key, SOCKET_CONNECTOR_TOKEN_KEY_SIZE, (uint8 const*)data.c_str(), data.length(), digest, &length);
+
+    return ByteArrayToHexStr(digest, length);
+}
+
+std::string SocketConnectorTokens::Issue(ResumeState const& state, std::string& nonce)
+{
+    nonce.clear();
+
+    if (!m_ttl)
+        return "";
+
+    uint8 random[SOCKET_CONNECTOR_TOKEN_NONCE_SIZE];
+    if (RAND_bytes(random, SOCKET_CONNECTOR_TOKEN_NONCE_SIZE) != 1)
+        return "";
+
+    nonce = ByteArrayToHexStr(random, SOCKET_CONNECTOR_TOKEN_NONCE_SIZE);
+
+    Entry entry;
+    entry.state = state;
+    entry.expires = 0;
+
+    std::ostringstream token;
+    token << nonce << '.' << Sign(nonce, state);
+
+    // released when the token is redeemed, revoked or expires
+    sSocketConnectorModeration->Acquire(state.accountId, 0, false);
+    sSocketConnectorCharacters->Acquire(state.accountId, NULL);
+
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, "");
+    m_entries[nonce] = entry;
+
+    return token.str();
+}
+
+bool SocketConnectorTokens::Redeem(std::string const& token, ResumeState& state)
+{
+    std::string::size_type separator = token.find('.');
+    if (separator == std::string::npos)
+        return false;
+
+    std::string nonce = token.substr(0, separator);
+    std::string mac = token.substr(separator + 1);
+
+    ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_lock, false);
+
+    EntryMap::iterator itr = m_entries.find(nonce);
+    if (itr == m_entries.end())
+        return false;
+
+    Entry const& entry = itr->second;
+
+    std::string expected = Sign(nonce, entry.state);
+    if (expected.length() != mac.length())
+        return false;
+
+    // compare in constant time, the token arrives from an untrusted client
+    uint8 diff = 0;
+    for (size_t i = 0; i < mac.length(); ++i)
+        diff |= uint8(expected[i] ^ mac[i]);
+
+    if (diff)
+        return false;
+
+    // a connected session is taken over, see SocketConnector::handle_resume_line
+    if (entry.expires && entry.expires <= time(NULL))
+    {
+        sSocketConnectorModeration->Release(entry.state.accountId);
+        sSocketConnectorCharacters->Release(entry.state.accountId);
+        m_entries.erase(itr);
+        return false;
+    }
+
+    state = entry.state;
+    m_entries.erase(itr);
+    return true;
+}
+
+void SocketConnectorTokens::Revoke(std::string const& nonce)
+{
+    if (nonce.empty())
+        return;
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    EntryMap::iterator itr = m_entries.find(nonce);
+    if (itr == m_entries.end())
+        return;
+
+    sSocketConnectorModeration->Release(itr->second.state.accountId);
+    sSocketConnectorCharacters->Release(itr->second.state.accountId);
+    m_entries.erase(itr);
+}
+
+void SocketConnectorTokens::Drop(std::string const& nonce)
+{
+    if (nonce.empty())
+        return;
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    // redeemed by a resume that took the session over
+    EntryMap::iterator itr = m_entries.find(nonce);
+    if (itr != m_entries.end() && !itr->second.expires)
+        itr->second.expires = time(NULL) + m_ttl;
+}
+
+void SocketConnectorTokens::SetGuild(uint64 playerGuid, uint32 guildId)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    for (EntryMap::iterator itr = m_entries.begin(); itr != m_entries.end(); ++itr)
+        if (itr->second.state.playerGuid == playerGuid)
+            itr->second.state.guildId = guildId;
+}
+
+void SocketConnectorTokens::DisbandGuild(uint32 guildId)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    for (EntryMap::iterator itr = m_entries.begin(); itr != m_entries.end(); ++itr)
+        if (itr->second.state.guildId == guildId)
+            itr->second.state.guildId = 0;
+}
+
+void SocketConnectorTokens::Update()
+{
+    time_t now = time(NULL);
+    if (now < m_nextUpdate)
+        return;
+
+    m_nextUpdate = now + TOKEN_UPDATE_INTERVAL;
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_lock);
+
+    for (EntryMap::iterator itr = m_entries.begin(); itr != m_entries.end();)
+    {
+        if (itr->second.expires && itr->second.expires <= now)
+        {
+            sSocketConnectorModeration->Release(itr->second.state.accountId);
+            sSocketConnectorCharacters->Release(itr->second.state.accountId);
+            m_entries.erase(itr++);
+        }
+        else
+            ++itr;
+    }
+}
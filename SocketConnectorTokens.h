@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorTokens_H
+#define _SocketConnectorTokens_H
+
+#include "Common.h"
+#include "UnorderedMap.h"
+
+#include <ace/Singleton.h>
+#include <ace/Null_Mutex.h>
+#include <ace/Thread_Mutex.h>
+
+#define SOCKET_CONNECTOR_TOKEN_KEY_SIZE 32
+#define SOCKET_CONNECTOR_TOKEN_NONCE_SIZE 16
+
+/// Resume tokens of web chat sessions.
+/// A token is issued once a character is selected and lets a client that lost
+/// its connection log in again with a single line. The session state is kept
+/// in memory, the token only names it: "<nonce>.<hmac>" where the HMAC-SHA1
+/// covers nonce, account and character under a key that is generated at
+/// startup. The token does not expire while its session is connected, the TTL
+/// starts when the connection drops. Every token is single use, resuming
+/// issues a new one.
+class SocketConnectorTokens
+{
+    friend class ACE_Singleton<SocketConnectorTokens, ACE_Null_Mutex>;
+
+    public:
+        struct ResumeState
+        {
+            uint32 accountId;
+            uint64 playerGuid;
+            std::string playerName;
+            uint32 guildId;
+            uint8 faction;
+        };
+
+        /// Reads SocketConnector.ResumeTokenTTL, 0 disables resuming
+        void LoadConfig();
+        bool IsEnabled() const { return m_ttl != 0; }
+
+        /// Returns an empty string when resuming is disabled.
+        /// The token holds a SocketConnectorModeration reference of the account
+        /// so mute and ban changes made while the client is away are not lost.
+        std::string Issue(ResumeState const& state, std::string& nonce);
+
+        /// Consumes the token. On success the token's moderation reference is
+        /// handed over to the caller.
+        bool Redeem(std::string const& token, ResumeState& state);
+
+        /// The client logged out, the token must not bring the session back
+        void Revoke(std::string const& nonce);
+
+        /// The connection holding the token closed, its TTL starts now
+        void Drop(std::string const& nonce);
+
+        /// Guild changes of characters that are away, see SocketConnectorRegistry::SetGuild
+        void SetGuild(uint64 playerGuid, uint32 guildId);
+        void DisbandGuild(uint32 guildId);
+
+        /// Drops expired tokens, called from the connector thread
+        void Update();
+
+    private:
+        SocketConnectorTokens();
+        ~SocketConnectorTokens() { }
+
+        struct Entry
+        {
+            ResumeState state;
+            time_t expires;                                 // 0 while the session is connected
+        };
+
+        typedef UNORDERED_MAP<std::string, Entry> EntryMap;
+
+        std::string Sign(std::string const& nonce, ResumeState const& state) const;
+
+        ACE_Thread_Mutex m_lock;
+        EntryMap m_entries;
+        uint8 m_key[SOCKET_CONNECTOR_TOKEN_KEY_SIZE];
+        uint32 m_ttl;
+        time_t m_nextUpdate;
+        bool m_keyValid;
+};
+
+#define sSocketConnectorTokens ACE_Singleton<SocketConnectorTokens, ACE_Null_Mutex>::instance()
+
+#endif
+/// @}
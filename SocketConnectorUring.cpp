@@ -0,0 +1,590 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "Log.h"
+#include "SocketConnectorUring.h"
+#include "SocketConnector.h"
+
+#include <algorithm>
+
+bool SocketConnectorUring::s_enabled = false;
+uint32 SocketConnectorUring::s_entries = 256;
+uint32 SocketConnectorUring::s_bufferCount = 256;
+uint32 SocketConnectorUring::s_bufferSize = 4096;
+uint32 SocketConnectorUring::s_zeroCopyBytes = 32 * 1024;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint64> SocketConnectorUring::s_totalSyscalls;
+ACE_Atomic_Op<ACE_Thread_Mutex, uint64> SocketConnectorUring::s_totalZeroCopySends;
+
+void SocketConnectorUring::LoadConfig()
+{
+    // 0 - ACE reactor, 1 - io_uring
+    s_enabled = ConfigMgr::GetIntDefault("SocketConnector.Engine", 0) == 1;
+
+    s_entries = ConfigMgr::GetIntDefault("SocketConnector.IoUring.Entries", 256);
+    if (s_entries < 32)
+        s_entries = 32;
+
+    // the kernel takes at most 32768 provided buffers per group
+    s_bufferCount = std::min<uint32>(ConfigMgr::GetIntDefault("SocketConnector.IoUring.Buffers", 256), 32768);
+    if (s_bufferCount < 16)
+        s_bufferCount = 16;
+
+    s_bufferSize = ConfigMgr::GetIntDefault("SocketConnector.IoUring.BufferSize", 4096);
+    if (s_bufferSize < 512)
+        s_bufferSize = 512;
+
+    s_zeroCopyBytes = ConfigMgr::GetIntDefault("SocketConnector.IoUring.ZeroCopyBytes", 32 * 1024);
+
+#ifndef SOCKET_CONNECTOR_IO_URING
+    if (s_enabled)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnector.Engine = 1 needs a worldserver built with SOCKET_CONNECTOR_IO_URING, using the reactor");
+        s_enabled = false;
+    }
+#endif
+}
+
+#ifdef SOCKET_CONNECTOR_IO_URING
+
+#include <liburing.h>
+#include <sys/eventfd.h>
+
+#define URING_BUFFER_GROUP 0
+#define MAX_URING_IOV 64                                    // SocketConnector gathers at most MAX_WRITE_IOV frames
+#define MAX_URING_CQES 64                                   // completions taken per peek
+
+struct SocketConnectorUring::Link
+{
+    explicit Link(SocketConnector* c) : conn(c), ops(0), sendResult(0), receiving(false), held(false), detached(false)
+    {
+        memset(&msg, 0, sizeof(msg));
+    }
+
+    SocketConnector* conn;
+    iovec iov[MAX_URING_IOV];                               // the send in the ring, stays valid until it completes
+    msghdr msg;
+    uint32 ops;                                             // operations in the ring
+    int sendResult;                                         // zero copy: bytes sent, reported with the notification
+    bool receiving;                                         // multishot recv armed
+    bool held;                                              // login in the auth pipeline, do not rearm
+    bool detached;                                          // connection closed
+};
+
+/// Links are at least 8 byte aligned, the operation lives in the low bits of the user data
+static inline uint64 MakeUserData(void* link, uint32 op)
+{
+    return uint64(uintptr_t(link)) | op;
+}
+
+SocketConnectorUring::SocketConnectorUring(ACE_Reactor* reactor) : ACE_Event_Handler(reactor),
+    m_EventFd(ACE_INVALID_HANDLE), m_Ring(NULL), m_BufRing(NULL), m_Buffers(NULL), m_BufferCount(0),
+    m_Listener(ACE_INVALID_HANDLE), m_Dispatching(false), m_Notified(false)
+{
+}
+
+SocketConnectorUring::~SocketConnectorUring()
+{
+    Close();
+}
+
+bool SocketConnectorUring::Open()
+{
+    m_Ring = new io_uring;
+
+    int ret = io_uring_queue_init(s_entries, m_Ring, 0);
+    if (ret < 0)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorUring: io_uring_queue_init failed: %s, using the reactor", strerror(-ret));
+        delete m_Ring;
+        m_Ring = NULL;
+        return false;
+    }
+
+    // multishot recv and zero copy sendmsg arrived with 6.0 and 6.1
+    io_uring_probe* probe = io_uring_get_probe_ring(m_Ring);
+    bool supported = probe && io_uring_opcode_supported(probe, IORING_OP_SENDMSG_ZC);
+    if (probe)
+        io_uring_free_probe(probe);
+
+    if (!supported)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorUring: the kernel lacks multishot recv or zero copy sends (Linux 6.1 needed), using the reactor");
+        Close();
+        return false;
+    }
+
+    // the provided buffer ring size must be a power of two
+    m_BufferCount = 1;
+    while (m_BufferCount < s_bufferCount)
+        m_BufferCount <<= 1;
+
+    m_BufRing = io_uring_setup_buf_ring(m_Ring, m_BufferCount, URING_BUFFER_GROUP, 0, &ret);
+    if (!m_BufRing)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorUring: io_uring_setup_buf_ring failed: %s, using the reactor", strerror(-ret));
+        Close();
+        return false;
+    }
+
+    m_Buffers = new char[size_t(m_BufferCount) * s_bufferSize];
+    for (uint32 id = 0; id < m_BufferCount; ++id)
+        io_uring_buf_ring_add(m_BufRing, m_Buffers + size_t(id) * s_bufferSize, s_bufferSize, id, io_uring_buf_ring_mask(m_BufferCount), id);
+    io_uring_buf_ring_advance(m_BufRing, m_BufferCount);
+
+    // completions wake the shard reactor through the eventfd
+    m_EventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_EventFd == ACE_INVALID_HANDLE || io_uring_register_eventfd(m_Ring, m_EventFd) < 0 ||
+        reactor()->register_handler(this, ACE_Event_Handler::READ_MASK) == -1)
+    {
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorUring: unable to register the completion eventfd: %s, using the reactor", ACE_OS::strerror(errno));
+        Close();
+        return false;
+    }
+
+    return true;
+}
+
+void SocketConnectorUring::Close()
+{
+    if (!m_Ring)
+        return;
+
+    if (m_EventFd != ACE_INVALID_HANDLE)
+    {
+        reactor()->remove_handler(this, ACE_Event_Handler::ALL_EVENTS_MASK | ACE_Event_Handler::DONT_CALL);
+        reactor()->purge_pending_notifications(this);
+        ACE_OS::close(m_EventFd);
+        m_EventFd = ACE_INVALID_HANDLE;
+    }
+
+    if (m_BufRing)
+    {
+        io_uring_free_buf_ring(m_Ring, m_BufRing, m_BufferCount, URING_BUFFER_GROUP);
+        m_BufRing = NULL;
+    }
+
+    // cancels whatever is still in flight
+    io_uring_queue_exit(m_Ring);
+    delete m_Ring;
+    m_Ring = NULL;
+
+    delete[] m_Buffers;
+    m_Buffers = NULL;
+}
+
+io_uring_sqe* SocketConnectorUring::GetSqe()
+{
+    io_uring_sqe* sqe = io_uring_get_sqe(m_Ring);
+    if (sqe)
+        return sqe;
+
+    // the submission queue is full, hand it to the kernel first
+    Submit();
+
+    sqe = io_uring_get_sqe(m_Ring);
+    if (!sqe)
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorUring: submission queue full, raise SocketConnector.IoUring.Entries");
+
+    return sqe;
+}
+
+void SocketConnectorUring::Submit()
+{
+    if (!io_uring_sq_ready(m_Ring))
+        return;
+
+    ++s_totalSyscalls;
+
+    int ret = io_uring_submit(m_Ring);
+    if (ret < 0)
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorUring: io_uring_submit failed: %s", strerror(-ret));
+}
+
+bool SocketConnectorUring::Listen(ACE_HANDLE listener)
+{
+    m_Listener = listener;
+
+    if (!ArmAccept())
+        return false;
+
+    Submit();
+    return true;
+}
+
+bool SocketConnectorUring::ArmAccept()
+{
+    io_uring_sqe* sqe = GetSqe();
+    if (!sqe)
+        return false;
+
+    io_uring_prep_multishot_accept(sqe, m_Listener, NULL, NULL, SOCK_CLOEXEC);
+    io_uring_sqe_set_data64(sqe, OP_ACCEPT);
+    return true;
+}
+
+bool SocketConnectorUring::ArmRecv(Link* link)
+{
+    io_uring_sqe* sqe = GetSqe();
+    if (!sqe)
+        return false;
+
+    // the kernel picks a buffer of the group when data arrives, idle connections hold none
+    io_uring_prep_recv_multishot(sqe, link->conn->get_handle(), NULL, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    io_uring_sqe_set_data64(sqe, MakeUserData(link, OP_RECV));
+
+    link->receiving = true;
+    ++link->ops;
+
+    if (!m_Dispatching)
+        Submit();
+
+    return true;
+}
+
+void SocketConnectorUring::Cancel(Link* link, Operation op)
+{
+    io_uring_sqe* sqe = GetSqe();
+    if (!sqe)
+        return;
+
+    io_uring_prep_cancel64(sqe, MakeUserData(link, op), 0);
+    io_uring_sqe_set_data64(sqe, OP_NONE);
+
+    if (!m_Dispatching)
+        Submit();
+}
+
+void SocketConnectorUring::Notify()
+{
+    // called with m_PostLock held, one notification covers everything posted until it runs
+    if (m_Notified)
+        return;
+
+    m_Notified = true;
+    reactor()->notify(this, ACE_Event_Handler::EXCEPT_MASK);
+}
+
+void SocketConnectorUring::Adopt(SocketConnector* conn)
+{
+    conn->m_UringLink = new Link(conn);
+
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_PostLock);
+    m_Adopted.push_back(conn);
+    Notify();
+}
+
+void SocketConnectorUring::RequestOutput(SocketConnector* conn)
+{
+    ACE_GUARD(ACE_Thread_Mutex, guard, m_PostLock);
+    m_Writable.push_back(conn);
+    Notify();
+}
+
+bool SocketConnectorUring::HoldInput(SocketConnector* conn, bool hold)
+{
+    Link* link = conn->m_UringLink;
+    link->held = hold;
+
+    if (hold)
+    {
+        // bytes already in flight still arrive, the connection keeps them aside
+        if (link->receiving)
+            Cancel(link, OP_RECV);
+
+        return true;
+    }
+
+    // a recv that is still being cancelled is rearmed by OnRecv
+    if (link->receiving)
+        return true;
+
+    return ArmRecv(link);
+}
+
+bool SocketConnectorUring::Send(SocketConnector* conn, const iovec* iov, int count, size_t bytes)
+{
+    Link* link = conn->m_UringLink;
+
+    io_uring_sqe* sqe = GetSqe();
+    if (!sqe)
+        return false;
+
+    memcpy(link->iov, iov, sizeof(iovec) * count);
+    link->msg.msg_iov = link->iov;
+    link->msg.msg_iovlen = count;
+
+    // pinning the pages only pays off for large sends, the buffers stay busy until the notification
+    if (s_zeroCopyBytes && bytes >= s_zeroCopyBytes)
+    {
+        io_uring_prep_sendmsg_zc(sqe, conn->get_handle(), &link->msg, MSG_NOSIGNAL);
+        ++s_totalZeroCopySends;
+    }
+    else
+        io_uring_prep_sendmsg(sqe, conn->get_handle(), &link->msg, MSG_NOSIGNAL);
+
+    io_uring_sqe_set_data64(sqe, MakeUserData(link, OP_SEND));
+    ++link->ops;
+
+    if (!m_Dispatching)
+        Submit();
+
+    return true;
+}
+
+void SocketConnectorUring::Detach(SocketConnector* conn)
+{
+    Link* link = conn->m_UringLink;
+
+    {
+        ACE_GUARD(ACE_Thread_Mutex, guard, m_PostLock);
+        m_Adopted.erase(std::remove(m_Adopted.begin(), m_Adopted.end(), conn), m_Adopted.end());
+        m_Writable.erase(std::remove(m_Writable.begin(), m_Writable.end(), conn), m_Writable.end());
+    }
+
+    link->detached = true;
+
+    // a send to a client that stopped reading would never complete
+    if (link->receiving)
+        Cancel(link, OP_RECV);
+    if (link->ops > (link->receiving ? 1u : 0u))
+        Cancel(link, OP_SEND);
+
+    if (link->ops == 0)
+        Release(link);
+}
+
+void SocketConnectorUring::Release(Link* link)
+{
+    SocketConnector* conn = link->conn;
+    conn->m_UringLink = NULL;
+    delete link;
+
+    conn->uring_detached();
+}
+
+void SocketConnectorUring::Fail(Link* link)
+{
+    // handle_close detaches the connection
+    link->conn->handle_close();
+}
+
+void SocketConnectorUring::RecycleBuffer(uint32 id)
+{
+    io_uring_buf_ring_add(m_BufRing, m_Buffers + size_t(id) * s_bufferSize, s_bufferSize, id, io_uring_buf_ring_mask(m_BufferCount), 0);
+    io_uring_buf_ring_advance(m_BufRing, 1);
+}
+
+int SocketConnectorUring::handle_exception(ACE_HANDLE)
+{
+    std::vector<SocketConnector*> adopted, writable;
+
+    {
+        ACE_GUARD_RETURN(ACE_Thread_Mutex, guard, m_PostLock, 0);
+        m_Notified = false;
+        adopted.swap(m_Adopted);
+        writable.swap(m_Writable);
+    }
+
+    // everything posted since the last notification goes into one submit
+    m_Dispatching = true;
+
+    for (std::vector<SocketConnector*>::const_iterator itr = adopted.begin(); itr != adopted.end(); ++itr)
+    {
+        Link* link = (*itr)->m_UringLink;
+        if (link && !link->detached && !ArmRecv(link))
+            Fail(link);
+    }
+
+    for (std::vector<SocketConnector*>::const_iterator itr = writable.begin(); itr != writable.end(); ++itr)
+    {
+        Link* link = (*itr)->m_UringLink;
+        if (link && !link->detached && (*itr)->uring_output() == -1)
+            Fail(link);
+    }
+
+    m_Dispatching = false;
+    Submit();
+    return 0;
+}
+
+int SocketConnectorUring::handle_input(ACE_HANDLE)
+{
+    uint64 value;
+    if (ACE_OS::read(m_EventFd, &value, sizeof(value)) > 0)
+        ++s_totalSyscalls;
+
+    Reap();
+    return 0;
+}
+
+void SocketConnectorUring::Reap()
+{
+    m_Dispatching = true;
+
+    io_uring_cqe* cqes[MAX_URING_CQES];
+    unsigned count;
+
+    while ((count = io_uring_peek_batch_cqe(m_Ring, cqes, MAX_URING_CQES)) > 0)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            uint64 data = io_uring_cqe_get_data64(cqes[i]);
+            Link* link = (Link*)uintptr_t(data & ~uint64(3));
+
+            switch (data & 3)
+            {
+                case OP_ACCEPT:
+                    OnAccept(cqes[i]->res, cqes[i]->flags);
+                    break;
+                case OP_RECV:
+                    OnRecv(link, cqes[i]->res, cqes[i]->flags);
+                    break;
+                case OP_SEND:
+                    OnSend(link, cqes[i]->res, cqes[i]->flags);
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        io_uring_cq_advance(m_Ring, count);
+    }
+
+    // rearmed recvs and follow-up sends of the whole batch
+    m_Dispatching = false;
+    Submit();
+}
+
+void SocketConnectorUring::OnAccept(int result, uint32 flags)
+{
+    if (result >= 0)
+    {
+        // what ACE_Acceptor does for the reactor engine
+        SocketConnector* conn = new SocketConnector();
+        conn->peer().set_handle(ACE_HANDLE(result));
+
+        if (conn->open() == -1)
+            conn->close(0);
+    }
+    else
+        sLog->outError(LOG_FILTER_WORLDSERVER, "SocketConnectorUring: accept failed: %s", strerror(-result));
+
+    // the kernel ends a multishot accept on errors
+    if (!(flags & IORING_CQE_F_MORE))
+        ArmAccept();
+}
+
+void SocketConnectorUring::OnRecv(Link* link, int result, uint32 flags)
+{
+    bool failed = false;
+
+    if (flags & IORING_CQE_F_BUFFER)
+    {
+        uint32 id = flags >> IORING_CQE_BUFFER_SHIFT;
+
+        // the connection copies what it needs, the buffer goes straight back to the kernel
+        if (result > 0 && !link->detached && link->conn->handle_received(m_Buffers + size_t(id) * s_bufferSize, size_t(result)) == -1)
+            failed = true;
+
+        RecycleBuffer(id);
+    }
+
+    if (!(flags & IORING_CQE_F_MORE))
+    {
+        link->receiving = false;
+        --link->ops;
+
+        if (link->detached)
+        {
+            if (link->ops == 0)
+                Release(link);
+            return;
+        }
+
+        // 0 is EOF; ENOBUFS only means every buffer was taken for a moment
+        if (result == 0 || (result < 0 && result != -ECANCELED && result != -ENOBUFS))
+            failed = true;
+        else if (!failed && !link->held && !ArmRecv(link))
+            failed = true;
+    }
+
+    if (failed && !link->detached)
+        Fail(link);
+}
+
+void SocketConnectorUring::OnSend(Link* link, int result, uint32 flags)
+{
+    if (flags & IORING_CQE_F_NOTIF)
+    {
+        // zero copy: the kernel released the pages, report the send now
+        result = link->sendResult;
+    }
+    else if (flags & IORING_CQE_F_MORE)
+    {
+        // zero copy: the buffers stay busy until the notification
+        link->sendResult = result;
+        return;
+    }
+
+    --link->ops;
+
+    if (link->detached)
+    {
+        if (link->ops == 0)
+            Release(link);
+        return;
+    }
+
+    if (link->conn->uring_sent(result) == -1)
+        Fail(link);
+}
+
+#else
+
+struct SocketConnectorUring::Link
+{
+};
+
+SocketConnectorUring::SocketConnectorUring(ACE_Reactor* reactor) : ACE_Event_Handler(reactor),
+    m_EventFd(ACE_INVALID_HANDLE), m_Ring(NULL), m_BufRing(NULL), m_Buffers(NULL), m_BufferCount(0),
+    m_Listener(ACE_INVALID_HANDLE), m_Dispatching(false), m_Notified(false)
+{
+}
+
+SocketConnectorUring::~SocketConnectorUring() { }
+
+// LoadConfig keeps the engine disabled, nothing below is reached
+bool SocketConnectorUring::Open() { return false; }
+void SocketConnectorUring::Close() { }
+bool SocketConnectorUring::Listen(ACE_HANDLE) { return false; }
+void SocketConnectorUring::Adopt(SocketConnector*) { }
+void SocketConnectorUring::RequestOutput(SocketConnector*) { }
+bool SocketConnectorUring::HoldInput(SocketConnector*, bool) { return false; }
+bool SocketConnectorUring::Send(SocketConnector*, const iovec*, int, size_t) { return false; }
+void SocketConnectorUring::Detach(SocketConnector*) { }
+int SocketConnectorUring::handle_input(ACE_HANDLE) { return 0; }
+int SocketConnectorUring::handle_exception(ACE_HANDLE) { return 0; }
+
+#endif
@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorUring_H
+#define _SocketConnectorUring_H
+
+#include "Common.h"
+
+#include <ace/Event_Handler.h>
+#include <ace/Reactor.h>
+#include <ace/Thread_Mutex.h>
+#include <ace/Atomic_Op.h>
+#include <vector>
+
+class SocketConnector;
+struct io_uring;
+struct io_uring_buf_ring;
+struct io_uring_sqe;
+struct iovec;
+
+/// io_uring engine of one connector shard (Linux, built with SOCKET_CONNECTOR_IO_URING and liburing).
+/// The shard reactor stays the event loop: the ring signals completions through an
+/// eventfd registered with the reactor, so timers and notifications work unchanged.
+/// Connections receive with a multishot recv from a ring of provided buffers; sends
+/// requested during one reactor iteration are submitted together, and sends of at
+/// least SocketConnector.IoUring.ZeroCopyBytes go out with MSG_ZEROCOPY.
+class SocketConnectorUring : public ACE_Event_Handler
+{
+    public:
+        /// Per connection state, allocated by Adopt and freed once the ring holds no operation on it
+        struct Link;
+
+        explicit SocketConnectorUring(ACE_Reactor* reactor);
+        virtual ~SocketConnectorUring();
+
+        /// Reads SocketConnector.Engine and SocketConnector.IoUring.*, called before the shards are created
+        static void LoadConfig();
+        static bool IsEnabled() { return s_enabled; }
+
+        bool Open();
+        void Close();
+
+        /// Shard 0: multishot accept on the listen socket, new connections are opened on this thread
+        bool Listen(ACE_HANDLE listener);
+
+        /// Any thread. Receiving starts on the shard thread.
+        void Adopt(SocketConnector* conn);
+        /// Any thread, called with the connection's m_OutLock held
+        void RequestOutput(SocketConnector* conn);
+
+        /// Shard thread
+        bool HoldInput(SocketConnector* conn, bool hold);
+        /// Sends of at least SocketConnector.IoUring.ZeroCopyBytes use MSG_ZEROCOPY
+        bool Send(SocketConnector* conn, const iovec* iov, int count, size_t bytes);
+        /// The connection is closed, it is handed to the registry once its operations completed
+        void Detach(SocketConnector* conn);
+
+        virtual int handle_input(ACE_HANDLE = ACE_INVALID_HANDLE);
+        virtual int handle_exception(ACE_HANDLE = ACE_INVALID_HANDLE);
+        virtual ACE_HANDLE get_handle() const { return m_EventFd; }
+
+        /// io_uring_enter calls and eventfd reads, the engine's I/O syscalls
+        static uint64 GetTotalSyscalls() { return s_totalSyscalls.value(); }
+        static uint64 GetTotalZeroCopySends() { return s_totalZeroCopySends.value(); }
+
+    private:
+        enum Operation
+        {
+            OP_NONE     = 0,                                // cancel requests, completions are ignored
+            OP_RECV     = 1,
+            OP_SEND     = 2,
+            OP_ACCEPT   = 3
+        };
+
+        io_uring_sqe* GetSqe();
+        void Submit();
+        bool ArmAccept();
+        bool ArmRecv(Link* link);
+        void Cancel(Link* link, Operation op);
+        void Reap();
+        void OnAccept(int result, uint32 flags);
+        void OnRecv(Link* link, int result, uint32 flags);
+        void OnSend(Link* link, int result, uint32 flags);
+        void Release(Link* link);
+        void Fail(Link* link);
+        void RecycleBuffer(uint32 id);
+        void Notify();
+
+        ACE_HANDLE m_EventFd;
+        io_uring* m_Ring;
+        io_uring_buf_ring* m_BufRing;
+        char* m_Buffers;
+        uint32 m_BufferCount;
+        ACE_HANDLE m_Listener;
+        bool m_Dispatching;                                 // inside a ring callback, Submit happens once at the end
+
+        /// Work posted from other threads, drained by handle_exception
+        ACE_Thread_Mutex m_PostLock;
+        std::vector<SocketConnector*> m_Adopted;
+        std::vector<SocketConnector*> m_Writable;
+        bool m_Notified;
+
+        static bool s_enabled;
+        static uint32 s_entries;
+        static uint32 s_bufferCount;
+        static uint32 s_bufferSize;
+        static uint32 s_zeroCopyBytes;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint64> s_totalSyscalls;
+        static ACE_Atomic_Op<ACE_Thread_Mutex, uint64> s_totalZeroCopySends;
+};
+
+#endif
+/// @}
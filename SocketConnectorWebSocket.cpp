@@ -0,0 +1,558 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Log.h"
+#include "SocketConnectorWebSocket.h"
+
+#include <openssl/sha.h>
+#include <openssl/evp.h>
+#include <algorithm>
+#include <sstream>
+
+#define WEBSOCKET_GUID "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WEBSOCKET_DEFLATE_MIN_SIZE 64                       // shorter messages are sent as they are
+#define WEBSOCKET_MIN_WINDOW_BITS 9                         // zlib can not produce raw streams with a 256 byte window
+#define WEBSOCKET_CLOSE_PROTOCOL_ERROR 1002
+#define WEBSOCKET_CLOSE_INVALID_DATA 1007
+#define WEBSOCKET_CLOSE_TOO_BIG 1009
+
+static const char s_deflateTail[4] = { 0x00, 0x00, char(0xFF), char(0xFF) };
+
+static std::string Trim(const std::string& str)
+{
+    std::string::size_type begin = str.find_first_not_of(" \t");
+    if (begin == std::string::npos)
+        return "";
+
+    std::string::size_type end = str.find_last_not_of(" \t");
+    return str.substr(begin, end - begin + 1);
+}
+
+static std::string ToLower(std::string str)
+{
+    std::transform(str.begin(), str.end(), str.begin(), ::tolower);
+    return str;
+}
+
+/// Value of the comma separated header list contains the token, case insensitive
+static bool HasToken(const std::string& value, const char* token)
+{
+    std::istringstream list(ToLower(value));
+    std::string item;
+    while (std::getline(list, item, ','))
+        if (Trim(item) == token)
+            return true;
+
+    return false;
+}
+
+SocketConnectorWebSocket::SocketConnectorWebSocket(Settings const& settings, size_t maxMessage) :
+    m_settings(settings), m_maxMessage(maxMessage), m_deflate(false), m_resetDeflate(false),
+    m_resetInflate(false), m_streamsReady(false), m_fragmented(false), m_compressed(false), m_opcode(OPCODE_TEXT)
+{
+}
+
+SocketConnectorWebSocket::~SocketConnectorWebSocket()
+{
+    if (m_streamsReady)
+    {
+        deflateEnd(&m_deflateStream);
+        inflateEnd(&m_inflateStream);
+    }
+}
+
+bool SocketConnectorWebSocket::Accept(const std::string& request, std::string& response)
+{
+    std::istringstream lines(request);
+    std::string line;
+
+    std::getline(lines, line);
+    if (line.compare(0, 4, "GET ") != 0 || line.find(" HTTP/1.1") == std::string::npos)
+    {
+        response = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+        return false;
+    }
+
+    std::string upgrade, connection, key, version, extensions, origin;
+    while (std::getline(lines, line))
+    {
+        std::string::size_type colon = line.find(':');
+        if (colon == std::string::npos)
+            continue;
+
+        std::string name = ToLower(Trim(line.substr(0, colon)));
+        std::string value = Trim(line.substr(colon + 1));
+        if (!value.empty() && value[value.length() - 1] == '\r')
+            value = Trim(value.substr(0, value.length() - 1));
+
+        if (name == "upgrade")
+            upgrade = value;
+        else if (name == "connection")
+            connection = value;
+        else if (name == "sec-websocket-key")
+            key = value;
+        else if (name == "sec-websocket-version")
+            version = value;
+        else if (name == "sec-websocket-extensions")
+            extensions += extensions.empty() ? value : ", " + value;
+        else if (name == "origin")
+            origin = value;
+    }
+
+    // browsers always send the page's origin, a foreign page must not reuse the player's session
+    if (!m_settings.origins.empty() && std::find(m_settings.origins.begin(), m_settings.origins.end(), ToLower(origin)) == m_settings.origins.end())
+    {
+        response = "HTTP/1.1 403 Forbidden\r\nConnection: close\r\n\r\n";
+        return false;
+    }
+
+    if (!HasToken(upgrade, "websocket") || !HasToken(connection, "upgrade") || key.empty())
+    {
+        response = "HTTP/1.1 400 Bad Request\r\nConnection: close\r\n\r\n";
+        return false;
+    }
+
+    if (version != "13")
+    {
+        response = "HTTP/1.1 426 Upgrade Required\r\nSec-WebSocket-Version: 13\r\nConnection: close\r\n\r\n";
+        return false;
+    }
+
+    std::string accept = key + WEBSOCKET_GUID;
+    uint8 digest[SHA_DIGEST_LENGTH];
+    SHA1((const uint8*)accept.c_str(), accept.length(), digest);
+
+    char encoded[4 * ((SHA_DIGEST_LENGTH + 2) / 3) + 1];
+    EVP_EncodeBlock((uint8*)encoded, digest, SHA_DIGEST_LENGTH);
+
+    response = "HTTP/1.1 101 Switching Protocols\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
+    response += encoded;
+    response += "\r\n";
+
+    std::string accepted;
+    if (m_settings.allowDeflate && !extensions.empty() && NegotiateDeflate(extensions, accepted))
+        response += "Sec-WebSocket-Extensions: " + accepted + "\r\n";
+
+    response += "\r\n";
+    return true;
+}
+
+bool SocketConnectorWebSocket::NegotiateDeflate(const std::string& offers, std::string& accepted)
+{
+    std::istringstream list(offers);
+    std::string offer;
+
+    // the first acceptable permessage-deflate offer wins
+    while (std::getline(list, offer, ','))
+    {
+        std::istringstream params(offer);
+        std::string param;
+
+        std::getline(params, param, ';');
+        if (ToLower(Trim(param)) != "permessage-deflate")
+            continue;
+
+        bool valid = true;
+        bool resetDeflate = false, resetInflate = false;
+        int deflateBits = m_settings.windowBits;
+        int inflateBits = MAX_WBITS;
+        bool clientWindow = false;
+        accepted = "permessage-deflate";
+
+        while (valid && std::getline(params, param, ';'))
+        {
+            param = Trim(param);
+            std::string::size_type eq = param.find('=');
+            std::string name = ToLower(Trim(param.substr(0, eq)));
+            std::string value = eq == std::string::npos ? "" : Trim(param.substr(eq + 1));
+            if (value.length() >= 2 && value[0] == '"' && value[value.length() - 1] == '"')
+                value = value.substr(1, value.length() - 2);
+
+            if (name == "server_no_context_takeover" && value.empty())
+            {
+                resetDeflate = true;
+                accepted += "; server_no_context_takeover";
+            }
+            else if (name == "client_no_context_takeover" && value.empty())
+                resetInflate = true;
+            else if (name == "server_max_window_bits")
+            {
+                int bits = atoi(value.c_str());
+                if (bits < WEBSOCKET_MIN_WINDOW_BITS || bits > MAX_WBITS)
+                    valid = false;
+                else
+                    deflateBits = std::min(deflateBits, bits);
+            }
+            else if (name == "client_max_window_bits")
+            {
+                // without a value the client only says it understands the parameter
+                int bits = value.empty() ? MAX_WBITS : atoi(value.c_str());
+                if (bits < 8 || bits > MAX_WBITS)
+                    valid = false;
+                else
+                {
+                    clientWindow = true;
+                    inflateBits = bits;
+                }
+            }
+            else
+                valid = false;
+        }
+
+        if (!valid)
+            continue;
+
+        // a smaller window than the client allows is always fine for its inflater, it is announced anyway
+        if (deflateBits < MAX_WBITS)
+        {
+            std::ostringstream ss;
+            ss << "; server_max_window_bits=" << deflateBits;
+            accepted += ss.str();
+        }
+
+        // the client's window may only be limited when it offered the parameter
+        if (clientWindow)
+        {
+            inflateBits = std::min(inflateBits, m_settings.windowBits);
+
+            std::ostringstream ss;
+            ss << "; client_max_window_bits=" << inflateBits;
+            accepted += ss.str();
+        }
+
+        // a larger window than the client uses is always fine for the inflater, zlib writes 8 as 9
+        inflateBits = std::max(inflateBits, WEBSOCKET_MIN_WINDOW_BITS);
+
+        memset(&m_deflateStream, 0, sizeof(m_deflateStream));
+        memset(&m_inflateStream, 0, sizeof(m_inflateStream));
+
+        if (deflateInit2(&m_deflateStream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -deflateBits, m_settings.memLevel, Z_DEFAULT_STRATEGY) != Z_OK)
+            return false;
+
+        if (inflateInit2(&m_inflateStream, -inflateBits) != Z_OK)
+        {
+            deflateEnd(&m_deflateStream);
+            return false;
+        }
+
+        m_streamsReady = true;
+        m_deflate = true;
+        m_resetDeflate = resetDeflate;
+        m_resetInflate = resetInflate;
+        return true;
+    }
+
+    return false;
+}
+
+void SocketConnectorWebSocket::AppendFrame(std::string& out, uint8 opcode, bool compressed, const char* data, size_t length)
+{
+    // server frames are never masked
+    out += char(0x80 | (compressed ? 0x40 : 0) | opcode);
+
+    if (length < 126)
+        out += char(length);
+    else if (length <= 0xFFFF)
+    {
+        out += char(126);
+        out += char(length >> 8);
+        out += char(length & 0xFF);
+    }
+    else
+    {
+        out += char(127);
+        for (int shift = 56; shift >= 0; shift -= 8)
+            out += char((uint64(length) >> shift) & 0xFF);
+    }
+
+    out.append(data, length);
+}
+
+void SocketConnectorWebSocket::Write(const char* data, size_t length, std::string& out, uint8 opcode)
+{
+    if (!m_deflate || length < WEBSOCKET_DEFLATE_MIN_SIZE)
+    {
+        AppendFrame(out, opcode, false, data, length);
+        return;
+    }
+
+    std::string compressed;
+    compressed.resize(length + 64);
+
+    m_deflateStream.next_in = (Bytef*)data;
+    m_deflateStream.avail_in = uInt(length);
+
+    size_t produced = 0;
+    for (;;)
+    {
+        m_deflateStream.next_out = (Bytef*)&compressed[produced];
+        m_deflateStream.avail_out = uInt(compressed.size() - produced);
+
+        deflate(&m_deflateStream, Z_SYNC_FLUSH);
+        produced = compressed.size() - m_deflateStream.avail_out;
+
+        if (m_deflateStream.avail_out != 0)
+            break;
+
+        compressed.resize(compressed.size() * 2);
+    }
+
+    // RFC 7692 7.2.1: the empty stored block that ends a sync flush is not sent
+    if (produced >= 4 && memcmp(&compressed[produced - 4], s_deflateTail, 4) == 0)
+        produced -= 4;
+
+    if (m_resetDeflate)
+        deflateReset(&m_deflateStream);
+
+    AppendFrame(out, opcode, true, compressed.data(), produced);
+}
+
+bool SocketConnectorWebSocket::Inflate(const std::string& in, std::string& out)
+{
+    std::string input = in;
+    input.append(s_deflateTail, 4);
+
+    m_inflateStream.next_in = (Bytef*)&input[0];
+    m_inflateStream.avail_in = uInt(input.length());
+
+    out.clear();
+    char chunk[1024];
+    do
+    {
+        m_inflateStream.next_out = (Bytef*)chunk;
+        m_inflateStream.avail_out = sizeof(chunk);
+
+        int result = inflate(&m_inflateStream, Z_SYNC_FLUSH);
+        if (result != Z_OK && result != Z_BUF_ERROR && result != Z_STREAM_END)
+            return false;
+
+        out.append(chunk, sizeof(chunk) - m_inflateStream.avail_out);
+        if (out.length() > m_maxMessage)
+            return false;
+
+        // the message ended with a final block: the stream is over, only our empty block may follow
+        if (result == Z_STREAM_END)
+        {
+            if (m_inflateStream.avail_in > sizeof(s_deflateTail))
+                return false;
+
+            // the next message starts a new stream, with context takeover it may still refer to this one
+            std::string window;
+            uInt windowLength = 0;
+            if (!m_resetInflate)
+            {
+                window.resize(size_t(1) << MAX_WBITS);
+                if (inflateGetDictionary(&m_inflateStream, (Bytef*)&window[0], &windowLength) != Z_OK)
+                    windowLength = 0;
+            }
+
+            inflateReset(&m_inflateStream);
+            if (windowLength)
+                inflateSetDictionary(&m_inflateStream, (const Bytef*)window.data(), windowLength);
+
+            return true;
+        }
+    }
+    while (m_inflateStream.avail_in != 0 || m_inflateStream.avail_out == 0);
+
+    if (m_resetInflate)
+        inflateReset(&m_inflateStream);
+
+    return true;
+}
+
+SocketConnectorWebSocket::ReadResult SocketConnectorWebSocket::Fail(uint16 code, std::string& reply)
+{
+    char payload[2] = { char(code >> 8), char(code & 0xFF) };
+    reply.clear();
+    AppendFrame(reply, OPCODE_CLOSE, false, payload, 2);
+    return READ_CLOSE;
+}
+
+SocketConnectorWebSocket::ReadResult SocketConnectorWebSocket::Read(ACE_Message_Block& in, std::string& message, std::string& reply)
+{
+    for (;;)
+    {
+        const uint8* p = (const uint8*)in.rd_ptr();
+        size_t available = in.length();
+
+        if (available < 2)
+            return READ_MORE;
+
+        bool fin = (p[0] & 0x80) != 0;
+        bool rsv1 = (p[0] & 0x40) != 0;
+        uint8 opcode = p[0] & 0x0F;
+        uint64 length = p[1] & 0x7F;
+        size_t header = 2;
+
+        if (length == 126)
+        {
+            if (available < 4)
+                return READ_MORE;
+
+            length = (uint64(p[2]) << 8) | p[3];
+            header = 4;
+        }
+        else if (length == 127)
+        {
+            if (available < 10)
+                return READ_MORE;
+
+            length = 0;
+            for (int i = 0; i < 8; ++i)
+                length = (length << 8) | p[2 + i];
+            header = 10;
+        }
+
+        // clients must mask, RSV2/RSV3 are not negotiated, RSV1 only with deflate on the first frame
+        if (!(p[1] & 0x80) || (p[0] & 0x30) || (rsv1 && (!m_deflate || opcode == OPCODE_CONTINUATION || (opcode & 0x8))))
+            return Fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR, reply);
+
+        header += 4;
+
+        // the whole frame has to fit into the input buffer
+        if (length > in.size() - header)
+            return Fail(WEBSOCKET_CLOSE_TOO_BIG, reply);
+
+        if (available < header + length)
+            return READ_MORE;
+
+        const uint8* mask = p + header - 4;
+        char* payload = in.rd_ptr() + header;
+        for (size_t i = 0; i < length; ++i)
+            payload[i] ^= mask[i & 3];
+
+        in.rd_ptr(header + size_t(length));
+
+        if (opcode & 0x8)
+        {
+            if (!fin || length > 125)
+                return Fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR, reply);
+
+            switch (opcode)
+            {
+                case OPCODE_PING:
+                    reply.clear();
+                    AppendFrame(reply, OPCODE_PONG, false, payload, size_t(length));
+                    return READ_CONTROL;
+                case OPCODE_PONG:
+                    continue;
+                case OPCODE_CLOSE:
+                    // echo the status code and close
+                    reply.clear();
+                    AppendFrame(reply, OPCODE_CLOSE, false, payload, length >= 2 ? 2 : 0);
+                    return READ_CLOSE;
+                default:
+                    return Fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR, reply);
+            }
+        }
+
+        if (opcode == OPCODE_CONTINUATION)
+        {
+            if (!m_fragmented)
+                return Fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR, reply);
+        }
+        else if (opcode == OPCODE_TEXT || opcode == OPCODE_BINARY)
+        {
+            if (m_fragmented)
+                return Fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR, reply);
+
+            m_fragmented = true;
+            m_compressed = rsv1;
+            m_opcode = opcode;
+            m_fragments.clear();
+        }
+        else
+            return Fail(WEBSOCKET_CLOSE_PROTOCOL_ERROR, reply);
+
+        if (m_fragments.length() + length > m_maxMessage)
+            return Fail(WEBSOCKET_CLOSE_TOO_BIG, reply);
+
+        m_fragments.append(payload, size_t(length));
+
+        if (!fin)
+            continue;
+
+        m_fragmented = false;
+
+        if (m_compressed)
+        {
+            if (!Inflate(m_fragments, message))
+                return Fail(WEBSOCKET_CLOSE_INVALID_DATA, reply);
+        }
+        else
+            message.swap(m_fragments);
+
+        m_fragments.clear();
+
+        if (m_opcode == OPCODE_TEXT && !IsValidUtf8(message.data(), message.length()))
+            return Fail(WEBSOCKET_CLOSE_INVALID_DATA, reply);
+
+        return READ_MESSAGE;
+    }
+}
+
+bool SocketConnectorWebSocket::IsValidUtf8(const char* data, size_t length)
+{
+    const uint8* p = (const uint8*)data;
+    const uint8* end = p + length;
+
+    while (p < end)
+    {
+        uint8 c = *p++;
+        if (c < 0x80)
+            continue;
+
+        size_t follow;
+        uint8 min = 0x80, max = 0xBF;                       // range of the first continuation byte
+
+        if (c >= 0xC2 && c <= 0xDF)
+            follow = 1;
+        else if (c >= 0xE0 && c <= 0xEF)
+        {
+            follow = 2;
+            if (c == 0xE0)
+                min = 0xA0;                                 // overlong
+            else if (c == 0xED)
+                max = 0x9F;                                 // surrogates
+        }
+        else if (c >= 0xF0 && c <= 0xF4)
+        {
+            follow = 3;
+            if (c == 0xF0)
+                min = 0x90;                                 // overlong
+            else if (c == 0xF4)
+                max = 0x8F;                                 // above U+10FFFF
+        }
+        else
+            return false;
+
+        if (size_t(end - p) < follow || *p < min || *p > max)
+            return false;
+
+        for (++p; --follow; ++p)
+            if ((*p & 0xC0) != 0x80)
+                return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorWebSocket_H
+#define _SocketConnectorWebSocket_H
+
+#include "Common.h"
+
+#include <ace/Message_Block.h>
+#include <zlib.h>
+#include <vector>
+
+/// RFC 6455 framing of one web chat connection.
+/// A browser opens the connection with an HTTP upgrade request, afterwards every
+/// text message carries one legacy chat line. permessage-deflate (RFC 7692) is
+/// negotiated when the client offers it; the compression context is kept across
+/// messages unless the client asks for server_no_context_takeover.
+class SocketConnectorWebSocket
+{
+    public:
+        /// SocketConnector.WebSocket.* settings shared by every connection
+        struct Settings
+        {
+            Settings() : allowDeflate(true), windowBits(MAX_WBITS), memLevel(8) { }
+
+            bool allowDeflate;
+            int windowBits;                                 // largest window of both directions, 9 to 15
+            int memLevel;                                   // deflate state size, 1 to 9
+            std::vector<std::string> origins;               // allowed Origin headers, empty allows every page
+        };
+
+        enum Opcode
+        {
+            OPCODE_CONTINUATION = 0x0,
+            OPCODE_TEXT         = 0x1,
+            OPCODE_BINARY       = 0x2,
+            OPCODE_CLOSE        = 0x8,
+            OPCODE_PING         = 0x9,
+            OPCODE_PONG         = 0xA
+        };
+
+        enum ReadResult
+        {
+            READ_MORE,                                      // the next frame is incomplete
+            READ_MESSAGE,                                   // message holds a complete data message
+            READ_CONTROL,                                   // reply holds a control frame to send (pong)
+            READ_CLOSE                                      // reply holds the closing frame, close after sending it
+        };
+
+        /// settings has to outlive the connection
+        SocketConnectorWebSocket(Settings const& settings, size_t maxMessage);
+        ~SocketConnectorWebSocket();
+
+        /// Upgrade request without the terminating empty line.
+        /// Fills the HTTP response in both cases, returns false if the upgrade is refused.
+        bool Accept(const std::string& request, std::string& response);
+
+        /// Takes complete frames from the front of the buffer, payloads are unmasked in place
+        ReadResult Read(ACE_Message_Block& in, std::string& message, std::string& reply);
+
+        /// Appends a data message frame, compressed when negotiated
+        void Write(const char* data, size_t length, std::string& out, uint8 opcode = OPCODE_TEXT);
+
+        bool IsDeflateEnabled() const { return m_deflate; }
+
+        static void AppendFrame(std::string& out, uint8 opcode, bool compressed, const char* data, size_t length);
+
+        /// RFC 3629: no overlong forms, surrogates or code points above U+10FFFF
+        static bool IsValidUtf8(const char* data, size_t length);
+
+    private:
+        bool NegotiateDeflate(const std::string& offers, std::string& accepted);
+        bool Inflate(const std::string& in, std::string& out);
+        ReadResult Fail(uint16 code, std::string& reply);
+
+        Settings const& m_settings;
+        size_t m_maxMessage;
+
+        /// permessage-deflate state
+        bool m_deflate;
+        bool m_resetDeflate;                                // server_no_context_takeover
+        bool m_resetInflate;                                // client_no_context_takeover
+        z_stream m_deflateStream;
+        z_stream m_inflateStream;
+        bool m_streamsReady;
+
+        /// Fragmented message being assembled
+        std::string m_fragments;
+        bool m_fragmented;
+        bool m_compressed;
+        uint8 m_opcode;                                     // of the first frame, text messages must be UTF-8
+};
+
+#endif
+/// @}
@@ -0,0 +1,97 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "SocketConnectorLines.h"
+#include "SocketConnectorTest.h"
+
+#include <string>
+
+static size_t LineEnd(std::string const& data)
+{
+    return FindLineEnd(data.data(), data.data() + data.size()) - data.data();
+}
+
+static void TestEmpty()
+{
+    CHECK(LineEnd("") == 0);
+    CHECK(LineEnd("abc") == 3);
+}
+
+static void TestEveryPosition()
+{
+    // the word-wise scan must find a terminator at any offset and alignment
+    for (size_t length = 1; length < 40; ++length)
+    {
+        for (size_t at = 0; at < length; ++at)
+        {
+            std::string newline(length, 'x');
+            newline[at] = '\n';
+            CHECK(LineEnd(newline) == at);
+
+            std::string zero(length, 'x');
+            zero[at] = '\0';
+            CHECK(LineEnd(zero) == at);
+
+            for (size_t offset = 1; offset < 8 && offset <= at; ++offset)
+                CHECK(size_t(FindLineEnd(newline.data() + offset, newline.data() + length) - newline.data()) == at);
+        }
+
+        CHECK(LineEnd(std::string(length, 'x')) == length);
+    }
+}
+
+static void TestFirstWins()
+{
+    CHECK(LineEnd("abcdefghij\nklm\n") == 10);
+    CHECK(LineEnd(std::string("abcdefghijklmnopq\0rs\n", 22)) == 17);
+    CHECK(LineEnd("\n\n") == 0);
+}
+
+static void TestNoFalseMatch()
+{
+    // bytes next to '\n' and 0, and high bytes from UTF-8, must not match
+    std::string data;
+    for (int c = 1; c < 256; ++c)
+        if (c != '\n')
+            data += char(c);
+
+    CHECK(LineEnd(data) == data.size());
+    CHECK(LineEnd("\xd1\x82\xd0\xb5\xd1\x81\xd1\x82\x0b\x09\x0a") == 10);
+}
+
+static void TestBounds()
+{
+    // a terminator right past the end is not part of the range
+    std::string data("abcdefgh\nijklmnop\n");
+    CHECK(FindLineEnd(data.data(), data.data() + 8) == data.data() + 8);
+    CHECK(FindLineEnd(data.data() + 9, data.data() + 17) == data.data() + 17);
+}
+
+int main()
+{
+    RUN_TEST(TestEmpty);
+    RUN_TEST(TestEveryPosition);
+    RUN_TEST(TestFirstWins);
+    RUN_TEST(TestNoFalseMatch);
+    RUN_TEST(TestBounds);
+    return TEST_RESULT();
+}
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "SocketConnectorProtocol.h"
+#include "SocketConnectorTest.h"
+
+#include <string>
+
+typedef SocketConnectorProtocol Protocol;
+
+/// Queued data block as SocketConnector builds them
+static ACE_Data_Block* Block(ACE_Message_Block::ACE_Message_Type type, std::string const& data)
+{
+    ACE_Data_Block* block = new ACE_Data_Block(data.length(), type, NULL, NULL, NULL, 0, NULL);
+    memcpy(block->base(), data.data(), data.length());
+    return block;
+}
+
+static std::string Encode(ACE_Message_Block::ACE_Message_Type type, std::string const& data)
+{
+    ACE_Data_Block* block = Block(type, data);
+    std::string out;
+    Protocol::Encode(block, out);
+    block->release();
+    return out;
+}
+
+/// Checks out is exactly one frame and returns its payload
+static bool SingleFrame(std::string const& out, uint8 expectedOpcode, std::string& payload)
+{
+    uint8 opcode = 0xFF;
+    ByteView view;
+    size_t frameSize = 0;
+    if (Protocol::Peek(out.data(), out.data() + out.length(), opcode, view, frameSize) != Protocol::PEEK_FRAME)
+        return false;
+
+    payload = view.ToString();
+    return opcode == expectedOpcode && frameSize == out.length();
+}
+
+static void TestIntegers()
+{
+    std::string out;
+    Protocol::AppendUInt32(out, 0x01020304);
+    Protocol::AppendUInt8(out, 0xFE);
+    Protocol::AppendUInt32(out, 0xFFFFFFFF);
+    CHECK(out == std::string("\x01\x02\x03\x04\xFE\xFF\xFF\xFF\xFF", 9));
+
+    SocketConnectorPacketReader reader(out.data(), out.length());
+    uint32 first = 0, second = 0;
+    uint8 byte = 0;
+    CHECK(reader.ReadUInt32(first) && first == 0x01020304);
+    CHECK(reader.ReadUInt8(byte) && byte == 0xFE);
+    CHECK(reader.ReadUInt32(second) && second == 0xFFFFFFFF);
+    CHECK(reader.AtEnd());
+    CHECK(!reader.ReadUInt8(byte));
+
+    // a short read does not move the reader
+    SocketConnectorPacketReader truncated(out.data(), 3);
+    CHECK(!truncated.ReadUInt32(first));
+    CHECK(truncated.ReadUInt8(byte) && byte == 0x01);
+}
+
+static void TestStrings()
+{
+    std::string out;
+    Protocol::AppendString(out, "", 0);
+    Protocol::AppendString(out, "Thrall", 6);
+    Protocol::AppendString(out, "a\\b\0c", 5);
+    CHECK(out.compare(0, 10, std::string("\x00\x00\x00\x06Thrall", 10)) == 0);
+
+    SocketConnectorPacketReader reader(out.data(), out.length());
+    ByteView empty, name, binary;
+    CHECK(reader.ReadString(empty) && empty.length == 0);
+    CHECK(reader.ReadString(name) && name.ToString() == "Thrall");
+    CHECK(reader.ReadString(binary) && binary.ToString() == std::string("a\\b\0c", 5));
+    CHECK(reader.AtEnd());
+
+    // the length prefix must fit into the payload
+    SocketConnectorPacketReader shortString(out.data() + 2, 6);
+    CHECK(!shortString.ReadString(name));
+    SocketConnectorPacketReader noLength(out.data(), 1);
+    CHECK(!noLength.ReadString(name));
+
+    // strings are cut at 64 KiB
+    std::string longText(0x10005, 'x');
+    std::string cut;
+    Protocol::AppendString(cut, longText.data(), longText.length());
+    CHECK(cut.length() == 2 + 0xFFFF);
+    CHECK(uint8(cut[0]) == 0xFF && uint8(cut[1]) == 0xFF);
+}
+
+static void TestPeek()
+{
+    // V2_CHAT from a client: id 7, "hello"
+    std::string payload;
+    Protocol::AppendUInt32(payload, 7);
+    Protocol::AppendString(payload, "hello", 5);
+
+    std::string frames;
+    Protocol::AppendHeader(frames, V2_CHAT, payload.length());
+    frames += payload;
+    Protocol::AppendHeader(frames, V2_PING, 0);
+
+    uint8 opcode = 0;
+    ByteView view;
+    size_t frameSize = 0;
+
+    // the header is needed before the size is known
+    for (size_t i = 0; i < V2_HEADER_SIZE; ++i)
+    {
+        CHECK(Protocol::Peek(frames.data(), frames.data() + i, opcode, view, frameSize) == Protocol::PEEK_MORE);
+        CHECK(frameSize == V2_HEADER_SIZE);
+    }
+
+    CHECK(Protocol::Peek(frames.data(), frames.data() + V2_HEADER_SIZE + payload.length() - 1, opcode, view, frameSize) == Protocol::PEEK_MORE);
+    CHECK(frameSize == V2_HEADER_SIZE + payload.length());
+
+    const char* end = frames.data() + frames.length();
+    CHECK(Protocol::Peek(frames.data(), end, opcode, view, frameSize) == Protocol::PEEK_FRAME);
+    CHECK(opcode == V2_CHAT && frameSize == V2_HEADER_SIZE + payload.length());
+
+    SocketConnectorPacketReader reader(view.data, view.length);
+    uint32 id = 0;
+    ByteView message;
+    CHECK(reader.ReadUInt32(id) && id == 7);
+    CHECK(reader.ReadString(message) && message.ToString() == "hello");
+    CHECK(reader.AtEnd());
+
+    // the next frame follows directly
+    CHECK(Protocol::Peek(frames.data() + frameSize, end, opcode, view, frameSize) == Protocol::PEEK_FRAME);
+    CHECK(opcode == V2_PING && view.length == 0 && frameSize == V2_HEADER_SIZE);
+
+    // a huge length is reported, the caller refuses it
+    std::string huge("\x7F\xFF\xFF\xFF\x01", 5);
+    CHECK(Protocol::Peek(huge.data(), huge.data() + huge.length(), opcode, view, frameSize) == Protocol::PEEK_MORE);
+    CHECK(frameSize == size_t(V2_HEADER_SIZE) + 0x7FFFFFFF);
+}
+
+static void TestEncodeLines()
+{
+    // untyped lines become V2_TEXT
+    std::string payload;
+    CHECK(SingleFrame(Encode(ACE_Message_Block::MB_DATA, "Welcome to the web chat"), V2_TEXT, payload));
+
+    SocketConnectorPacketReader reader(payload.data(), payload.length());
+    ByteView text;
+    CHECK(reader.ReadString(text) && text.ToString() == "Welcome to the web chat");
+    CHECK(reader.AtEnd());
+
+    // frames built for v2 are passed as they are
+    std::string ack;
+    Protocol::AppendHeader(ack, V2_ACK, 5);
+    Protocol::AppendUInt32(ack, 42);
+    Protocol::AppendUInt8(ack, V2_ACK_MUTED);
+    CHECK(Encode(SOCKET_CONNECTOR_V2_FRAME, ack) == ack);
+}
+
+static void TestEncodeTyped()
+{
+    struct
+    {
+        char type;
+        uint8 opcode;
+    } cases[] =
+    {
+        { 'm', V2_CHAT },
+        { 'g', V2_GUILD },
+        { 'w', V2_WHISPER }
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        // the message keeps its backslashes, only the first one after the sender separates
+        std::string payload;
+        CHECK(SingleFrame(Encode(SOCKET_CONNECTOR_TYPED_FRAME, std::string(1, cases[i].type) + "\\Jaina\\path C:\\wow\\"), cases[i].opcode, payload));
+
+        SocketConnectorPacketReader reader(payload.data(), payload.length());
+        ByteView sender, message;
+        CHECK(reader.ReadString(sender) && sender.ToString() == "Jaina");
+        CHECK(reader.ReadString(message) && message.ToString() == "path C:\\wow\\");
+        CHECK(reader.AtEnd());
+    }
+
+    // empty message
+    std::string payload;
+    CHECK(SingleFrame(Encode(SOCKET_CONNECTOR_TYPED_FRAME, "m\\Jaina\\"), V2_CHAT, payload));
+    CHECK(payload == std::string("\x00\x05Jaina\x00\x00", 9));
+}
+
+static void TestEncodePresence()
+{
+    std::string payload;
+    CHECK(SingleFrame(Encode(SOCKET_CONNECTOR_TYPED_FRAME, "p\\Varian\\1"), V2_PRESENCE, payload));
+    CHECK(payload == std::string("\x00\x06Varian\x01", 9));
+
+    CHECK(SingleFrame(Encode(SOCKET_CONNECTOR_TYPED_FRAME, "p\\Varian\\0"), V2_PRESENCE, payload));
+    CHECK(payload == std::string("\x00\x06Varian\x00", 9));
+}
+
+int main()
+{
+    RUN_TEST(TestIntegers);
+    RUN_TEST(TestStrings);
+    RUN_TEST(TestPeek);
+    RUN_TEST(TestEncodeLines);
+    RUN_TEST(TestEncodeTyped);
+    RUN_TEST(TestEncodePresence);
+    return TEST_RESULT();
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/// \addtogroup Trinityd
+/// @{
+/// \file
+
+#ifndef _SocketConnectorTest_H
+#define _SocketConnectorTest_H
+
+#include <cstdio>
+
+/// Minimal checks for the standalone tests, a failed CHECK is reported and the test goes on
+static int s_testFailures = 0;
+
+#define CHECK(expr) \
+    do \
+    { \
+        if (!(expr)) \
+        { \
+            fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+            ++s_testFailures; \
+        } \
+    } while (0)
+
+#define RUN_TEST(test) \
+    do \
+    { \
+        int failures = s_testFailures; \
+        test(); \
+        printf("%s %s\n", failures == s_testFailures ? "ok  " : "FAIL", #test); \
+    } while (0)
+
+#define TEST_RESULT() (s_testFailures ? 1 : 0)
+
+#endif
+/// @}
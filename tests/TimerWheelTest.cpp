@@ -0,0 +1,261 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "SocketConnectorTimerWheel.h"
+#include "SocketConnectorTest.h"
+
+#include <vector>
+
+typedef SocketConnectorTimerWheel TimerWheel;
+
+#define TEST_WHEEL_SPAN (uint64(1) << (TIMER_WHEEL_SLOT_BITS * TIMER_WHEEL_LEVELS))
+
+/// Records the tick of every expiry, the wheel is driven without a reactor
+class CountingHandler : public ACE_Event_Handler
+{
+    public:
+        CountingHandler(TimerWheel& wheel) : m_wheel(wheel), result(0), repeat(0), closed(0) { }
+
+        virtual int handle_timeout(const ACE_Time_Value& /*current_time*/, const void* act)
+        {
+            fired.push_back(m_wheel.GetTick());
+            acts.push_back(act);
+
+            if (repeat)
+                m_wheel.Schedule(&timer, this, repeat);
+
+            return result;
+        }
+
+        virtual int handle_close(ACE_HANDLE /*handle*/, ACE_Reactor_Mask mask)
+        {
+            if (mask == ACE_Event_Handler::TIMER_MASK)
+                ++closed;
+            return 0;
+        }
+
+        TimerWheel& m_wheel;
+        TimerWheel::Timer timer;
+        std::vector<uint64> fired;
+        std::vector<const void*> acts;
+        int result;
+        uint64 repeat;
+        int closed;
+};
+
+/// Time since the wheel was opened that makes it reach the tick
+static void Advance(TimerWheel& wheel, uint64 tick)
+{
+    uint64 ms = tick * TIMER_WHEEL_TICK_MS;
+    wheel.handle_timeout(ACE_Time_Value(time_t(ms / 1000), long(ms % 1000) * 1000));
+}
+
+static void Step(TimerWheel& wheel, uint64 ticks)
+{
+    for (uint64 target = wheel.GetTick() + ticks; wheel.GetTick() < target;)
+        Advance(wheel, wheel.GetTick() + 1);
+}
+
+static void TestSchedule()
+{
+    TimerWheel wheel(NULL);
+    CountingHandler handler(wheel);
+
+    wheel.Schedule(&handler.timer, &handler, 3);
+    CHECK(handler.timer.IsScheduled());
+    CHECK(wheel.GetScheduled() == 1);
+
+    Step(wheel, 2);
+    CHECK(handler.fired.empty());
+
+    Step(wheel, 1);
+    CHECK(handler.fired.size() == 1 && handler.fired[0] == 3);
+    CHECK(handler.acts[0] == &handler.timer);
+    CHECK(!handler.timer.IsScheduled());
+    CHECK(wheel.GetScheduled() == 0);
+
+    // no second expiry
+    Step(wheel, 100);
+    CHECK(handler.fired.size() == 1);
+
+    // zero means the next tick, the current one is already done
+    wheel.Schedule(&handler.timer, &handler, 0);
+    Step(wheel, 1);
+    CHECK(handler.fired.size() == 2 && handler.fired[1] == 104);
+}
+
+static void TestCascade()
+{
+    // both sides of every level boundary, each timer fires on its own tick
+    uint64 delays[] = { 1, 63, 64, 65, 127, 128, 4095, 4096, 4097, 5000, 262143, 262144, 262145, 300000 };
+    size_t const count = sizeof(delays) / sizeof(delays[0]);
+
+    // started off a slot boundary, so slots do not line up with the delays
+    TimerWheel wheel(NULL);
+    Step(wheel, 37);
+
+    std::vector<CountingHandler*> handlers;
+    for (size_t i = 0; i < count; ++i)
+    {
+        handlers.push_back(new CountingHandler(wheel));
+        wheel.Schedule(&handlers[i]->timer, handlers[i], delays[i]);
+    }
+
+    CHECK(wheel.GetScheduled() == count);
+
+    Step(wheel, 300001);
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        CHECK(handlers[i]->fired.size() == 1);
+        CHECK(!handlers[i]->fired.empty() && handlers[i]->fired[0] == 37 + delays[i]);
+        delete handlers[i];
+    }
+
+    CHECK(wheel.GetScheduled() == 0);
+}
+
+static void TestBeyondSpan()
+{
+    // longer than the wheel, the timer waits at the top and is linked again
+    TimerWheel wheel(NULL);
+    CountingHandler handler(wheel);
+
+    uint64 delay = TEST_WHEEL_SPAN + 1000;
+    wheel.Schedule(&handler.timer, &handler, delay);
+
+    Advance(wheel, delay - 1);
+    CHECK(handler.fired.empty());
+    CHECK(handler.timer.IsScheduled());
+
+    Step(wheel, 1);
+    CHECK(handler.fired.size() == 1 && handler.fired[0] == delay);
+}
+
+static void TestCancel()
+{
+    TimerWheel wheel(NULL);
+    CountingHandler first(wheel), second(wheel);
+
+    wheel.Schedule(&first.timer, &first, 10);
+    wheel.Schedule(&second.timer, &second, 5000);
+    CHECK(wheel.GetScheduled() == 2);
+
+    wheel.Cancel(&first.timer);
+    CHECK(!first.timer.IsScheduled());
+    CHECK(wheel.GetScheduled() == 1);
+
+    // cancelling twice or an idle timer changes nothing
+    wheel.Cancel(&first.timer);
+    CHECK(wheel.GetScheduled() == 1);
+
+    // a cascaded timer is cancelled from the lower level
+    Step(wheel, 4990);
+    wheel.Cancel(&second.timer);
+    CHECK(wheel.GetScheduled() == 0);
+
+    Step(wheel, 100);
+    CHECK(first.fired.empty());
+    CHECK(second.fired.empty());
+}
+
+static void TestReschedule()
+{
+    TimerWheel wheel(NULL);
+    CountingHandler handler(wheel);
+
+    // a new expiry replaces the pending one, earlier or later
+    wheel.Schedule(&handler.timer, &handler, 100);
+    wheel.Schedule(&handler.timer, &handler, 10);
+    CHECK(wheel.GetScheduled() == 1);
+
+    Step(wheel, 200);
+    CHECK(handler.fired.size() == 1 && handler.fired[0] == 10);
+
+    wheel.Schedule(&handler.timer, &handler, 10);
+    wheel.Schedule(&handler.timer, &handler, 5000);
+    Step(wheel, 5000);
+    CHECK(handler.fired.size() == 2 && handler.fired[1] == 5200);
+    CHECK(wheel.GetScheduled() == 0);
+}
+
+static void TestHandlerReschedules()
+{
+    // a handler may schedule its timer again from handle_timeout
+    TimerWheel wheel(NULL);
+    CountingHandler handler(wheel);
+    handler.repeat = 20;
+
+    wheel.Schedule(&handler.timer, &handler, 20);
+    Step(wheel, 100);
+
+    CHECK(handler.fired.size() == 5);
+    for (size_t i = 0; i < handler.fired.size(); ++i)
+        CHECK(handler.fired[i] == 20 * (i + 1));
+
+    CHECK(wheel.GetScheduled() == 1);
+    wheel.Cancel(&handler.timer);
+}
+
+static void TestCatchUp()
+{
+    // a late reactor expires everything that came due, handle_close follows -1
+    TimerWheel wheel(NULL);
+    CountingHandler early(wheel), late(wheel), later(wheel);
+    late.result = -1;
+
+    wheel.Schedule(&early.timer, &early, 3);
+    wheel.Schedule(&late.timer, &late, 70);
+    wheel.Schedule(&later.timer, &later, 71);
+
+    Advance(wheel, 70);
+    CHECK(early.fired.size() == 1 && late.fired.size() == 1);
+    CHECK(later.fired.empty());
+    CHECK(early.closed == 0 && late.closed == 1);
+
+    // no time passed, nothing happens
+    Advance(wheel, 70);
+    CHECK(later.fired.empty());
+
+    Advance(wheel, 71);
+    CHECK(later.fired.size() == 1);
+}
+
+static void TestSecondsToTicks()
+{
+    CHECK(TimerWheel::SecondsToTicks(0) == 0);
+    CHECK(TimerWheel::SecondsToTicks(1) == 1000 / TIMER_WHEEL_TICK_MS);
+    CHECK(TimerWheel::SecondsToTicks(3600) == uint64(3600) * 1000 / TIMER_WHEEL_TICK_MS);
+}
+
+int main()
+{
+    RUN_TEST(TestSchedule);
+    RUN_TEST(TestCascade);
+    RUN_TEST(TestBeyondSpan);
+    RUN_TEST(TestCancel);
+    RUN_TEST(TestReschedule);
+    RUN_TEST(TestHandlerReschedules);
+    RUN_TEST(TestCatchUp);
+    RUN_TEST(TestSecondsToTicks);
+    return TEST_RESULT();
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "Config.h"
+#include "SocketConnectorTokens.h"
+#include "SocketConnectorModeration.h"
+#include "SocketConnectorCharacters.h"
+#include "SocketConnectorTest.h"
+
+#include <ace/OS_NS_unistd.h>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <unistd.h>
+
+#define TEST_TOKEN_TTL 1
+
+typedef SocketConnectorTokens::ResumeState ResumeState;
+
+/// References the tokens hold, the caches themselves are not part of the test
+static std::map<uint32, int> s_moderationRefs;
+static std::map<uint32, int> s_characterRefs;
+
+void SocketConnectorModeration::Acquire(uint32 accountId, time_t /*muteTime*/, bool /*banned*/) { ++s_moderationRefs[accountId]; }
+void SocketConnectorModeration::Release(uint32 accountId) { --s_moderationRefs[accountId]; }
+bool SocketConnectorCharacters::Acquire(uint32 accountId, SocketConnectorAuthRequest* /*request*/) { ++s_characterRefs[accountId]; return true; }
+void SocketConnectorCharacters::Release(uint32 accountId) { --s_characterRefs[accountId]; }
+
+static int References(uint32 accountId)
+{
+    CHECK(s_moderationRefs[accountId] == s_characterRefs[accountId]);
+    return s_moderationRefs[accountId];
+}
+
+static bool LoadTTL(uint32 ttl)
+{
+    char path[] = "/tmp/TokensTestXXXXXX";
+    int fd = mkstemp(path);
+    if (fd == -1)
+        return false;
+
+    char line[64];
+    int length = snprintf(line, sizeof(line), "SocketConnector.ResumeTokenTTL = %u\n", ttl);
+    bool written = write(fd, line, length) == length;
+    close(fd);
+
+    bool loaded = written && ConfigMgr::Load(path);
+    unlink(path);
+    if (!loaded)
+        return false;
+
+    sSocketConnectorTokens->LoadConfig();
+    return true;
+}
+
+static ResumeState State(uint32 accountId, uint64 playerGuid)
+{
+    ResumeState state;
+    state.accountId = accountId;
+    state.playerGuid = playerGuid;
+    state.playerName = "Thrall";
+    state.guildId = 7;
+    state.faction = 1;
+    return state;
+}
+
+static void TestDisabled()
+{
+    CHECK(LoadTTL(0));
+    CHECK(!sSocketConnectorTokens->IsEnabled());
+
+    std::string nonce = "stale";
+    CHECK(sSocketConnectorTokens->Issue(State(1, 10), nonce).empty());
+    CHECK(nonce.empty());
+    CHECK(References(1) == 0);
+}
+
+static void TestSignVerify()
+{
+    CHECK(LoadTTL(TEST_TOKEN_TTL));
+    CHECK(sSocketConnectorTokens->IsEnabled());
+
+    std::string nonce;
+    std::string token = sSocketConnectorTokens->Issue(State(2, 20), nonce);
+
+    // "<nonce>.<hmac>", hex of the random nonce and of HMAC-SHA1
+    CHECK(nonce.length() == 2 * SOCKET_CONNECTOR_TOKEN_NONCE_SIZE);
+    CHECK(token.length() == nonce.length() + 1 + 40);
+    CHECK(token.compare(0, nonce.length() + 1, nonce + ".") == 0);
+    CHECK(References(2) == 1);
+
+    // every character of the signature counts
+    std::string tampered = token;
+    char& last = tampered[tampered.length() - 1];
+    last = last == '0' ? '1' : '0';
+
+    ResumeState state;
+    CHECK(!sSocketConnectorTokens->Redeem(tampered, state));
+    CHECK(!sSocketConnectorTokens->Redeem(token.substr(0, token.length() - 1), state));
+    CHECK(!sSocketConnectorTokens->Redeem(nonce, state));
+    CHECK(!sSocketConnectorTokens->Redeem(nonce + "." + nonce, state));
+    CHECK(!sSocketConnectorTokens->Redeem("", state));
+
+    // a token of another session does not redeem this one
+    std::string otherNonce;
+    std::string other = sSocketConnectorTokens->Issue(State(2, 21), otherNonce);
+    CHECK(!sSocketConnectorTokens->Redeem(nonce + other.substr(otherNonce.length()), state));
+
+    // failed attempts leave the token usable, the references go to the caller
+    CHECK(sSocketConnectorTokens->Redeem(token, state));
+    CHECK(state.accountId == 2 && state.playerGuid == 20 && state.playerName == "Thrall" && state.guildId == 7 && state.faction == 1);
+    CHECK(References(2) == 2);
+
+    // single use
+    CHECK(!sSocketConnectorTokens->Redeem(token, state));
+
+    sSocketConnectorTokens->Revoke(otherNonce);
+    CHECK(References(2) == 1);
+    CHECK(!sSocketConnectorTokens->Redeem(other, state));
+}
+
+static void TestGuildChanges()
+{
+    CHECK(LoadTTL(TEST_TOKEN_TTL));
+
+    std::string firstNonce, secondNonce;
+    std::string first = sSocketConnectorTokens->Issue(State(3, 30), firstNonce);
+    std::string second = sSocketConnectorTokens->Issue(State(3, 31), secondNonce);
+
+    sSocketConnectorTokens->SetGuild(30, 8);
+    sSocketConnectorTokens->DisbandGuild(7);
+
+    ResumeState state;
+    CHECK(sSocketConnectorTokens->Redeem(first, state) && state.guildId == 8);
+    CHECK(sSocketConnectorTokens->Redeem(second, state) && state.guildId == 0);
+}
+
+static void TestExpiry()
+{
+    CHECK(LoadTTL(TEST_TOKEN_TTL));
+
+    // connected: never expires; dropped: expires TTL after the drop, on redeem or on update
+    std::string connectedNonce, redeemedNonce, sweptNonce;
+    std::string connected = sSocketConnectorTokens->Issue(State(4, 40), connectedNonce);
+    std::string redeemed = sSocketConnectorTokens->Issue(State(5, 50), redeemedNonce);
+    std::string swept = sSocketConnectorTokens->Issue(State(6, 60), sweptNonce);
+
+    // the TTL counts from the drop, not from the issue
+    ACE_OS::sleep(ACE_Time_Value(TEST_TOKEN_TTL + 1));
+    sSocketConnectorTokens->Drop(redeemedNonce);
+    sSocketConnectorTokens->Drop(sweptNonce);
+    sSocketConnectorTokens->Drop("");
+
+    ResumeState state;
+    std::string freshNonce;
+    std::string fresh = sSocketConnectorTokens->Issue(State(7, 70), freshNonce);
+    sSocketConnectorTokens->Drop(freshNonce);
+    CHECK(sSocketConnectorTokens->Redeem(fresh, state) && state.playerGuid == 70);
+
+    ACE_OS::sleep(ACE_Time_Value(TEST_TOKEN_TTL + 1));
+
+    CHECK(!sSocketConnectorTokens->Redeem(redeemed, state));
+    CHECK(References(5) == 0);
+
+    sSocketConnectorTokens->Update();
+    CHECK(References(6) == 0);
+    CHECK(!sSocketConnectorTokens->Redeem(swept, state));
+
+    CHECK(References(4) == 1);
+    CHECK(sSocketConnectorTokens->Redeem(connected, state) && state.playerGuid == 40);
+}
+
+int main()
+{
+    RUN_TEST(TestDisabled);
+    RUN_TEST(TestSignVerify);
+    RUN_TEST(TestGuildChanges);
+    RUN_TEST(TestExpiry);
+    return TEST_RESULT();
+}
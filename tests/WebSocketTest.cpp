@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2008-2011 TrinityCore <http://www.trinitycore.org/>
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the
+ * Free Software Foundation; either version 2 of the License, or (at your
+ * option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program. If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/** \file
+    \ingroup Trinityd
+*/
+
+#include "Common.h"
+#include "SocketConnectorWebSocket.h"
+#include "SocketConnectorTest.h"
+
+#include <string>
+
+#define TEST_BUFFER_SIZE 4096
+#define TEST_MAX_MESSAGE 2048
+
+typedef SocketConnectorWebSocket WebSocket;
+
+static const char s_mask[4] = { 0x37, char(0xFA), 0x21, 0x3D };
+
+/// Client frame, always masked as RFC 6455 requires
+static std::string ClientFrame(uint8 opcode, std::string const& payload, bool fin = true, bool compressed = false, bool masked = true)
+{
+    std::string frame;
+    frame += char((fin ? 0x80 : 0) | (compressed ? 0x40 : 0) | opcode);
+
+    uint8 maskBit = masked ? 0x80 : 0;
+    if (payload.length() < 126)
+        frame += char(maskBit | payload.length());
+    else if (payload.length() <= 0xFFFF)
+    {
+        frame += char(maskBit | 126);
+        frame += char(payload.length() >> 8);
+        frame += char(payload.length() & 0xFF);
+    }
+    else
+    {
+        frame += char(maskBit | 127);
+        for (int shift = 56; shift >= 0; shift -= 8)
+            frame += char((uint64(payload.length()) >> shift) & 0xFF);
+    }
+
+    if (!masked)
+        return frame + payload;
+
+    frame.append(s_mask, 4);
+    for (size_t i = 0; i < payload.length(); ++i)
+        frame += char(payload[i] ^ s_mask[i & 3]);
+
+    return frame;
+}
+
+/// Server frame split into its parts, false if it is not a single unmasked frame
+static bool ParseServerFrame(std::string const& frame, uint8& opcode, bool& compressed, std::string& payload)
+{
+    if (frame.length() < 2 || !(frame[0] & 0x80) || (frame[1] & 0x80))
+        return false;
+
+    opcode = frame[0] & 0x0F;
+    compressed = (frame[0] & 0x40) != 0;
+
+    uint64 length = frame[1] & 0x7F;
+    size_t header = 2;
+    if (length == 126)
+    {
+        length = (uint64(uint8(frame[2])) << 8) | uint8(frame[3]);
+        header = 4;
+    }
+    else if (length == 127)
+    {
+        length = 0;
+        for (int i = 0; i < 8; ++i)
+            length = (length << 8) | uint8(frame[2 + i]);
+        header = 10;
+    }
+
+    if (frame.length() != header + length)
+        return false;
+
+    payload = frame.substr(header);
+    return true;
+}
+
+static uint16 CloseCode(std::string const& reply)
+{
+    uint8 opcode;
+    bool compressed;
+    std::string payload;
+    if (!ParseServerFrame(reply, opcode, compressed, payload) || opcode != WebSocket::OPCODE_CLOSE || payload.length() != 2)
+        return 0;
+
+    return (uint16(uint8(payload[0])) << 8) | uint8(payload[1]);
+}
+
+static std::string Request(std::string const& headers)
+{
+    return "GET /chat HTTP/1.1\r\nHost: 127.0.0.1:3448\r\nUpgrade: websocket\r\nConnection: keep-alive, Upgrade\r\n"
+        "Sec-WebSocket-Key: dGhlIHNhbXBsZSBub25jZQ==\r\nSec-WebSocket-Version: 13\r\n" + headers;
+}
+
+/// Raw deflate of the client side, the empty block of the sync flush is cut off as in RFC 7692
+static std::string ClientDeflate(z_stream& stream, std::string const& data, int flush = Z_SYNC_FLUSH)
+{
+    std::string out(data.length() + 64, '\0');
+    stream.next_in = (Bytef*)data.data();
+    stream.avail_in = uInt(data.length());
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = uInt(out.length());
+    deflate(&stream, flush);
+    out.resize(out.length() - stream.avail_out);
+
+    if (flush == Z_SYNC_FLUSH && out.length() >= 4 && out.compare(out.length() - 4, 4, std::string("\x00\x00\xFF\xFF", 4)) == 0)
+        out.resize(out.length() - 4);
+
+    return out;
+}
+
+static std::string ClientInflate(z_stream& stream, std::string const& data)
+{
+    std::string input = data + std::string("\x00\x00\xFF\xFF", 4);
+    std::string out(TEST_MAX_MESSAGE, '\0');
+    stream.next_in = (Bytef*)&input[0];
+    stream.avail_in = uInt(input.length());
+    stream.next_out = (Bytef*)&out[0];
+    stream.avail_out = uInt(out.length());
+    inflate(&stream, Z_SYNC_FLUSH);
+    out.resize(out.length() - stream.avail_out);
+    return out;
+}
+
+static WebSocket::ReadResult Feed(WebSocket& ws, ACE_Message_Block& in, std::string const& data, std::string& message, std::string& reply)
+{
+    in.copy(data.data(), data.length());
+    return ws.Read(in, message, reply);
+}
+
+static void TestHandshake()
+{
+    WebSocket::Settings settings;
+    WebSocket ws(settings, TEST_MAX_MESSAGE);
+
+    std::string response;
+    CHECK(ws.Accept(Request(""), response));
+    CHECK(response.find("HTTP/1.1 101 Switching Protocols\r\n") == 0);
+    // RFC 6455 1.3
+    CHECK(response.find("Sec-WebSocket-Accept: s3pPLMBiTxaQ9kYGzzhZRbK+xOo=\r\n") != std::string::npos);
+    CHECK(response.find("Sec-WebSocket-Extensions") == std::string::npos);
+    CHECK(response.compare(response.length() - 4, 4, "\r\n\r\n") == 0);
+    CHECK(!ws.IsDeflateEnabled());
+}
+
+static void TestBadHandshake()
+{
+    WebSocket::Settings settings;
+    std::string response;
+
+    WebSocket post(settings, TEST_MAX_MESSAGE);
+    CHECK(!post.Accept("POST / HTTP/1.1\r\nUpgrade: websocket\r\n", response));
+    CHECK(response.find("400") != std::string::npos);
+
+    WebSocket noKey(settings, TEST_MAX_MESSAGE);
+    CHECK(!noKey.Accept("GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Version: 13\r\n", response));
+    CHECK(response.find("400") != std::string::npos);
+
+    WebSocket oldVersion(settings, TEST_MAX_MESSAGE);
+    CHECK(!oldVersion.Accept("GET / HTTP/1.1\r\nUpgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Key: x\r\nSec-WebSocket-Version: 8\r\n", response));
+    CHECK(response.find("426") != std::string::npos);
+}
+
+static void TestOrigins()
+{
+    WebSocket::Settings settings;
+    settings.origins.push_back("https://chat.example.org");
+    std::string response;
+
+    WebSocket allowed(settings, TEST_MAX_MESSAGE);
+    CHECK(allowed.Accept(Request("Origin: https://Chat.Example.org\r\n"), response));
+
+    WebSocket foreign(settings, TEST_MAX_MESSAGE);
+    CHECK(!foreign.Accept(Request("Origin: https://evil.example.com\r\n"), response));
+    CHECK(response.find("403 Forbidden") != std::string::npos);
+
+    WebSocket missing(settings, TEST_MAX_MESSAGE);
+    CHECK(!missing.Accept(Request(""), response));
+    CHECK(response.find("403 Forbidden") != std::string::npos);
+}
+
+static void TestMaskedText()
+{
+    WebSocket::Settings settings;
+    WebSocket ws(settings, TEST_MAX_MESSAGE);
+    ACE_Message_Block in(TEST_BUFFER_SIZE);
+    std::string message, reply;
+
+    // 7 bit, 16 bit and the largest lengths, the payload is unmasked in place
+    size_t lengths[] = { 0, 1, 125, 126, 1000, TEST_MAX_MESSAGE };
+    for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); ++i)
+    {
+        std::string payload(lengths[i], 'a');
+        for (size_t j = 0; j < payload.length(); ++j)
+            payload[j] = char('a' + j % 26);
+
+        in.reset();
+        CHECK(Feed(ws, in, ClientFrame(WebSocket::OPCODE_TEXT, payload), message, reply) == WebSocket::READ_MESSAGE);
+        CHECK(message == payload);
+        CHECK(in.length() == 0);
+    }
+}
+
+static void TestPartialFrames()
+{
+    WebSocket::Settings settings;
+    WebSocket ws(settings, TEST_MAX_MESSAGE);
+    ACE_Message_Block in(TEST_BUFFER_SIZE);
+    std::string message, reply;
+
+    std::string frames = ClientFrame(WebSocket::OPCODE_TEXT, std::string(300, 'x')) + ClientFrame(WebSocket::OPCODE_TEXT, "second");
+
+    // byte by byte, the first frame completes exactly at its last byte
+    size_t firstLength = frames.length() - 12;
+    for (size_t i = 0; i + 1 < firstLength; ++i)
+        CHECK(Feed(ws, in, frames.substr(i, 1), message, reply) == WebSocket::READ_MORE);
+
+    CHECK(Feed(ws, in, frames.substr(firstLength - 1), message, reply) == WebSocket::READ_MESSAGE);
+    CHECK(message == std::string(300, 'x'));
+
+    // the second frame is already in the buffer
+    CHECK(ws.Read(in, message, reply) == WebSocket::READ_MESSAGE);
+    CHECK(message == "second");
+    CHECK(ws.Read(in, message, reply) == WebSocket::READ_MORE);
+}
+
+static void TestFragmentsAndControl()
+{
+    WebSocket::Settings settings;
+    WebSocket ws(settings, TEST_MAX_MESSAGE);
+    ACE_Message_Block in(TEST_BUFFER_SIZE);
+    std::string message, reply;
+
+    // a ping between fragments is answered first, the message is assembled afterwards
+    std::string data = ClientFrame(WebSocket::OPCODE_TEXT, "hel", false)
+        + ClientFrame(WebSocket::OPCODE_PING, "beat")
+        + ClientFrame(WebSocket::OPCODE_CONTINUATION, "lo ", false)
+        + ClientFrame(WebSocket::OPCODE_PONG, "")
+        + ClientFrame(WebSocket::OPCODE_CONTINUATION, "world");
+
+    CHECK(Feed(ws, in, data, message, reply) == WebSocket::READ_CONTROL);
+
+    uint8 opcode;
+    bool compressed;
+    std::string payload;
+    CHECK(ParseServerFrame(reply, opcode, compressed, payload));
+    CHECK(opcode == WebSocket::OPCODE_PONG && !compressed && payload == "beat");
+
+    CHECK(ws.Read(in, message, reply) == WebSocket::READ_MESSAGE);
+    CHECK(message == "hello world");
+
+    // close is echoed with its status code
+    in.reset();
+    CHECK(Feed(ws, in, ClientFrame(WebSocket::OPCODE_CLOSE, std::string("\x03\xE8" "bye", 5)), message, reply) == WebSocket::READ_CLOSE);
+    CHECK(CloseCode(reply) == 1000);
+}
+
+static void TestProtocolErrors()
+{
+    WebSocket::Settings settings;
+    std::string message, reply;
+
+    struct
+    {
+        std::string frame;
+        uint16 code;
+    } cases[] =
+    {
+        { ClientFrame(WebSocket::OPCODE_TEXT, "unmasked", true, false, false), 1002 },
+        { ClientFrame(WebSocket::OPCODE_CONTINUATION, "orphan"), 1002 },
+        { ClientFrame(WebSocket::OPCODE_TEXT, "deflate not negotiated", true, true), 1002 },
+        { ClientFrame(WebSocket::OPCODE_PING, "fragmented ping", false), 1002 },
+        { ClientFrame(WebSocket::OPCODE_PING, std::string(126, 'p')), 1002 },
+        { ClientFrame(0x3, "reserved opcode"), 1002 },
+        { ClientFrame(WebSocket::OPCODE_TEXT, std::string(TEST_MAX_MESSAGE + 1, 'x')), 1009 },
+        { ClientFrame(WebSocket::OPCODE_BINARY, std::string(TEST_BUFFER_SIZE, 'x')), 1009 },
+        { ClientFrame(WebSocket::OPCODE_TEXT, "\xC0\xAF"), 1007 }
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); ++i)
+    {
+        WebSocket ws(settings, TEST_MAX_MESSAGE);
+        ACE_Message_Block in(TEST_BUFFER_SIZE);
+
+        // only the header of a frame larger than the buffer arrives
+        std::string frame = cases[i].frame.substr(0, TEST_BUFFER_SIZE);
+        CHECK(Feed(ws, in, frame, message, reply) == WebSocket::READ_CLOSE);
+        CHECK(CloseCode(reply) == cases[i].code);
+    }
+
+    // a new message may not start inside a fragmented one
+    WebSocket ws(settings, TEST_MAX_MESSAGE);
+    ACE_Message_Block in(TEST_BUFFER_SIZE);
+    std::string data = ClientFrame(WebSocket::OPCODE_TEXT, "a", false) + ClientFrame(WebSocket::OPCODE_TEXT, "b");
+    CHECK(Feed(ws, in, data, message, reply) == WebSocket::READ_CLOSE);
+    CHECK(CloseCode(reply) == 1002);
+}
+
+static void TestUtf8()
+{
+    CHECK(WebSocket::IsValidUtf8("", 0));
+    CHECK(WebSocket::IsValidUtf8("plain", 5));
+    CHECK(WebSocket::IsValidUtf8("\xD1\x82\xD0\xB5\xD1\x81\xD1\x82", 8));          // тест
+    CHECK(WebSocket::IsValidUtf8("\xE2\x82\xAC", 3));                              // U+20AC
+    CHECK(WebSocket::IsValidUtf8("\xEF\xBF\xBF", 3));                              // U+FFFF
+    CHECK(WebSocket::IsValidUtf8("\xF0\x90\x80\x80", 4));                          // U+10000
+    CHECK(WebSocket::IsValidUtf8("\xF4\x8F\xBF\xBF", 4));                          // U+10FFFF
+
+    CHECK(!WebSocket::IsValidUtf8("\x80", 1));                                     // lone continuation
+    CHECK(!WebSocket::IsValidUtf8("\xC1\xBF", 2));                                 // overlong 2 bytes
+    CHECK(!WebSocket::IsValidUtf8("\xE0\x9F\xBF", 3));                             // overlong 3 bytes
+    CHECK(!WebSocket::IsValidUtf8("\xF0\x8F\xBF\xBF", 4));                         // overlong 4 bytes
+    CHECK(!WebSocket::IsValidUtf8("\xED\xA0\x80", 3));                             // surrogate
+    CHECK(!WebSocket::IsValidUtf8("\xF4\x90\x80\x80", 4));                         // above U+10FFFF
+    CHECK(!WebSocket::IsValidUtf8("\xF5\x80\x80\x80", 4));
+    CHECK(!WebSocket::IsValidUtf8("\xD1", 1));                                     // truncated
+    CHECK(!WebSocket::IsValidUtf8("\xE2\x82", 2));
+    CHECK(!WebSocket::IsValidUtf8("\xE2\x28\xA1", 3));                             // bad continuation
+
+    // binary messages are not checked, text split inside a character is checked as a whole
+    WebSocket::Settings settings;
+    WebSocket ws(settings, TEST_MAX_MESSAGE);
+    ACE_Message_Block in(TEST_BUFFER_SIZE);
+    std::string message, reply;
+
+    std::string data = ClientFrame(WebSocket::OPCODE_BINARY, "\xFF\xFE")
+        + ClientFrame(WebSocket::OPCODE_TEXT, "\xD1", false) + ClientFrame(WebSocket::OPCODE_CONTINUATION, "\x82");
+    CHECK(Feed(ws, in, data, message, reply) == WebSocket::READ_MESSAGE);
+    CHECK(message == "\xFF\xFE");
+    CHECK(ws.Read(in, message, reply) == WebSocket::READ_MESSAGE);
+    CHECK(message == "\xD1\x82");
+}
+
+static void TestDeflate()
+{
+    WebSocket::Settings settings;
+    WebSocket ws(settings, TEST_MAX_MESSAGE);
+    ACE_Message_Block in(TEST_BUFFER_SIZE);
+    std::string message, reply, response;
+
+    CHECK(ws.Accept(Request("Sec-WebSocket-Extensions: x-unknown, permessage-deflate; client_max_window_bits\r\n"), response));
+    CHECK(response.find("Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=15\r\n") != std::string::npos);
+    CHECK(ws.IsDeflateEnabled());
+
+    z_stream clientDeflate, clientInflate;
+    memset(&clientDeflate, 0, sizeof(clientDeflate));
+    memset(&clientInflate, 0, sizeof(clientInflate));
+    CHECK(deflateInit2(&clientDeflate, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) == Z_OK);
+    CHECK(inflateInit2(&clientInflate, -MAX_WBITS) == Z_OK);
+
+    // the second message refers back to the first one, the context is kept
+    std::string text = "m\\[Trade] WTS [Thunderfury, Blessed Blade of the Windseeker], whisper me";
+    for (int i = 0; i < 2; ++i)
+    {
+        std::string compressed = ClientDeflate(clientDeflate, text);
+        in.reset();
+        CHECK(Feed(ws, in, ClientFrame(WebSocket::OPCODE_TEXT, compressed, true, true), message, reply) == WebSocket::READ_MESSAGE);
+        CHECK(message == text);
+
+        std::string out;
+        ws.Write(text.data(), text.length(), out);
+
+        uint8 opcode;
+        bool isCompressed;
+        std::string payload;
+        CHECK(ParseServerFrame(out, opcode, isCompressed, payload));
+        CHECK(opcode == WebSocket::OPCODE_TEXT && isCompressed);
+        CHECK(ClientInflate(clientInflate, payload) == text);
+    }
+
+    // short messages are not worth compressing
+    std::string out;
+    ws.Write("short", 5, out);
+    CHECK(out == std::string("\x81\x05short"));
+
+    // a client may end a message with a final block, the next message starts a new stream
+    std::string final = ClientDeflate(clientDeflate, text, Z_FINISH);
+    in.reset();
+    CHECK(Feed(ws, in, ClientFrame(WebSocket::OPCODE_TEXT, final, true, true), message, reply) == WebSocket::READ_MESSAGE);
+    CHECK(message == text);
+
+    deflateReset(&clientDeflate);
+    std::string next = ClientDeflate(clientDeflate, "after the final block");
+    in.reset();
+    CHECK(Feed(ws, in, ClientFrame(WebSocket::OPCODE_TEXT, next, true, true), message, reply) == WebSocket::READ_MESSAGE);
+    CHECK(message == "after the final block");
+
+    // garbage after the final block is invalid
+    deflateReset(&clientDeflate);
+    std::string trailing = ClientDeflate(clientDeflate, text, Z_FINISH) + "garbage";
+    in.reset();
+    CHECK(Feed(ws, in, ClientFrame(WebSocket::OPCODE_TEXT, trailing, true, true), message, reply) == WebSocket::READ_CLOSE);
+    CHECK(CloseCode(reply) == 1007);
+
+    deflateEnd(&clientDeflate);
+    inflateEnd(&clientInflate);
+}
+
+static void TestDeflateWindow()
+{
+    WebSocket::Settings settings;
+    std::string response;
+
+    // the client limits the server's window
+    WebSocket limited(settings, TEST_MAX_MESSAGE);
+    CHECK(limited.Accept(Request("Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=12; server_no_context_takeover\r\n"), response));
+    CHECK(response.find("Sec-WebSocket-Extensions: permessage-deflate; server_no_context_takeover; server_max_window_bits=12\r\n") != std::string::npos);
+
+    // the configured window limits both directions, the client's one only when it may be limited
+    settings.windowBits = 10;
+    WebSocket small(settings, TEST_MAX_MESSAGE);
+    CHECK(small.Accept(Request("Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits\r\n"), response));
+    CHECK(response.find("Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=10; client_max_window_bits=10\r\n") != std::string::npos);
+
+    WebSocket fixed(settings, TEST_MAX_MESSAGE);
+    CHECK(fixed.Accept(Request("Sec-WebSocket-Extensions: permessage-deflate\r\n"), response));
+    CHECK(response.find("Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=10\r\n") != std::string::npos);
+
+    // the answer may not exceed what the client offered
+    WebSocket tiny(settings, TEST_MAX_MESSAGE);
+    CHECK(tiny.Accept(Request("Sec-WebSocket-Extensions: permessage-deflate; client_max_window_bits=8\r\n"), response));
+    CHECK(response.find("client_max_window_bits=8\r\n") != std::string::npos);
+
+    // invalid offers are skipped, no extension is accepted
+    WebSocket invalid(settings, TEST_MAX_MESSAGE);
+    CHECK(invalid.Accept(Request("Sec-WebSocket-Extensions: permessage-deflate; server_max_window_bits=7, permessage-deflate; unknown\r\n"), response));
+    CHECK(response.find("Sec-WebSocket-Extensions") == std::string::npos);
+    CHECK(!invalid.IsDeflateEnabled());
+
+    settings.allowDeflate = false;
+    WebSocket disabled(settings, TEST_MAX_MESSAGE);
+    CHECK(disabled.Accept(Request("Sec-WebSocket-Extensions: permessage-deflate\r\n"), response));
+    CHECK(!disabled.IsDeflateEnabled());
+}
+
+int main()
+{
+    RUN_TEST(TestHandshake);
+    RUN_TEST(TestBadHandshake);
+    RUN_TEST(TestOrigins);
+    RUN_TEST(TestMaskedText);
+    RUN_TEST(TestPartialFrames);
+    RUN_TEST(TestFragmentsAndControl);
+    RUN_TEST(TestProtocolErrors);
+    RUN_TEST(TestUtf8);
+    RUN_TEST(TestDeflate);
+    RUN_TEST(TestDeflateWindow);
+    return TEST_RESULT();
+}
@@ -0,0 +1,211 @@
+#!/usr/bin/env python3
+# Load driver for comparing the web chat I/O engines (SocketConnector.Engine = 0 / 1).
+# Opens protocol v2 sessions, lets a part of them post LFG messages at a fixed rate and
+# counts what every session receives. The server side numbers (I/O syscalls per frame,
+# CPU per 10k frames) are the "SocketConnector reactor engine" / "io_uring engine" lines
+# of its debug log; this script reports the client side: delivered frames and latency.
+# Only the standard library is used.
+#
+#   python3 load_driver.py --logins logins.txt --connections 500 --senders 50 --rate 200 --duration 180
+#
+# logins.txt holds "account password character" lines, the sessions use them in turn and the
+# first --senders sessions post. Sessions of the posting character do not get its message,
+# so the file needs at least two characters of one faction, and the LFG channel of that
+# faction has to exist (a game character in LookingForGroup).
+
+import argparse
+import asyncio
+import struct
+import sys
+import time
+
+V2_LINE, V2_CHAT, V2_WHISPER, V2_GUILD, V2_PRESENCE, V2_ACK, V2_TEXT, V2_PING = range(8)
+LOGIN_FAILURES = ("Authentication failed", "Character not found", "Server busy")
+
+
+def frame(opcode, payload=b""):
+    return struct.pack(">IB", len(payload), opcode) + payload
+
+
+def string(data):
+    return struct.pack(">H", len(data)) + data
+
+
+def read_string(payload, offset):
+    length = struct.unpack_from(">H", payload, offset)[0]
+    return payload[offset + 2:offset + 2 + length], offset + 2 + length
+
+
+class Stats:
+    def __init__(self):
+        self.logged_in = 0
+        self.login_failed = 0
+        self.sent = 0
+        self.received = 0
+        self.acks = [0, 0, 0]
+        self.latencies = []
+        self.expected = 0
+
+
+class Session:
+    def __init__(self, index, login, stats, args):
+        self.index = index
+        self.login = login
+        self.stats = stats
+        self.args = args
+        self.sent = 0
+
+    async def read_frame(self):
+        header = await self.reader.readexactly(5)
+        length, opcode = struct.unpack(">IB", header)
+        return opcode, await self.reader.readexactly(length)
+
+    async def connect(self):
+        self.reader, self.writer = await asyncio.open_connection(self.args.host, self.args.port)
+
+        account, password, character = self.login
+        self.writer.write(b"v2\n")
+        for line in (account, password, character, "getchars"):
+            self.writer.write(frame(V2_LINE, string(line.encode())))
+        await self.writer.drain()
+
+        # the character list comes after the password and again for getchars, once the session chats
+        lists = 0
+        while lists < 2:
+            opcode, payload = await self.read_frame()
+            if opcode != V2_TEXT:
+                continue
+
+            text = read_string(payload, 0)[0].decode("utf-8", "replace")
+            if text.startswith(LOGIN_FAILURES):
+                raise ConnectionError(text)
+            if text.endswith(","):
+                lists += 1
+
+    async def receive(self):
+        while True:
+            opcode, payload = await self.read_frame()
+            if opcode == V2_CHAT:
+                sender, offset = read_string(payload, 0)
+                message = read_string(payload, offset)[0]
+                self.stats.received += 1
+
+                parts = message.split(b" ")
+                if len(parts) >= 3 and parts[0] == b"load":
+                    self.stats.latencies.append(time.monotonic() - float(parts[2]))
+            elif opcode == V2_ACK:
+                status = payload[4]
+                if status < len(self.stats.acks):
+                    self.stats.acks[status] += 1
+            elif opcode == V2_PING:
+                self.writer.write(frame(V2_PING))
+
+    async def send(self, interval, deadline):
+        sequence = 0
+        next_send = time.monotonic()
+        while time.monotonic() < deadline:
+            text = ("load %d %.6f " % (sequence, time.monotonic())).encode()
+            text += b"x" * max(0, self.args.size - len(text))
+            self.writer.write(frame(V2_CHAT, struct.pack(">I", sequence) + string(text)))
+            self.stats.sent += 1
+            self.sent += 1
+            sequence += 1
+
+            next_send += interval
+            await asyncio.sleep(max(0.0, next_send - time.monotonic()))
+
+    def close(self):
+        if hasattr(self, "writer"):
+            self.writer.close()
+
+
+async def run(args, logins):
+    stats = Stats()
+    sessions = [Session(i, logins[i % len(logins)], stats, args) for i in range(args.connections)]
+
+    # a wave of logins would only measure the admission queue
+    connected = []
+    for batch in range(0, len(sessions), args.login_batch):
+        results = await asyncio.gather(*(s.connect() for s in sessions[batch:batch + args.login_batch]), return_exceptions=True)
+        for session, result in zip(sessions[batch:batch + args.login_batch], results):
+            if isinstance(result, Exception):
+                stats.login_failed += 1
+                print("session %d: login failed: %s" % (session.index, result), file=sys.stderr)
+                session.close()
+            else:
+                stats.logged_in += 1
+                connected.append(session)
+
+    print("%d sessions logged in, %d failed" % (stats.logged_in, stats.login_failed))
+    if not connected:
+        return stats
+
+    receivers = [asyncio.ensure_future(s.receive()) for s in connected]
+    senders = connected[:args.senders]
+    interval = len(senders) / float(args.rate) if args.rate else 0
+    deadline = time.monotonic() + args.duration
+
+    started = time.monotonic()
+    await asyncio.gather(*(s.send(interval, deadline) for s in senders))
+    stats.sending = time.monotonic() - started
+
+    # the last messages are still on their way
+    await asyncio.sleep(args.drain)
+    elapsed = time.monotonic() - started
+
+    # every session except those of the sending character, if all of them share the faction
+    for sender in senders:
+        stats.expected += sender.sent * sum(1 for s in connected if s.login[2].lower() != sender.login[2].lower())
+
+    for task in receivers:
+        task.cancel()
+    for session in connected:
+        session.close()
+
+    stats.elapsed = elapsed
+    return stats
+
+
+def report(stats):
+    if not stats.logged_in:
+        return
+
+    expected = stats.expected
+    print("sent %d messages in %.1f s (%.1f per s)" % (stats.sent, stats.sending, stats.sent / stats.sending))
+    print("received %d chat frames (%.1f per s), %.1f%% of at most %d"
+          % (stats.received, stats.received / stats.elapsed, 100.0 * stats.received / expected if expected else 0, expected))
+    print("acks: %d delivered, %d muted, %d undelivered" % tuple(stats.acks))
+
+    if stats.latencies:
+        latencies = sorted(stats.latencies)
+        pick = lambda q: latencies[min(len(latencies) - 1, int(q * len(latencies)))] * 1000.0
+        print("latency ms: p50 %.1f, p90 %.1f, p99 %.1f, max %.1f" % (pick(0.5), pick(0.9), pick(0.99), latencies[-1] * 1000.0))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Web chat load driver, protocol v2 over TCP")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=3448)
+    parser.add_argument("--logins", required=True, help="file with \"account password character\" per line")
+    parser.add_argument("--connections", type=int, default=100)
+    parser.add_argument("--senders", type=int, default=10, help="sessions that post, the others only receive")
+    parser.add_argument("--rate", type=float, default=50.0, help="LFG messages per second of all senders together")
+    parser.add_argument("--size", type=int, default=64, help="message length in bytes")
+    parser.add_argument("--duration", type=float, default=180.0, help="seconds, at least two server stats intervals")
+    parser.add_argument("--drain", type=float, default=2.0, help="seconds to wait for the last messages")
+    parser.add_argument("--login-batch", type=int, default=4, help="sessions that log in at the same time, Admission.MaxQueuedPerHost at most")
+    args = parser.parse_args()
+
+    with open(args.logins) as f:
+        logins = [tuple(line.split()[:3]) for line in f if len(line.split()) >= 3]
+
+    if len(set(login[2].lower() for login in logins)) < 2:
+        parser.error("the logins need at least two characters")
+
+    stats = asyncio.get_event_loop().run_until_complete(run(args, logins))
+    report(stats)
+    return 0 if stats.logged_in else 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,232 @@
+#!/usr/bin/env python3
+# Scripted WebSocket client for a running worldserver, checks the handshake and the framing
+# of the web chat port. Only the standard library is used.
+#
+#   python3 websocket_client.py [--host 127.0.0.1] [--port 3448] [--origin https://chat.example.org]
+#                               [--foreign-origin https://evil.example.com]
+#
+# Returns 0 when every check passed.
+
+import argparse
+import base64
+import hashlib
+import os
+import socket
+import struct
+import sys
+import zlib
+
+GUID = b"258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+DEFLATE_TAIL = b"\x00\x00\xff\xff"
+
+failures = 0
+
+
+def check(condition, what):
+    global failures
+    print("%s %s" % ("ok  " if condition else "FAIL", what))
+    if not condition:
+        failures += 1
+
+
+class Client:
+    def __init__(self, host, port, timeout=5.0):
+        self.sock = socket.create_connection((host, port), timeout)
+        self.buffer = b""
+        self.host = "%s:%d" % (host, port)
+
+    def close(self):
+        self.sock.close()
+
+    def handshake(self, origin=None, extensions=None):
+        self.key = base64.b64encode(os.urandom(16))
+        lines = [
+            "GET /chat HTTP/1.1",
+            "Host: " + self.host,
+            "Upgrade: websocket",
+            "Connection: Upgrade",
+            "Sec-WebSocket-Key: " + self.key.decode(),
+            "Sec-WebSocket-Version: 13",
+        ]
+        if origin:
+            lines.append("Origin: " + origin)
+        if extensions:
+            lines.append("Sec-WebSocket-Extensions: " + extensions)
+        self.sock.sendall(("\r\n".join(lines) + "\r\n\r\n").encode())
+
+        while b"\r\n\r\n" not in self.buffer:
+            data = self.sock.recv(4096)
+            if not data:
+                break
+            self.buffer += data
+
+        head, _, self.buffer = self.buffer.partition(b"\r\n\r\n")
+        lines = head.decode("latin-1").split("\r\n")
+        headers = {}
+        for line in lines[1:]:
+            name, _, value = line.partition(":")
+            headers[name.strip().lower()] = value.strip()
+        return lines[0], headers
+
+    def expected_accept(self):
+        return base64.b64encode(hashlib.sha1(self.key + GUID).digest()).decode()
+
+    def send_frame(self, opcode, payload, fin=True, rsv1=False, mask=True):
+        header = bytes([(0x80 if fin else 0) | (0x40 if rsv1 else 0) | opcode])
+        bit = 0x80 if mask else 0
+        if len(payload) < 126:
+            header += bytes([bit | len(payload)])
+        elif len(payload) <= 0xFFFF:
+            header += bytes([bit | 126]) + struct.pack(">H", len(payload))
+        else:
+            header += bytes([bit | 127]) + struct.pack(">Q", len(payload))
+
+        if mask:
+            key = os.urandom(4)
+            header += key
+            payload = bytes(b ^ key[i & 3] for i, b in enumerate(payload))
+        self.sock.sendall(header + payload)
+
+    def recv_exact(self, count):
+        while len(self.buffer) < count:
+            data = self.sock.recv(4096)
+            if not data:
+                raise EOFError("connection closed")
+            self.buffer += data
+        data, self.buffer = self.buffer[:count], self.buffer[count:]
+        return data
+
+    def recv_frame(self):
+        """Returns (fin, rsv1, opcode, payload), server frames must not be masked"""
+        first, second = self.recv_exact(2)
+        if second & 0x80:
+            raise ValueError("masked server frame")
+        length = second & 0x7F
+        if length == 126:
+            length = struct.unpack(">H", self.recv_exact(2))[0]
+        elif length == 127:
+            length = struct.unpack(">Q", self.recv_exact(8))[0]
+        return bool(first & 0x80), bool(first & 0x40), first & 0x0F, self.recv_exact(length)
+
+    def recv_closed(self):
+        """True when the server closed the TCP connection after its close frame"""
+        try:
+            return self.sock.recv(1) == b""
+        except (socket.timeout, ConnectionResetError):
+            return False
+
+
+def close_code(payload):
+    return struct.unpack(">H", payload[:2])[0] if len(payload) >= 2 else None
+
+
+def test_handshake(args):
+    client = Client(args.host, args.port)
+    status, headers = client.handshake(args.origin)
+    check(status.startswith("HTTP/1.1 101"), "handshake answered with 101 (%s)" % status)
+    check(headers.get("sec-websocket-accept") == client.expected_accept(), "Sec-WebSocket-Accept matches the key")
+    check(headers.get("upgrade", "").lower() == "websocket", "Upgrade: websocket")
+    client.close()
+
+
+def test_ping(args):
+    client = Client(args.host, args.port)
+    client.handshake(args.origin)
+    client.send_frame(0x9, b"heartbeat")
+    fin, rsv1, opcode, payload = client.recv_frame()
+    check(fin and opcode == 0xA and payload == b"heartbeat", "ping answered with the same pong")
+
+    # a ping inside a fragmented message is answered at once
+    client.send_frame(0x1, b"ACC", fin=False)
+    client.send_frame(0x9, b"between")
+    fin, rsv1, opcode, payload = client.recv_frame()
+    check(opcode == 0xA and payload == b"between", "ping between fragments answered")
+    client.send_frame(0x0, b"OUNT")
+
+    client.send_frame(0x8, struct.pack(">H", 1000))
+    fin, rsv1, opcode, payload = client.recv_frame()
+    check(opcode == 0x8 and close_code(payload) == 1000, "close echoed with 1000")
+    check(client.recv_closed(), "connection closed after the close frame")
+    client.close()
+
+
+def test_invalid_utf8(args):
+    client = Client(args.host, args.port)
+    client.handshake(args.origin)
+    client.send_frame(0x1, b"\xc0\xaf")
+    fin, rsv1, opcode, payload = client.recv_frame()
+    check(opcode == 0x8 and close_code(payload) == 1007, "invalid UTF-8 text closed with 1007")
+    check(client.recv_closed(), "connection closed after 1007")
+    client.close()
+
+
+def test_unmasked(args):
+    client = Client(args.host, args.port)
+    client.handshake(args.origin)
+    client.send_frame(0x1, b"ACCOUNT", mask=False)
+    fin, rsv1, opcode, payload = client.recv_frame()
+    check(opcode == 0x8 and close_code(payload) == 1002, "unmasked client frame closed with 1002")
+    client.close()
+
+
+def deflate_connection(args, data, what):
+    client = Client(args.host, args.port)
+    status, headers = client.handshake(args.origin, "permessage-deflate; client_max_window_bits")
+    accepted = headers.get("sec-websocket-extensions", "")
+    check(accepted.startswith("permessage-deflate"), "permessage-deflate accepted (%s)" % accepted)
+    if not accepted.startswith("permessage-deflate"):
+        client.close()
+        return
+
+    # the account line, the server waits for the password afterwards and answers the ping
+    client.send_frame(0x1, data, rsv1=True)
+    client.send_frame(0x9, b"alive")
+    try:
+        fin, rsv1, opcode, payload = client.recv_frame()
+        check(opcode == 0xA and payload == b"alive", what)
+    except EOFError:
+        check(False, what)
+    client.close()
+
+
+def test_deflate(args):
+    compressor = zlib.compressobj(zlib.Z_DEFAULT_COMPRESSION, zlib.DEFLATED, -zlib.MAX_WBITS)
+    data = compressor.compress(b"ACCOUNT") + compressor.flush(zlib.Z_SYNC_FLUSH)
+    check(data.endswith(DEFLATE_TAIL), "client deflate ends with a sync flush")
+    deflate_connection(args, data[:-4], "compressed message accepted")
+
+    # some clients end a message with a final block, it must not close the connection
+    compressor = zlib.compressobj(zlib.Z_DEFAULT_COMPRESSION, zlib.DEFLATED, -zlib.MAX_WBITS)
+    data = compressor.compress(b"ACCOUNT") + compressor.flush(zlib.Z_FINISH)
+    deflate_connection(args, data, "message with a final deflate block accepted")
+
+
+def test_origin(args):
+    if not args.foreign_origin:
+        return
+
+    client = Client(args.host, args.port)
+    status, headers = client.handshake(args.foreign_origin)
+    check(status.startswith("HTTP/1.1 403"), "foreign origin refused (%s)" % status)
+    client.close()
+
+
+def main():
+    parser = argparse.ArgumentParser(description="WebSocket checks of the web chat port")
+    parser.add_argument("--host", default="127.0.0.1")
+    parser.add_argument("--port", type=int, default=3448)
+    parser.add_argument("--origin", help="Origin sent by the checks, one of SocketConnector.WebSocket.AllowedOrigins")
+    parser.add_argument("--foreign-origin", help="Origin that must be refused")
+    args = parser.parse_args()
+
+    for test in (test_handshake, test_ping, test_invalid_utf8, test_unmasked, test_deflate, test_origin):
+        try:
+            test(args)
+        except (OSError, EOFError, ValueError) as e:
+            check(False, "%s: %s" % (test.__name__, e))
+
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())